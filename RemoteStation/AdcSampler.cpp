@@ -0,0 +1,176 @@
+#include "AdcSampler.h"
+#include "ArduinoWeatherStation.h"
+#include "WeatherProcessing/TwoWire.h"
+#include "Scheduler.h"
+#include <avr/sleep.h>
+
+namespace AdcSampler
+{
+  constexpr byte maxQueue = 4;
+
+  struct Request
+  {
+    byte channel;
+    byte extraBits;
+    AdcCallback callback;
+    unsigned short result;
+  };
+
+  Request requests[maxQueue];
+  volatile byte firstRequest = 0; // Oldest not yet dispatched
+  volatile byte requestCount = 0;
+  volatile byte completedCount = 0; // Done but not dispatched, from firstRequest
+
+  volatile unsigned short sum;
+  volatile byte samplesLeft;
+
+  static inline byte slot(byte idx)
+  {
+    return (firstRequest + idx) % maxQueue;
+  }
+
+  static void startConversion(byte idx)
+  {
+    Request& req = requests[slot(idx)];
+    sum = 0;
+    samplesLeft = 1 << (2 * req.extraBits);
+    // AVcc reference, as per analogRead(pin) with the default reference
+    ADMUX = _BV(REFS0) | (req.channel & 0x07);
+    ADCSRA |= _BV(ADIE) | _BV(ADSC);
+  }
+
+  // ADC_vect's work. Also run by pollAdc when interrupts are off.
+  static inline void conversionComplete()
+  {
+    sum += ADC;
+    if (--samplesLeft)
+    {
+      ADCSRA |= _BV(ADSC);
+      return;
+    }
+    Request& req = requests[slot(completedCount)];
+    req.result = sum >> req.extraBits;
+    completedCount++;
+    if (completedCount < requestCount)
+      startConversion(completedCount);
+    else
+    {
+      ADCSRA &= ~_BV(ADIE); // So analogRead and the internal temperature read still see ADIF
+      Scheduler::post(Scheduler::AdcEvent);
+    }
+  }
+
+  ISR(ADC_vect)
+  {
+    conversionComplete();
+  }
+
+  // With interrupts off ADC_vect can't run, so we watch ADIF ourselves.
+  static void pollAdc()
+  {
+    if (bit_is_clear(ADCSRA, ADIF))
+      return;
+    ADCSRA |= _BV(ADIF); // Writing a one clears it
+    conversionComplete();
+  }
+
+  bool request(byte pin, byte extraBits, AdcCallback callback)
+  {
+    if (pin >= A0)
+      pin -= A0;
+    if (extraBits > maxExtraBits)
+      extraBits = maxExtraBits;
+    // We might be called with interrupts off, leave them that way
+    auto sreg = SREG;
+    noInterrupts();
+    if (requestCount >= maxQueue)
+    {
+      SREG = sreg;
+      return false;
+    }
+    Request& req = requests[slot(requestCount)];
+    req.channel = pin;
+    req.extraBits = extraBits;
+    req.callback = callback;
+    bool idle = completedCount == requestCount;
+    requestCount++;
+    if (idle)
+      startConversion(completedCount);
+    SREG = sreg;
+    return true;
+  }
+
+  bool busy()
+  {
+    return completedCount != requestCount;
+  }
+
+  // Sleep until an interrupt. Noise reduction mode stops clkIO, so only use it if nothing else needs it.
+  // If interrupts are off nothing would wake us, or finish the conversion: poll instead.
+  static void sleepForAdc()
+  {
+    if (bit_is_clear(SREG, SREG_I))
+    {
+      pollAdc();
+      return;
+    }
+    SleepModes allowed = min(solarSleepEnabled, dbSleepEnabled);
+    if (allowed == SleepModes::disabled)
+      return;
+    set_sleep_mode(allowed == SleepModes::powerSave && !Wire_busy() ? SLEEP_MODE_ADC : SLEEP_MODE_IDLE);
+    noInterrupts();
+    if (busy())
+    {
+      sleep_enable();
+      interrupts();
+      sleep_cpu();
+      sleep_disable();
+    }
+    interrupts();
+#ifdef CRYSTAL_FREQ
+    // If timer2 woke us we can't go back to sleep within one TOSC cycle (see sleep() in ArduinoWeatherStation.cpp)
+    OCR2B++;
+    while (ASSR & _BV(OCR2BUB));
+#endif
+  }
+
+  void waitIdle()
+  {
+    while (busy())
+      sleepForAdc();
+  }
+
+  unsigned short read(byte pin, byte extraBits)
+  {
+    while (!request(pin, extraBits, nullptr))
+    {
+      sleepForAdc();
+      dispatch();
+    }
+    // Ours is the last in the queue
+    byte idx = requestCount - 1;
+    while (completedCount <= idx)
+      sleepForAdc();
+    unsigned short ret = requests[slot(idx)].result;
+    dispatch();
+    return ret;
+  }
+
+  void dispatch()
+  {
+    while (completedCount > 0)
+    {
+      // Take it off the queue before the callback, in case it requests again.
+      AdcCallback callback = requests[firstRequest].callback;
+      unsigned short result = requests[firstRequest].result;
+      auto sreg = SREG;
+      noInterrupts();
+      firstRequest = (firstRequest + 1) % maxQueue;
+      requestCount--;
+      completedCount--;
+      SREG = sreg;
+      if (callback)
+        callback(result);
+    }
+  }
+}
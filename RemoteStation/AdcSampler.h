@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+
+// Queued, interrupt driven ADC conversions.
+// Conversions run back to back from the ADC interrupt, and we sleep (ADC noise reduction if we can) while they do.
+// Each request can oversample: 4^extraBits conversions are summed and decimated,
+// so the result is 0 - (1023 << extraBits).
+namespace AdcSampler
+{
+  constexpr byte maxExtraBits = 3; // 64 conversions, the most that fits the 16 bit sum
+
+  typedef void (*AdcCallback)(unsigned short result);
+
+  // Queue a conversion. callback runs from dispatch, in order. Returns false if the queue is full.
+  bool request(byte pin, byte extraBits, AdcCallback callback);
+  // Sleep until the conversion is done rather than spinning on ADSC. With interrupts off it polls ADIF instead.
+  unsigned short read(byte pin, byte extraBits);
+  // Run the callbacks for any completed conversions
+  void dispatch();
+  bool busy();
+  // For code that drives the ADC directly (e.g. internal temperature)
+  void waitIdle();
+}
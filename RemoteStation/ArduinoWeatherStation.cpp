@@ -15,6 +15,11 @@
 #include "PWMSolar.h"
 #include "Flash.h"
 #include "Database.h"
+#include "WeatherProcessing/TwoWire.h"
+#include "AdcSampler.h"
+#include "Scheduler.h"
+#include "Trace.h"
+#include "CrashLog.h"
 
 unsigned long weatherInterval = 2000; //Current weather interval.
 /*unsigned long overrideStartMillis;
@@ -46,7 +51,6 @@ void loop();
 void sleep(adc_t adc_state);
 void restart();
 void sendStackTrace();
-void storeStackTrace();
 void sendNoPingMessage();
 void testCrystal(bool sendAnyway);
 
@@ -237,6 +241,13 @@ void setup() {
     BASE_PRINTLN(F("!! Remote programming failed to initialise !!"));
     SIGNALERROR(REMOTE_PROGRAM_INITALISATION_FAILURE);
   }
+  if (oldSP > 0x100)
+    CrashLog::store();
+  TimerTwo::resetUptime();
+#ifdef TRACE
+  Trace::initialise();
+#endif
+  TRACE_EVENT(Boot, MCUSR_Mirror, oldSP);
   Database::initDatabase();
 
   InitMessaging();
@@ -247,13 +258,9 @@ void setup() {
   BASE_PRINTLN(F("Weather initialised"));
 
   if (oldSP > 0x100)
-  {
-#ifndef NO_STORAGE
-    storeStackTrace();
-#endif
     sendStackTrace();
-  }
   canarifyStackDump();
+  resetStackLowWater();
 
   BASE_PRINTLN(F("Messaging Initialised"));
   
@@ -267,7 +274,11 @@ void sendStackTrace()
 {
   byte buffer[254];
   LoraMessageDestination msg(false, buffer, sizeof(buffer), 'S', 0x00);
-	msg.appendT(oldSP);
+  // The top bit says the low water marks follow: (SP:2)(Count:1)(LowWater:2)...(Stack)
+  msg.appendT((unsigned short)(oldSP | 0x8000));
+  msg.appendByte2(StackSectionCount);
+  for (byte i = 0; i < StackSectionCount; i++)
+    msg.appendT(stackLowWater[i]);
   byte size = STACK_DUMP_SIZE;
   unsigned short oldStackSize = (unsigned short)&__stack - oldSP;
   if (size > oldStackSize)
@@ -275,22 +286,10 @@ void sendStackTrace()
   msg.append((byte*)&oldStack, size);
 }
 
-__attribute__((noinline))
-void storeStackTrace()
-{
-  byte buffer[STACK_DUMP_SIZE + 2];
-  byte size = STACK_DUMP_SIZE;
-  unsigned short oldStackSize = (unsigned short)&__stack - oldSP;
-  if (size > oldStackSize)
-    size = oldStackSize;
-  *((unsigned short*)buffer) = oldSP;
-  memcpy(buffer + 2, (void*)&oldStack, size);
-  Database::storeData('S', stationID, buffer, size + 2);
-}
-
 void sendNoPingMessage()
 {
   BASE_PRINTLN(F("Ping timeout message!"));
+  TRACE_EVENT(NoPing, (millis() - lastPingMillis) / 60000, 0);
   byte buffer[20];
   LoraMessageDestination msg(false, buffer, sizeof(buffer), 'K', MessageHandling::getUniqueID());
 	msg.append(F("PTimeout"), 8);
@@ -318,16 +317,18 @@ void testCrystal(bool sendAnyway)
 __attribute__((noinline))
 void loop() {
   //BASE(auto loopMicros = micros());
-  static byte counter = 0;
-  constexpr byte cystalTestInterval = 50;
+  Scheduler::startLoop();
+  // By time rather than loop count, we don't go round the loop every tick any more.
+  static unsigned long lastCrystalTestMillis = 0;
+  constexpr unsigned long cystalTestInterval = 50 * TimerTwo::MillisPerTick;
 
-  if (++counter == cystalTestInterval)
+  if (millis() - lastCrystalTestMillis >= cystalTestInterval)
   {
     if ((rand() & 0x0F) == 1)
     {
       testCrystal(false);
     }
-    counter = 0;
+    lastCrystalTestMillis = millis();
   }
   static bool noPingSent = false;
 
@@ -342,6 +343,9 @@ void loop() {
 #ifndef NO_STORAGE
   Database::doProcessing();
 #endif
+#ifdef TRACE_FLASH
+  Trace::spill();
+#endif
   
   #ifdef DEBUG
   messageDebugAction();
@@ -376,12 +380,14 @@ void loop() {
     {
       MessageHandling::sendWeatherMessage();
       BASE_PRINTLN(F("Weather message sent."));
+      stackCheckpoint(StackWeather);
     }
 
     if (millis() - lastStatusMillis > millisBetweenStatus)
     {
       MessageHandling::sendStatusMessage();
     }
+    Scheduler::setDeadline(Scheduler::Status, lastStatusMillis + millisBetweenStatus + 1);
 #ifdef SOLAR_PWM
     PwmSolar::doPwmLoop();
 #endif
@@ -398,7 +404,9 @@ void loop() {
     sendNoPingMessage();
     noPingSent = true;
   }
-  if (StackCount() == 0)
+  Scheduler::setDeadline(Scheduler::Ping, lastPingMillis + maxMillisBetweenPings);
+  Scheduler::setDeadline(Scheduler::Watchdog, millis() + watchdogKickMillis);
+  if (stackCheckpoint(StackOther) == 0)
     while(1);  
   #if 0 //DEBUG
   loopMicros = micros() - loopMicros;
@@ -438,6 +446,10 @@ void yield()
 void sleep(adc_t adc_state)
 {
   SleepModes sleepMode = min(solarSleepEnabled, dbSleepEnabled);
+  // The TWI clock stops in power save, so a vane read in progress means idle.
+  bool twiActive = Wire_busy();
+  if (twiActive && sleepMode == SleepModes::powerSave)
+    sleepMode = SleepModes::idle;
   //If we've disabled sleep for some reason...
   if (sleepMode == SleepModes::disabled)
   {
@@ -446,6 +458,12 @@ void sleep(adc_t adc_state)
   // Or interrupts aren't enabled (= no wakeup)
   if (bit_is_clear(SREG, SREG_I))
     return;
+  // Queued conversions would stop in power save. Sleep through them, then go round the loop to hand out the results.
+  if (AdcSampler::busy())
+  {
+    AdcSampler::waitIdle();
+    return;
+  }
 #ifdef DEBUG
   // Or there's data in the serial buffer
   if (bit_is_set(UCSR0B, UDRIE0) || bit_is_clear(UCSR0A, TXC0))
@@ -456,54 +474,67 @@ void sleep(adc_t adc_state)
 #else
   timer2_t timer2State = (batteryMode == BatteryMode::DeepSleep && adc_state == ADC_OFF) ? TIMER2_OFF : TIMER2_ON;
 #endif
-  if (timer2State == TIMER2_OFF)
-    wdt_dontRestart = true;
-  else
+  // Most interrupts (timer ticks, wind ticks) don't leave anything for the main loop to do.
+  // Go straight back to sleep until something is posted or due.
+  // Without timer2 there's no clock for the deadlines, so any interrupt wakes us.
+  bool keepSleeping;
+  do
   {
-    // Even though we do the ASSR check after we wake up from sleep, 
-    // there is a small chance the ISR could fire while we're awake.
-    // This is just some paranoia to ensure we don't get a second interrupt.
-    while (TCNT2 == 0xFF || TCNT2 <= 0x01); 
-  }
-
-  if (sleepMode == SleepModes::powerSave)
-  {
-    LowPower.powerSave(SLEEP_FOREVER, //Low power library messes with our watchdog timer, so we lie and tell it to sleep forever.
-      adc_state,
-      BOD_ON,
-      timer2State
-    );
-  }
-  else if (sleepMode == SleepModes::idle)
-  {
-    // note that these *_ON just tell LowPower not to mess with the PRR, they don't actually turn things on. 
-    // TODO: Test what happens if we turn off SPI & TWI.
-    LowPower.idle(SLEEP_FOREVER,
-                  adc_state,
-                  timer2State,
-                  TIMER1_ON, 
-                  TIMER0_ON, 
-                  SPI_OFF,
-                  USART0_ON, 
-                  TWI_OFF);
-  }
-  // Ensure that any calls to millis will work properly, 
-  // and that we won't have problems returning to sleep.
-  // OCR2B isn't used, this just ensures we wait at least one TOSC cycle.
-  #ifdef CRYSTAL_FREQ
-  OCR2B++;
-  while (ASSR & _BV(OCR2BUB));
-  #endif
+    if (timer2State == TIMER2_OFF)
+      wdt_dontRestart = true;
+    else
+    {
+      // Even though we do the ASSR check after we wake up from sleep, 
+      // there is a small chance the ISR could fire while we're awake.
+      // This is just some paranoia to ensure we don't get a second interrupt.
+      while (TCNT2 == 0xFF || TCNT2 <= 0x01); 
+    }
 
-  // The re-enable isn't guarded to make it harder for runaway code to disable the watchdog timer
-  wdt_dontRestart = false;
-  if (timer2State == TIMER2_OFF)
-  {
-    // If there was no wind tick or message received,
-    // then we might have been woken by the watchdog timer going off. 
-    // In that case we need to re-enable the interrupt.
-    WDTCSR |= (1 << WDIE);
-  }
+    if (sleepMode == SleepModes::powerSave)
+    {
+      LowPower.powerSave(SLEEP_FOREVER, //Low power library messes with our watchdog timer, so we lie and tell it to sleep forever.
+        adc_state,
+        BOD_ON,
+        timer2State
+      );
+    }
+    else if (sleepMode == SleepModes::idle)
+    {
+      // note that these *_ON just tell LowPower not to mess with the PRR, they don't actually turn things on. 
+      // TODO: Test what happens if we turn off SPI & TWI.
+      // Every TWI byte wakes us. Rather than go round the main loop for each of them,
+      // stay asleep until the vane read is done. Anything else that woke us waits at most ~1ms.
+      do
+      {
+        LowPower.idle(SLEEP_FOREVER,
+                      adc_state,
+                      timer2State,
+                      TIMER1_ON, 
+                      TIMER0_ON, 
+                      SPI_OFF,
+                      USART0_ON, 
+                      twiActive ? TWI_ON : TWI_OFF);
+      } while (twiActive && Wire_busy());
+    }
+    // Ensure that any calls to millis will work properly, 
+    // and that we won't have problems returning to sleep.
+    // OCR2B isn't used, this just ensures we wait at least one TOSC cycle.
+    #ifdef CRYSTAL_FREQ
+    OCR2B++;
+    while (ASSR & _BV(OCR2BUB));
+    #endif
+
+    // The re-enable isn't guarded to make it harder for runaway code to disable the watchdog timer
+    wdt_dontRestart = false;
+    if (timer2State == TIMER2_OFF)
+    {
+      // If there was no wind tick or message received,
+      // then we might have been woken by the watchdog timer going off. 
+      // In that case we need to re-enable the interrupt.
+      WDTCSR |= (1 << WDIE);
+    }
+    keepSleeping = timer2State == TIMER2_ON && !Scheduler::wakeRequired(millis());
+  } while (keepSleeping);
 }
 
 void updateBatterySavings()
@@ -533,6 +564,7 @@ void enterDeepSleep()
 {
   BASE_PRINTLN(F("Entering Deep Sleep"));
   batteryMode = BatteryMode::DeepSleep;
+  TRACE_EVENT(BatteryModeChange, (byte)batteryMode, batteryReading_mV);
   WeatherProcessing::enterDeepSleep();
   updateIdleState();
 #ifdef SOLAR_PWM
@@ -544,6 +576,7 @@ void enterDeepSleep()
 void enterBatterySave()
 {
   batteryMode = BatteryMode::Save;
+  TRACE_EVENT(BatteryModeChange, (byte)batteryMode, batteryReading_mV);
   WeatherProcessing::enterBatterySave();
   updateIdleState();
 }
@@ -551,6 +584,7 @@ void enterBatterySave()
 void enterNormalMode()
 {
   batteryMode = BatteryMode::Normal;
+  TRACE_EVENT(BatteryModeChange, (byte)batteryMode, batteryReading_mV);
   WeatherProcessing::enterNormalMode();
   updateIdleState();
 }
@@ -558,6 +592,7 @@ void enterNormalMode()
 void enterStasis()
 {
   batteryMode = BatteryMode::Stasis;
+  TRACE_EVENT(BatteryModeChange, (byte)batteryMode, batteryReading_mV);
   WeatherProcessing::enterDeepSleep();
   sleepRadio();
   TimerTwo::slowDown();
@@ -614,6 +649,7 @@ void signalError(uint16_t errorCode, const byte delay_ms)
     return;
   lastErrorSeconds = TimerTwo::seconds();
   lastErrorCode = errorCode;
+  TRACE_EVENT(Error, errorCode, 0);
 #ifdef DARK
   return;
 #endif
@@ -9,6 +9,8 @@
 #ifdef MODEM
 #define GET_CRC_FAILURES
 #endif
+// Stations want each packet's own signal quality for routing (Routing.h), not whatever the radio heard last.
+#define GET_PACKET_METADATA
 
 #ifdef DEBUG
 #define AWS_DEBUG_PRINT(...) do { \
@@ -114,6 +116,7 @@ inline constexpr unsigned long serialBaud =
 #endif
 inline constexpr unsigned long millisBetweenStatus = 600000; //We send our status messages every ten minutes.
 inline constexpr unsigned long maxMillisBetweenPings = 1300000; //If we don't receive a ping in just under 20 minutes, we restart.
+inline constexpr unsigned long watchdogKickMillis = 2000; //We sleep through ticks with nothing to do, but must wake to reset the 8s watchdog.
 inline constexpr unsigned short batteryHysterisis_mV = 50;
 
 #ifdef FCC_COMPLIANT
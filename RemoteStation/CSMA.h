@@ -4,6 +4,7 @@
 #include "lib/RadioLib/src/Radiolib.h"
 #include "ArduinoWeatherStation.h"
 #include "StackCanary.h"
+#include "Scheduler.h"
 
 inline uint8_t getLowNibble(const uint8_t input) { return input & 0x0F; }
 inline uint8_t getHiNibble(const uint8_t input) { return (input >> 4) & 0xF0; }
@@ -35,6 +36,18 @@ inline int16_t lora_check(const int16_t result, const __FlashStringHelper* msg)
 #define LORA_CHECK(A) lora_check(A, F("LORA_CHECK FAILED: "))
 #endif
 
+#ifdef GET_PACKET_METADATA
+// Captured as each packet comes off the radio, so it isn't muddled with later packets.
+struct PacketMetadata
+{
+#ifdef MODEM
+  uint32_t micros; // When the radio signalled RxDone
+#endif
+  int16_t rssi_x2; // dBm * 2
+  int8_t snr_x4;   // dB * 4
+};
+#endif
+
 enum class IdleStates : byte {
   NotInitialised,
   ContinuousReceive,
@@ -167,6 +180,9 @@ class CSMAWrapper
       uint16_t* timestamp
 #ifdef GET_CRC_FAILURES
       ,bool* crcMismatch
+#endif
+#ifdef GET_PACKET_METADATA
+      ,PacketMetadata* metadata
 #endif
       ) {
       // handle any available packet from the modem if we have space:
@@ -191,6 +207,9 @@ class CSMAWrapper
       *timestamp = _messageTimestamps[_readBufferLenIdx];
 #ifdef GET_CRC_FAILURES
       *crcMismatch = _crcMismatches[_readBufferLenIdx];
+#endif
+#ifdef GET_PACKET_METADATA
+      *metadata = _metadata[_readBufferLenIdx];
 #endif
       _checkedOut = true;
       if (length == 0)
@@ -205,6 +224,19 @@ class CSMAWrapper
       return(state);
     }
 
+    uint8_t messagesWaiting()
+    {
+      return _writeBufferLenIdx - _readBufferLenIdx;
+    }
+
+    // Length of the message dequeueMessage would return next, or zero if there isn't one.
+    uint8_t peekMessageLength()
+    {
+      if (_checkedOut || _readBufferLenIdx >= _writeBufferLenIdx)
+        return 0;
+      return _messageLengths[_readBufferLenIdx];
+    }
+
     void doneWithBuffer()
     {
       _checkedOut = false;
@@ -267,6 +299,18 @@ class CSMAWrapper
         _messageTimestamps[_writeBufferLenIdx] = millis16();
 #ifdef GET_CRC_FAILURES
         _crcMismatches[_writeBufferLenIdx] = state == ERR_CRC_MISMATCH;
+#endif
+#ifdef GET_PACKET_METADATA
+#ifdef MODEM
+        _metadata[_writeBufferLenIdx].micros = s_packetMicros;
+        _metadata[_writeBufferLenIdx].rssi_x2 = _base->getRSSI() * 2;
+        _metadata[_writeBufferLenIdx].snr_x4 = _base->getSNR() * 4;
+#else
+        // The same registers without the floating point: (-RSSI*2:1)(SNR*4:1)
+        uint32_t packetStatus = _base->getPacketStatus();
+        _metadata[_writeBufferLenIdx].rssi_x2 = -(int16_t)(packetStatus & 0xFF);
+        _metadata[_writeBufferLenIdx].snr_x4 = (packetStatus >> 8) & 0xFF;
+#endif
 #endif
         _writeBufferLenIdx++;
       }
@@ -343,6 +387,9 @@ class CSMAWrapper
     uint16_t _messageTimestamps[maxQueue];
 #ifdef GET_CRC_FAILURES
     bool _crcMismatches[maxQueue];
+#endif
+#ifdef GET_PACKET_METADATA
+    PacketMetadata _metadata[maxQueue];
 #endif
     bool _checkedOut = false;
     uint8_t _readBufferLenIdx = 0;
@@ -376,10 +423,19 @@ class CSMAWrapper
 
     static volatile bool s_packetWaiting;
     static volatile uint8_t s_packetCounter;
+#ifdef MODEM
+    static volatile uint32_t s_packetMicros;
+#endif
     static void rxDoneActionStatic()
     {
       s_packetWaiting = true;
       s_packetCounter++;
+#ifndef MODEM
+      Scheduler::post(Scheduler::RadioEvent);
+#endif
+#ifdef MODEM
+      s_packetMicros = micros();
+#endif
     }
 };
 
@@ -388,4 +444,9 @@ volatile bool CSMAWrapper<T, bs, mp>::s_packetWaiting = false;
 
 template<class T, uint8_t bs, uint8_t mp>
 volatile uint8_t CSMAWrapper<T, bs, mp>::s_packetCounter = 0;
+
+#ifdef MODEM
+template<class T, uint8_t bs, uint8_t mp>
+volatile uint32_t CSMAWrapper<T, bs, mp>::s_packetMicros = 0;
+#endif
 #endif
\ No newline at end of file
@@ -8,6 +8,9 @@
 #include "PWMSolar.h"
 #include "Flash.h"
 #include "Database.h"
+#include "StackCanary.h"
+#include "Trace.h"
+#include "Routing.h"
 
 #ifdef DEBUG_COMMANDS
 #define COMMAND_PRINT AWS_DEBUG_PRINT
@@ -117,6 +120,7 @@ namespace Commands
 
           case 'P':
             handled = RemoteProgramming::handleProgrammingCommand(msg, uniqueID, &ackRequired);
+            stackCheckpoint(StackProgramming);
             break;
 
           case 'U': // Change ID
@@ -129,11 +133,13 @@ namespace Commands
 
           case 'G': // Flash (Gordon)
             handled = Flash::handleFlashCommand(msg, uniqueID, &ackRequired);
+            stackCheckpoint(StackProgramming);
             break;
 
   #ifndef  NO_STORAGE
           case 'D':
             handled = Database::handleDatabaseCommand(msg, uniqueID, &ackRequired);
+            stackCheckpoint(StackDatabase);
             break;
   #endif // ! NO_STORAGE
           case 'S':
@@ -144,6 +150,7 @@ namespace Commands
           //do nothing. handled = false, so we send "IGNORED"
           break;
         }
+        TRACE_EVENT(Command, command, handled);
       }
       msg.trim(-2);
     }
@@ -160,10 +167,21 @@ namespace Commands
   }
 
   //Relay command: C(ID)(UID)R(dataLength)((+|-)(C|W)(RelayID))*
+  //           or: C(ID)(UID)RA(0|1) to turn automatic routing (Routing.h) off or on
   bool handleRelayCommand(MessageSource& msg)
   {
     byte types[] = { 'W', 'C', 'R' };
     byte loc = msg.getCurrentLocation();
+    byte first;
+    if (msg.readByte(first) == MESSAGE_OK && first == 'A')
+    {
+      bool autoRoute;
+      if (msg.read(autoRoute))
+        return false;
+      SET_PERMANENT_S(autoRoute);
+      return true;
+    }
+    PermanentStorage::Transaction transaction;
     for (byte curType : types)
     {
       COMMAND_PRINTVAR(curType);
@@ -268,6 +286,7 @@ namespace Commands
   }
 
   //Interval command: C(ID)(UID)I(length)(new short interval)(new long interval)
+  //Interval command: C(ID)(UID)I(short:4)(long:4)[(heartbeat intervals)(speed_x2)(gust_x2)(direction)]
   bool handleIntervalCommand(MessageSource& msg)
   {
     unsigned long shortInterval, longInterval;
@@ -277,6 +296,21 @@ namespace Commands
     if (msg.read(longInterval))
       return false;
 
+    PermanentStorage::Transaction transaction;
+    byte heartbeatIntervals;
+    if (msg.readByte(heartbeatIntervals) == MESSAGE_OK)
+    {
+      byte reportSpeedThreshold_x2, reportGustThreshold_x2, reportDirectionThreshold;
+      if (msg.readByte(reportSpeedThreshold_x2) ||
+          msg.readByte(reportGustThreshold_x2) ||
+          msg.readByte(reportDirectionThreshold))
+        return false;
+      SET_PERMANENT_S(heartbeatIntervals);
+      SET_PERMANENT_S(reportSpeedThreshold_x2);
+      SET_PERMANENT_S(reportGustThreshold_x2);
+      SET_PERMANENT_S(reportDirectionThreshold);
+    }
+
     SET_PERMANENT_S(shortInterval);
     SET_PERMANENT_S(longInterval);
     if (batteryMode == BatteryMode::Normal)
@@ -326,6 +360,7 @@ namespace Commands
     if (msg.read(batteryThreshold_mV) ||
         msg.read(batteryEmergencyThresh_mV))
       return false;
+    PermanentStorage::Transaction transaction;
     SET_PERMANENT_S(batteryThreshold_mV);
     SET_PERMANENT_S(batteryEmergencyThresh_mV);
     return true;
@@ -346,6 +381,13 @@ namespace Commands
     if (msg.read(safeFreezingPwm))
       return false;
 
+    PermanentStorage::Transaction transaction;
+    bool solarMppt;
+    if (msg.read(solarMppt) == MESSAGE_OK)
+    {
+      SET_PERMANENT_S(solarMppt);
+      PwmSolar::solarMppt = solarMppt;
+    }
     SET_PERMANENT_S(chargeVoltage_mV);
     SET_PERMANENT_S(chargeResponseRate);
     SET_PERMANENT_S(safeFreezingChargeLevel_mV);
@@ -388,6 +430,15 @@ namespace Commands
     case 'V':
       handleQueryVolatileCommand(response);
       break;
+    case 'S':
+      // (Count:1)(LowWater:2)...
+      response.appendByte2(StackSectionCount);
+      for (byte i = 0; i < StackSectionCount; i++)
+        response.appendT(stackLowWater[i]);
+      break;
+    case 'R':
+      Routing::appendRouteQuery(response);
+      break;
     default:
       response.abort();
       return false;
@@ -422,7 +473,8 @@ namespace Commands
     constexpr byte messageSize = 35
       + sizeof(MessageHandling::recentlySeenStations)
       + sizeof(recentlyHandledCommands)
-      + sizeof(MessageHandling::recentlyRelayedMessages);
+      + sizeof(MessageHandling::recentlyRelayedMessages)
+      + sizeof(MessageHandling::stationHeartbeats_4s);
     static_assert(messageSize < 250);
     response.getBuffer(&buffer, messageSize);
     *(unsigned long*)buffer = curMillis; //+4 = 4
@@ -443,7 +495,7 @@ namespace Commands
     buffer += 4;
     *(unsigned long*)buffer = TimerTwo::seconds(); // +4 = 20
     buffer += 4;
-    *(unsigned short*)buffer = StackCount(); // +2 = 22
+    *(unsigned short*)buffer = stackLowWaterMin(); // +2 = 22
     buffer += 2;
     const uint8_t* p1 = &_end;
     *(unsigned short*)buffer = SP - (unsigned short)p1; //+2 = 24
@@ -456,6 +508,8 @@ namespace Commands
     buffer += 1;
     *(unsigned short*)buffer = MessageHandling::_relayResendRate; //+2 = 35
     buffer += 2;
+    memcpy(buffer, MessageHandling::stationHeartbeats_4s, sizeof(MessageHandling::stationHeartbeats_4s));
+    buffer += sizeof(MessageHandling::stationHeartbeats_4s);
     return;
 #endif
   }
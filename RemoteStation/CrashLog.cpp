@@ -0,0 +1,147 @@
+#include "CrashLog.h"
+#include "ArduinoWeatherStation.h"
+#include "Flash.h"
+#include "LoraMessaging.h"
+#include "StackCanary.h"
+#include "TimerTwo.h"
+#include "Trace.h"
+
+extern uint8_t __stack;
+
+namespace CrashLog
+{
+  constexpr unsigned short magic = 0x5AC3;
+  constexpr unsigned long regionLen = Flash::flashSize - Flash::crashLogStart;
+  constexpr byte slotCount = regionLen / recordSize;
+  constexpr byte slotsPerBlock = Flash::flashBlockSize / recordSize;
+  constexpr unsigned short lowWaterOffset = sizeof(Header);
+  constexpr unsigned short traceOffset = lowWaterOffset + sizeof(stackLowWater);
+  constexpr unsigned short stackOffset = partSize;
+  constexpr byte headersPerMessage = 6;
+#ifdef TRACE
+  constexpr byte traceRecords = TRACE_RECORDS < maxTraceRecords ? TRACE_RECORDS : maxTraceRecords;
+  static_assert(traceOffset + traceRecords * sizeof(Trace::Record) <= stackOffset, "The trace has to fit before the stack");
+#endif
+  static_assert(stackOffset + STACK_DUMP_SIZE <= recordSize, "The stack has to fit in the record");
+
+  static unsigned long slotAddress(byte slot)
+  {
+    return Flash::crashLogStart + (unsigned long)slot * recordSize;
+  }
+
+  void store()
+  {
+    if (!Flash::flashOK)
+      return;
+    Flash::flash.wakeup();
+    // Find the latest
+    bool found = false;
+    byte slot = slotCount - 1;
+    unsigned short number = 0;
+    for (byte i = 0; i < slotCount; i++)
+    {
+      unsigned short header[2];
+      Flash::flash.readBytes(slotAddress(i), header, sizeof(header));
+      if (header[0] == magic && (!found || (short)(header[1] - number) > 0))
+      {
+        found = true;
+        slot = i;
+        number = header[1];
+      }
+    }
+    slot = (slot + 1) % slotCount;
+    if (found)
+      number++;
+    // Starting a block: lose the oldest
+    if (slot % slotsPerBlock == 0)
+      Flash::flash.blockErase4K(slotAddress(slot));
+
+    unsigned long address = slotAddress(slot);
+    Header header;
+    header.magic = magic;
+    header.number = number;
+    strncpy(header.revision, REV_ID, sizeof(header.revision));
+    // The watchdog interrupt's return address is the first thing on the dumped stack, high byte first.
+    header.pc = (unsigned short)(&oldStack)[0] << 8 | (&oldStack)[1];
+    header.sp = oldSP;
+    header.mcusr = MCUSR_Mirror;
+    header.batteryMode = oldBatteryMode;
+    header.time = TimerTwo::seconds();
+    header.uptime = TimerTwo::uptime();
+    header.millisPerTick = TimerTwo::MillisPerTick;
+    header.ticksTop = TIMER2_TOP;
+    header.stackSections = StackSectionCount;
+    header.stackSize = STACK_DUMP_SIZE;
+    unsigned short oldStackSize = (unsigned short)&__stack - oldSP;
+    if (header.stackSize > oldStackSize)
+      header.stackSize = oldStackSize;
+#ifdef TRACE
+    byte trace[traceRecords * sizeof(Trace::Record)];
+    header.traceRecords = traceRecords;
+    header.traceNext = Trace::copyRecords(trace, traceRecords);
+    Flash::flash.writeBytes(address + traceOffset, trace, sizeof(trace));
+#else
+    header.traceRecords = 0;
+    header.traceNext = 0;
+#endif
+    Flash::flash.writeBytes(address + lowWaterOffset, (void*)stackLowWater, sizeof(stackLowWater));
+    Flash::flash.writeBytes(address + stackOffset, (void*)&oldStack, header.stackSize);
+    // The header last, so a half written record doesn't count
+    Flash::flash.writeBytes(address, &header, sizeof(header));
+    Flash::flash.sleep();
+  }
+
+  bool handleCrashLogCommand(MessageSource& msg, byte uniqueID, bool* ackRequired)
+  {
+    byte type, slot;
+    if (msg.read(type) || msg.read(slot) || slot >= slotCount)
+      return false;
+    byte part = 0;
+    byte count;
+    unsigned short offset = 0;
+    if (type == 'H')
+    {
+      count = slotCount - slot;
+      if (count > headersPerMessage)
+        count = headersPerMessage;
+      count *= sizeof(Header);
+    }
+    else if (type == 'B')
+    {
+      if (msg.read(part))
+        return false;
+      offset = (unsigned short)part * partSize;
+      if (offset >= recordSize)
+        return false;
+      count = recordSize - offset < partSize ? recordSize - offset : partSize;
+    }
+    else
+      return false;
+
+    byte msgBuffer[254];
+    LoraMessageDestination dest(false, msgBuffer, sizeof(msgBuffer), 'K', uniqueID);
+    dest.appendByte2('F');
+    dest.appendByte2('C');
+    dest.appendByte2(type);
+    dest.appendByte2(slot);
+    if (type == 'B')
+      dest.appendByte2(part);
+    byte* buffer;
+    if (dest.getBuffer(&buffer, count))
+    {
+      dest.abort();
+      return false;
+    }
+    Flash::flash.wakeup();
+    if (type == 'H')
+    {
+      for (byte i = 0; i < count / sizeof(Header); i++)
+        Flash::flash.readBytes(slotAddress(slot + i), buffer + i * sizeof(Header), sizeof(Header));
+    }
+    else
+      Flash::flash.readBytes(slotAddress(slot) + offset, buffer, count);
+    Flash::flash.sleep();
+    *ackRequired = false;
+    return true;
+  }
+}
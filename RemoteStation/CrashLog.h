@@ -0,0 +1,47 @@
+#pragma once
+#include <Arduino.h>
+#include "MessagingCommon.h"
+
+// Every time the watchdog catches us, setup writes a record to the top of the SPI flash (Flash::crashLogStart).
+// sendStackTrace only tells whoever is listening right after the reset; this keeps the last 8 to 16 of them,
+// so a station that locks up now and then can be looked at later.
+//
+// A record is a 512 byte slot:
+//   0: Header (32 bytes)
+//  32: (LowWater:2)...  stackSections of them (StackCanary.h)
+//    : (Trace:8)...     traceRecords of them, oldest first (Trace.h)
+// 200: (Stack)...       stackSize bytes from oldSP + 1
+namespace CrashLog
+{
+  constexpr unsigned short recordSize = 512;
+  constexpr byte partSize = 200;
+  constexpr byte maxTraceRecords = 16;
+
+  struct Header
+  {
+    unsigned short magic;   // Tells a record from erased flash or old database data
+    unsigned short number;  // Counts crashes, the highest is the latest
+    char revision[8];       // REV_ID we came back up with
+    unsigned short pc;      // Word address the watchdog interrupted
+    unsigned short sp;
+    byte mcusr;
+    byte batteryMode;
+    unsigned long time;     // TimerTwo::seconds() when we came back, within a watchdog timeout of the crash
+    unsigned long uptime;   // Seconds we'd been running
+    byte stackSections;
+    byte traceRecords;
+    byte traceNext;         // Trace sequence number after the last one in the record
+    byte stackSize;
+    byte millisPerTick;     // To read the trace times
+    byte ticksTop;          // TIMER2_TOP
+  };
+  static_assert(sizeof(Header) == 32, "Incorrect size for CrashLog::Header");
+
+  // From setup, after Flash::flashInit, if the watchdog reset us
+  void store();
+
+  // After the 'GC' of a flash command:
+  // GCH(First:1)            : Replies FCH(First:1)(Header)... for the slots from First. Empty slots have magic 0xFFFF.
+  // GCB(Slot:1)(Part:1)     : Replies FCB(Slot:1)(Part:1)(Bytes...), partSize bytes of the slot from Part * partSize.
+  bool handleCrashLogCommand(MessageSource& msg, byte uniqueID, bool* ackRequired);
+}
@@ -4,6 +4,8 @@
 #include "LoraMessaging.h"
 #include "MessageHandling.h"
 #include "ArduinoWeatherStation.h"
+#include "Scheduler.h"
+#include "StackCanary.h"
 
 #ifdef DEBUG_DATABASE
 #define DATABASE_PRINTLN AWS_DEBUG_PRINTLN
@@ -39,7 +41,11 @@ namespace Database
     byte isValid; // 1
   };
 
-  constexpr unsigned long totalMemory = 512ul * 1024;
+#ifdef TRACE_FLASH
+  constexpr unsigned long totalMemory = Flash::traceStart;
+#else
+  constexpr unsigned long totalMemory = Flash::crashLogStart;
+#endif
 
   constexpr unsigned short blockSize = 4096;
   constexpr unsigned long messageFatStart = 32768;
@@ -259,7 +265,10 @@ namespace Database
       return;
     case ProcessingActions::Cleaning:
     case ProcessingActions::Searching:
+      // Keep coming back every tick until we're done
+      Scheduler::setDeadline(Scheduler::Database, millis());
       doSearch();
+      stackCheckpoint(StackDatabase);
       break;
     }
   }
@@ -0,0 +1,116 @@
+#include "DuplicateFilter.h"
+#include "KissMessaging.h"
+#include "ArduinoWeatherStation.h"
+#include <util/crc16.h>
+
+namespace DuplicateFilter
+{
+  constexpr byte maxEntries = 6;
+  constexpr byte maxRssis = 4;
+
+  struct Entry
+  {
+    byte type; // Without the relay bit
+    byte stationID;
+    byte uniqueID;
+    byte count; // Zero if the entry is unused
+    unsigned short payloadCrc;
+    unsigned short firstMillis;
+    int16_t rssis_x2[maxRssis];
+  };
+
+  unsigned short windowMillis = 0;
+  Entry entries[maxEntries];
+
+  void sendAnnotation(Entry& entry)
+  {
+    KissMessageDestination msg(false);
+    msg.appendByte('X');
+    msg.appendByte(0x0A); //Message type
+    msg.appendByte(0x00); //Station ID
+    msg.appendByte(0x00); //Unique ID
+    msg.appendByte(entry.type);
+    msg.appendByte(entry.stationID);
+    msg.appendByte(entry.uniqueID);
+    msg.appendByte(entry.count);
+    byte rssiCount = entry.count < maxRssis ? entry.count : maxRssis;
+    msg.append((byte*)entry.rssis_x2, rssiCount * sizeof(entry.rssis_x2[0]));
+    msg.finishAndSend();
+  }
+
+  void retire(Entry& entry)
+  {
+    if (entry.count > 1)
+      sendAnnotation(entry);
+    entry.count = 0;
+  }
+
+  void sendExpired()
+  {
+    unsigned short now = millis16();
+    for (byte i = 0; i < maxEntries; i++)
+    {
+      if (entries[i].count && now - entries[i].firstMillis > windowMillis)
+        retire(entries[i]);
+    }
+  }
+
+  bool isDuplicate(LoraMessageSource& msg)
+  {
+    if (!windowMillis || msg._crcMismatch)
+      return false;
+
+    // 'X' (type) (stationID) (uniqueID) (payload...)
+    byte start = msg.getCurrentLocation();
+    byte length = msg.getMessageLength() - start;
+    byte* buffer;
+    if (length < 4 || msg.accessBytes(&buffer, length) != MESSAGE_OK)
+      return false;
+    msg.seek(start);
+
+    byte type = buffer[1] & 0x7F;
+    unsigned short crc = 0xFFFF;
+    for (byte i = 4; i < length; i++)
+      crc = _crc_ccitt_update(crc, buffer[i]);
+
+    sendExpired();
+
+    Entry* oldest = &entries[0];
+    Entry* unused = nullptr;
+    unsigned short now = millis16();
+    for (byte i = 0; i < maxEntries; i++)
+    {
+      Entry& entry = entries[i];
+      if (!entry.count)
+      {
+        unused = &entry;
+        continue;
+      }
+      if (entry.type == type && entry.stationID == buffer[2] &&
+        entry.uniqueID == buffer[3] && entry.payloadCrc == crc)
+      {
+        if (entry.count < maxRssis)
+          entry.rssis_x2[entry.count] = msg._metadata.rssi_x2;
+        if (entry.count < 255)
+          entry.count++;
+        return true;
+      }
+      if (now - entry.firstMillis > now - oldest->firstMillis)
+        oldest = &entry;
+    }
+
+    if (!unused)
+    {
+      retire(*oldest);
+      unused = oldest;
+    }
+    unused->type = type;
+    unused->stationID = buffer[2];
+    unused->uniqueID = buffer[3];
+    unused->payloadCrc = crc;
+    unused->firstMillis = now;
+    unused->rssis_x2[0] = msg._metadata.rssi_x2;
+    unused->count = 1;
+    return false;
+  }
+}
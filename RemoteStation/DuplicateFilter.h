@@ -0,0 +1,18 @@
+#pragma once
+#include "LoraMessaging.h"
+
+// Modem side duplicate suppression.
+// In a relay mesh we hear the same message from the origin and again from each relay.
+// Only the first copy goes to the host. If we hear it again within the window, the host later gets
+// an 'X' 0x0A frame saying how many times it was heard and at what RSSIs.
+namespace DuplicateFilter
+{
+  // Zero disables the filter.
+  extern unsigned short windowMillis;
+
+  // Returns true if msg has been seen within the window. Doesn't move msg's read position.
+  bool isDuplicate(LoraMessageSource& msg);
+
+  // Sends annotations for entries whose window has closed.
+  void sendExpired();
+}
@@ -12,6 +12,11 @@ constexpr short CSMA_UNEXPECTED_ZERO_LENGTH = -1004;
 
 constexpr short WX_CALIBRATION_FAILED = 0x11;
 constexpr short WX_CALIBRATION_FAILED_BAD_VOLTAGE = 0x12;
+// See WindFaults.h
+constexpr short WX_FAULT_CUPS_STOPPED = 0x13;
+constexpr short WX_FAULT_VANE_FROZEN = 0x14;
+constexpr short WX_FAULT_CUPS_NOISE = 0x15;
+constexpr short WX_FAULT_FIELD_DRIFT = 0x16;
 
 constexpr short REMOTE_PROGRAM_INITALISATION_FAILURE = 0x21;
 
@@ -1,5 +1,7 @@
 #include "Flash.h"
 #include "LoraMessaging.h"
+#include "Trace.h"
+#include "CrashLog.h"
 
 namespace Flash
 {  
@@ -18,13 +20,21 @@ namespace Flash
   bool handleFlashCommand(MessageSource& msg, const byte uniqueID,
     bool* ackRequired)
   {
+    byte rwe;
+    if (msg.readByte(rwe))
+      return false;
+#ifdef TRACE
+    // The trace lives in RAM, we might not need the flash
+    if (rwe == 'T')
+      return Trace::handleTraceCommand(msg, uniqueID, ackRequired);
+#endif
     if (!flashOK)
       return false;
+    if (rwe == 'C')
+      return CrashLog::handleCrashLogCommand(msg, uniqueID, ackRequired);
     FLASH_PRINTLN(F("Processing flash command..."));
-    byte rwe;
     uint32_t add;
-    if (msg.readByte(rwe) || 
-        msg.read(add))
+    if (msg.read(add))
       return false;
 
 #ifndef DEBUG
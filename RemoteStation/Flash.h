@@ -22,6 +22,15 @@
 
 namespace Flash
 {
+  constexpr unsigned long flashSize = 512ul * 1024;
+  constexpr unsigned short flashBlockSize = 4096;
+  // The top 8kB is the crash log (CrashLog.h)
+  constexpr unsigned long crashLogStart = flashSize - 2 * flashBlockSize;
+#ifdef TRACE_FLASH
+  // The 16kB under it is the trace's (Trace.h). The database has up to whichever is lowest.
+  constexpr unsigned long traceStart = crashLogStart - 4 * flashBlockSize;
+#endif
+
   extern SPIFlash flash;
   extern bool flashOK;
   
@@ -0,0 +1,25 @@
+#pragma once
+// Just enough of the Arduino core for the station's code under test to build on the PC, for the host tests
+// (see the makefile). Careful: int is 32 bits and long is 64 here. The code under test uses int32_t/uint32_t where
+// the AVR's long matters, so those overflow as they would on the station, but 16 bit int promotions don't.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+
+// Just the I bit: nothing else runs to interrupt us
+inline void noInterrupts() { cli(); }
+inline void interrupts() { sei(); }
+
+class __FlashStringHelper;
+
+unsigned long millis(); // See millis.cpp
+// Nothing under test waits
+inline void delay(unsigned long) { }
+inline void delayMicroseconds(unsigned int) { }
+#define HIGH 1
+#define LOW 0
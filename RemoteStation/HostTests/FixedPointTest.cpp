@@ -0,0 +1,144 @@
+// Checks the fixed point maths (WeatherProcessing/FixedPoint.h) against the float code it replaced.
+// Build and run with "make fixedpointtest". Exits non-zero if anything is more than one step out.
+// This only checks the results: the cycle and flash savings on the station haven't been measured.
+// FixedPoint's 32 bit maths is int32_t, as on the AVR, and the makefile builds this with the undefined behaviour
+// sanitizer, so an intermediate that overflows 32 bits (or a bad shift) fails the test rather than passing on 64 bits.
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include "../WeatherProcessing/FixedPoint.h"
+#include "../WeatherProcessing/WindStats.h"
+
+using namespace WeatherProcessing;
+
+static int failures = 0;
+
+// Distance between two direction bytes, going the short way round
+static int byteDistance(byte a, byte b)
+{
+  int d = abs((int)a - (int)b);
+  return d > 127 ? 256 - d : d;
+}
+
+static void expectNear(const char* what, int64_t input, int expected, int actual, int tolerance)
+{
+  if (abs(expected - actual) <= tolerance)
+    return;
+  if (failures++ < 20)
+    printf("FAIL %s(%lld): expected %d, got %d\n", what, (long long)input, expected, actual);
+}
+
+// The old float code
+static byte floatAtan2ToDirection(double x, double y)
+{
+  return (byte)((atan2(-x, -y) / (2 * M_PI) + 0.5) * 255 + 0.5);
+}
+
+static void testAtan2()
+{
+  std::mt19937 rng(1);
+  int worst = 0;
+  for (int i = 0; i < 2000000; i++)
+  {
+    // Spread the magnitudes out so the small vectors get as much attention as the big ones, right up to the
+    // full 32 bits. (Not INT32_MIN, which can't be negated, and our sums never get near.)
+    int bits = 1 + rng() % 32;
+    int32_t x = (int32_t)((int64_t)(rng() >> (32 - bits)) - ((int64_t)1 << (bits - 1)));
+    int32_t y = (int32_t)((int64_t)(rng() >> (32 - bits)) - ((int64_t)1 << (bits - 1)));
+    if ((x == 0 && y == 0) || x == INT32_MIN || y == INT32_MIN)
+      continue;
+    int d = byteDistance(floatAtan2ToDirection(x, y), atan2ToDirection(x, y));
+    if (d > worst)
+      worst = d;
+    expectNear("atan2ToDirection", x, 0, d, 1);
+  }
+  printf("atan2ToDirection: worst %d step(s)\n", worst);
+}
+
+// Averages count samples spread either side of wd, as accumulateDirection does.
+static void testAveraging(byte wd, int spread, int count)
+{
+  int32_t x = 0, y = 0;
+  double fx = 0, fy = 0;
+  for (int i = 0; i < count; i++)
+  {
+    byte sample = wd + (count > 1 ? spread * (2 * i - (count - 1)) / (count - 1) : 0);
+    byte angle = directionToAngle(sample);
+    x += sin_i(angle);
+    y += cos_i(angle);
+    fx += sin(sample * 2 * M_PI / 255);
+    fy += cos(sample * 2 * M_PI / 255);
+  }
+  if (x == 0 && y == 0)
+    return;
+  int d = byteDistance(floatAtan2ToDirection(fx, fy), atan2ToDirection(x, y));
+  expectNear("direction average", wd, 0, d, 1);
+}
+
+static void testDirectionAveraging()
+{
+  for (int wd = 0; wd < 255; wd++)
+  {
+    testAveraging(wd, 0, 1);
+    testAveraging(wd, 0, 240);
+    testAveraging(wd, 10, 240);
+    testAveraging(wd, 40, 240);
+  }
+  printf("direction averaging: done\n");
+}
+
+// The bytes getExternalTemperature sends, before and after
+static int floatThermistorByte(unsigned short reading)
+{
+  const double T0 = 25 + 273.15;
+  const double invB = 1.0 / 3892;
+  double T = 1 / (1 / T0 - invB * log(1023.0 / reading - 1)) - 273.15;
+  if (T < -32)
+    T = -32;
+  if (T > 95)
+    T = 95;
+  return (byte)((T + 0.5 + 32) * 2);
+}
+
+static int thermistorByte(unsigned short reading)
+{
+  short T_x2 = thermistorTemperature_x2(reading);
+  if (T_x2 < -32 * 2)
+    T_x2 = -32 * 2;
+  if (T_x2 > 95 * 2)
+    T_x2 = 95 * 2;
+  return T_x2 + 32 * 2 + 1;
+}
+
+static void testThermistor()
+{
+  for (unsigned short reading = 1; reading < 1023; reading++)
+    expectNear("thermistor", reading, floatThermistorByte(reading), thermistorByte(reading), 1);
+  printf("thermistor: done\n");
+}
+
+static void testIsqrt()
+{
+  std::mt19937 rng(2);
+  for (int i = 0; i < 1000000; i++)
+  {
+    uint32_t value = i < 70000 ? i : rng();
+    expectNear("isqrt_i", value, (int)sqrt((double)value), isqrt_i(value), 0);
+  }
+  printf("isqrt_i: done\n");
+}
+
+int main()
+{
+  testAtan2();
+  testDirectionAveraging();
+  testThermistor();
+  testIsqrt();
+  if (failures)
+  {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  printf("All passed\n");
+  return 0;
+}
@@ -0,0 +1,313 @@
+// Checks PermanentStorage's incremental CRC, write skipping and RAM cache against a simulated EEPROM
+// (HostTests/avr/eeprom.h), and that losing power part way through any write leaves something we boot from.
+// Build and run with "make permanentstoragetest". Exits non-zero on failure.
+// Each boot is its own process, so PermanentStorage's RAM starts from scratch as it would on the station.
+// PermanentVariables is laid out differently here (long is 64 bits, and there's padding), which doesn't matter:
+// it's the bookkeeping under test, not where the fields are.
+#include <stdio.h>
+#include <optional>
+#include <random>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../PermanentStorage.h"
+
+constexpr size_t varsSize = sizeof(PermanentVariables);
+// setBytes never writes the CRC itself
+constexpr size_t settableSize = offsetof(PermanentVariables, crc);
+constexpr size_t crcEnd = settableSize + sizeof(PermanentVariables::crc);
+constexpr size_t stationIDOffset = offsetof(PermanentVariables, stationID);
+constexpr size_t stasisOffset = offsetof(PermanentVariables, stasisRequested);
+constexpr int maxScriptOps = 16;
+constexpr int poweredOff = 3;
+
+// Outlives each boot
+struct Shared
+{
+  byte eeprom[E2END + 1];
+  byte vars[varsSize]; // What the last checkStored read
+  byte states[maxScriptOps + 1][varsSize]; // What the script left after each step
+  int failures;
+};
+static Shared* shared = (Shared*)mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+static int& failures = shared->failures;
+
+#define CHECK(cond, ...) do { if (!(cond) && failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } while (0)
+
+// These go in their rings, not PermanentVariables, and aren't covered by the CRC
+static bool wearLevelled(size_t offset)
+{
+  return offset == stationIDOffset || offset == stasisOffset;
+}
+
+// Powers up with the EEPROM in shared and runs body after PermanentStorage::initialise.
+// The power goes out at the cutAt'th EEPROM write of the boot (0 for never). Returns false if it did.
+template <typename Body>
+static bool boot(long cutAt, Body body)
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    SimulatedEeprom::powerCutAt = cutAt;
+    SimulatedEeprom::powerCut = [] { fflush(stdout); _exit(poweredOff); };
+    PermanentStorage::initialise();
+    body();
+    fflush(stdout);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  bool exited = WIFEXITED(status) && (WEXITSTATUS(status) == 0 || WEXITSTATUS(status) == poweredOff);
+  CHECK(exited, "boot crashed (status %d)", status);
+  return exited && WEXITSTATUS(status) == 0;
+}
+
+static bool readsAs(const byte* model)
+{
+  byte all[varsSize];
+  PermanentStorage::getBytes(0, varsSize, all);
+  return memcmp(all, model, settableSize) == 0;
+}
+
+// What we should always find after initialise: a good CRC, and every read (from the cache or not) agreeing
+// with the EEPROM. Leaves the variables in shared->vars.
+static void checkStored()
+{
+  CHECK(PermanentStorage::checkCRC(crcEnd), "CRC doesn't match");
+  byte all[varsSize];
+  PermanentStorage::getBytes(0, varsSize, all);
+  for (size_t i = 0; i < varsSize; i++)
+  {
+    byte one;
+    PermanentStorage::getBytes((void*)i, 1, &one);
+    byte raw = eeprom_read_byte((byte*)i);
+    CHECK(one == all[i], "byte %d reads %d alone, %d with the rest", (int)i, one, all[i]);
+    CHECK(wearLevelled(i) || one == raw, "byte %d reads %d, the EEPROM has %d", (int)i, one, raw);
+  }
+  CHECK(all[stationIDOffset] == (byte)stationID, "stationID %d, stored %d", stationID, all[stationIDOffset]);
+  memcpy(shared->vars, all, varsSize);
+}
+
+// Sets a few bytes somewhere, mostly to what they already were, and keeps the model up to date.
+// Adds the EEPROM writes it should take to writes, and sets crcChange if the CRC should be written.
+static void randomSet(std::mt19937& rng, byte* model, long& writes, bool& crcChange)
+{
+  size_t offset = rng() % settableSize;
+  size_t size = 1 + rng() % (settableSize - offset < 8 ? settableSize - offset : 8);
+  byte buffer[8];
+  for (size_t i = 0; i < size; i++)
+  {
+    size_t at = offset + i;
+    byte b = rng() % 3 ? model[at] : rng();
+    if (at == offsetof(PermanentVariables, initialised))
+      b = true;
+    else if (at == stationIDOffset && b != model[at])
+      b = 'A' + rng() % 26;
+    if (b != model[at])
+    {
+      // Wear levelled bytes take a value and a sequence byte in their ring
+      writes += wearLevelled(at) ? 2 : 1;
+      crcChange |= !wearLevelled(at);
+    }
+    model[at] = b;
+    buffer[i] = b;
+  }
+  PermanentStorage::setBytes((void*)offset, size, buffer);
+}
+
+static void testIncremental()
+{
+  memset(shared->eeprom, 0xFF, sizeof(shared->eeprom));
+  boot(0, []
+  {
+    checkStored();
+    std::mt19937 rng(4);
+    byte model[varsSize];
+    memcpy(model, shared->vars, varsSize);
+    for (int op = 0; op < 20000; op++)
+    {
+      long writes = 0;
+      bool crcChange = false;
+      long writesBefore = SimulatedEeprom::writes;
+      if (rng() % 2)
+      {
+        randomSet(rng, model, writes, crcChange);
+      }
+      else
+      {
+        // Several sets, some in nested transactions, and the CRC goes out once at the end
+        {
+          PermanentStorage::Transaction transaction;
+          int sets = 1 + rng() % 5;
+          for (int i = 0; i < sets; i++)
+          {
+            std::optional<PermanentStorage::Transaction> inner;
+            if (rng() % 3 == 0)
+              inner.emplace();
+            randomSet(rng, model, writes, crcChange);
+          }
+          CHECK(SimulatedEeprom::writes - writesBefore == writes,
+            "op %d: %ld writes inside the transaction, expected %ld", op, SimulatedEeprom::writes - writesBefore, writes);
+        }
+      }
+      if (crcChange)
+        writes += sizeof(PermanentVariables::crc);
+      CHECK(SimulatedEeprom::writes - writesBefore == writes,
+        "op %d: %ld writes, expected %ld", op, SimulatedEeprom::writes - writesBefore, writes);
+      CHECK(PermanentStorage::checkCRC(crcEnd), "op %d: CRC doesn't match", op);
+      CHECK(readsAs(model), "op %d: variables don't match", op);
+      // Small reads are the ones the cache can serve
+      size_t offset = rng() % settableSize;
+      byte some[4];
+      size_t size = settableSize - offset < sizeof(some) ? settableSize - offset : sizeof(some);
+      PermanentStorage::getBytes((void*)offset, size, some);
+      CHECK(memcmp(some, model + offset, size) == 0, "op %d: %d bytes at %d don't match", op, (int)size, (int)offset);
+    }
+    memcpy(shared->states[0], model, varsSize);
+  });
+
+  // And they're all still there next time
+  boot(0, checkStored);
+  CHECK(memcmp(shared->vars, shared->states[0], settableSize) == 0, "variables changed across a reboot");
+  printf("incremental CRC: done\n");
+}
+
+// Some sets and transactions, including to the wear levelled bytes. The same every time.
+// Records what's stored after each step in shared->states if record is set.
+static void runScript(bool record)
+{
+  std::mt19937 rng(5);
+  byte model[varsSize];
+  PermanentStorage::getBytes(0, varsSize, model);
+  if (record)
+    memcpy(shared->states[0], model, varsSize);
+  long writes = 0;
+  bool crcChange = false;
+  for (int op = 0; op < maxScriptOps; op++)
+  {
+    if (op % 4 == 1)
+    {
+      char newID = 'A' + op;
+      SET_PERMANENT2(&newID, stationID);
+    }
+    else if (op % 4 == 3)
+    {
+      bool stasisRequested = op % 8 == 3;
+      SET_PERMANENT_S(stasisRequested);
+    }
+    else if (op % 8 == 0)
+    {
+      randomSet(rng, model, writes, crcChange);
+    }
+    else
+    {
+      PermanentStorage::Transaction transaction;
+      for (int i = 0; i < 3; i++)
+        randomSet(rng, model, writes, crcChange);
+    }
+    if (record)
+      PermanentStorage::getBytes(0, varsSize, shared->states[op + 1]);
+  }
+}
+
+static bool matches(const byte* a, const byte* b)
+{
+  for (size_t i = 0; i < settableSize; i++)
+  {
+    if (!wearLevelled(i) && a[i] != b[i])
+      return false;
+  }
+  return true;
+}
+
+// Whether checkStored's wear levelled byte at offset is one the script stored (or b's)
+static bool seenWearLevelled(size_t offset, const byte* b)
+{
+  for (int k = 0; k <= maxScriptOps; k++)
+  {
+    if (shared->vars[offset] == shared->states[k][offset])
+      return true;
+  }
+  return b && shared->vars[offset] == b[offset];
+}
+
+static void testPowerCuts(byte cutBits)
+{
+  SimulatedEeprom::powerCutBits = cutBits;
+
+  // The first boot, from a blank EEPROM, has a lot to write. Wherever it stops, the next boot still gets the defaults.
+  memset(shared->eeprom, 0xFF, sizeof(shared->eeprom));
+  boot(0, checkStored);
+  byte defaults[varsSize];
+  memcpy(defaults, shared->vars, varsSize);
+  int firstBootCuts = 0;
+  for (long cutAt = 1; ; cutAt++)
+  {
+    memset(shared->eeprom, 0xFF, sizeof(shared->eeprom));
+    if (boot(cutAt, [] { }))
+      break;
+    firstBootCuts++;
+    boot(0, checkStored);
+    CHECK(matches(shared->vars, defaults) && shared->vars[stationIDOffset] == defaults[stationIDOffset],
+      "first boot cut at write %ld didn't give the defaults", cutAt);
+  }
+
+  // Then the power goes during the script, at each of its writes in turn. We should get what was stored after one
+  // of its steps, or if it was caught part way through the variables, the defaults. The wear levelled bytes are
+  // written as they're set, not with the rest, so they can each be from a different step. But never lost.
+  memset(shared->eeprom, 0xFF, sizeof(shared->eeprom));
+  boot(0, []
+  {
+    // Somewhere other than the defaults, so we can tell them apart
+    std::mt19937 rng(6);
+    byte model[varsSize];
+    PermanentStorage::getBytes(0, varsSize, model);
+    long writes = 0;
+    bool crcChange = false;
+    for (int i = 0; i < 20; i++)
+      randomSet(rng, model, writes, crcChange);
+  });
+  byte before[E2END + 1];
+  memcpy(before, shared->eeprom, sizeof(before));
+  CHECK(boot(0, [] { runScript(true); }), "script didn't finish");
+  int kept = 0, reset = 0;
+  for (long cutAt = 1; ; cutAt++)
+  {
+    memcpy(shared->eeprom, before, sizeof(before));
+    if (boot(cutAt, [] { runScript(false); }))
+      break;
+    boot(0, checkStored);
+    bool isState = false;
+    for (int k = 0; k <= maxScriptOps; k++)
+      isState |= matches(shared->vars, shared->states[k]);
+    bool isDefault = matches(shared->vars, defaults);
+    CHECK(isState || isDefault, "cut at write %ld left variables we never stored", cutAt);
+    kept += isState;
+    reset += !isState && isDefault;
+    CHECK(seenWearLevelled(stationIDOffset, nullptr), "cut at write %ld lost the station ID (%d)",
+      cutAt, shared->vars[stationIDOffset]);
+    CHECK(seenWearLevelled(stasisOffset, defaults), "cut at write %ld lost stasisRequested (%d)",
+      cutAt, shared->vars[stasisOffset]);
+  }
+  CHECK(!matches(shared->states[0], defaults), "the script starts from the defaults");
+  CHECK(kept && reset, "%d cuts kept a stored state and %d reset, expected some of each", kept, reset);
+  printf("power cuts leaving 0x%02X: %d in the first boot, %d in the script (%d kept a stored state, %d reset)\n",
+    cutBits, firstBootCuts, kept + reset, kept, reset);
+}
+
+int main()
+{
+  SimulatedEeprom::memory = shared->eeprom;
+  testIncremental();
+  testPowerCuts(0xFF);
+  testPowerCuts(0x5A);
+  if (failures)
+  {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  printf("All passed\n");
+  return 0;
+}
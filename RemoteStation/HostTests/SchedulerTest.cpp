@@ -0,0 +1,126 @@
+// Drives the Scheduler's deadlines (Scheduler.h) with a virtual millis() clock, including across its 49 day wrap.
+// Build and run with "make schedulertest". Exits non-zero on failure.
+#include <stdio.h>
+#include "../Scheduler.h"
+
+using namespace Scheduler;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond) && failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } while (0)
+
+// The first millis() at or after from (up to limit) that wakeRequired lets the loop run, or limit if none.
+static uint32_t firstWake(uint32_t from, uint32_t limit)
+{
+  for (uint32_t now = from; now != limit; now++)
+  {
+    if (wakeRequired(now))
+      return now;
+  }
+  return limit;
+}
+
+static void testOrdering(uint32_t start)
+{
+  startLoop();
+  setDeadline(Ping, start + 1000);
+  setDeadline(Solar, start + 4);
+  setDeadline(Status, start + 60);
+  // Whatever order they're armed in, the earliest wakes us
+  CHECK(firstWake(start, start + 2000) == start + 4, "earliest of three from %u", (unsigned)start);
+
+  // Each loop re-arms what it still wants, and the next one up wakes us
+  startLoop();
+  setDeadline(Ping, start + 1000);
+  setDeadline(Status, start + 60);
+  CHECK(firstWake(start + 5, start + 2000) == start + 60, "second deadline from %u", (unsigned)start);
+  startLoop();
+  setDeadline(Ping, start + 1000);
+  CHECK(firstWake(start + 61, start + 2000) == start + 1000, "last deadline from %u", (unsigned)start);
+
+  // Nothing armed, nothing to wake for
+  startLoop();
+  CHECK(firstWake(start, start + 2000) == start + 2000, "woke with nothing armed from %u", (unsigned)start);
+}
+
+static void testRearm(uint32_t start)
+{
+  // Armed twice in one loop keeps the earlier, either way round
+  startLoop();
+  setDeadline(Relay, start + 50);
+  setDeadline(Relay, start + 500);
+  CHECK(firstWake(start, start + 1000) == start + 50, "later re-arm replaced the earlier from %u", (unsigned)start);
+  startLoop();
+  setDeadline(Relay, start + 500);
+  setDeadline(Relay, start + 50);
+  CHECK(firstWake(start, start + 1000) == start + 50, "earlier re-arm ignored from %u", (unsigned)start);
+
+  // Arming at now means the next tick
+  startLoop();
+  setDeadline(Database, start);
+  CHECK(wakeRequired(start), "deadline at now didn't wake from %u", (unsigned)start);
+  // And one that's already gone by still wakes us
+  startLoop();
+  setDeadline(Database, start - 10);
+  CHECK(wakeRequired(start), "overdue deadline didn't wake from %u", (unsigned)start);
+}
+
+static void testTies(uint32_t start)
+{
+  // Two deadlines due at the same millisecond both wake us then, and not before
+  startLoop();
+  setDeadline(Watchdog, start + 100);
+  setDeadline(Ping, start + 100);
+  CHECK(!wakeRequired(start + 99), "tie woke early from %u", (unsigned)start);
+  CHECK(wakeRequired(start + 100), "tie didn't wake from %u", (unsigned)start);
+  // Either of them alone is still due there
+  startLoop();
+  setDeadline(Ping, start + 100);
+  CHECK(firstWake(start, start + 200) == start + 100, "one of a tie from %u", (unsigned)start);
+  startLoop();
+  setDeadline(Watchdog, start + 100);
+  CHECK(firstWake(start, start + 200) == start + 100, "other of a tie from %u", (unsigned)start);
+}
+
+static void testEvents()
+{
+  startLoop();
+  setDeadline(Ping, 1000);
+  CHECK(!wakeRequired(0), "woke with nothing due");
+  post(AdcEvent);
+  CHECK(wakeRequired(0), "posted event didn't wake");
+  startLoop();
+  CHECK(!wakeRequired(0), "startLoop didn't clear the events");
+}
+
+int main()
+{
+  // Starts just before millis() wraps put their deadlines either side of it
+  const uint32_t starts[] = { 0, 123456, 0xFFFFFFFF - 2000, 0xFFFFFFFF - 500, 0xFFFFFFFF - 30, 0xFFFFFFFF };
+  for (uint32_t start : starts)
+  {
+    testOrdering(start);
+    testRearm(start);
+    testTies(start);
+  }
+  testEvents();
+
+  // Right across the wrap: armed at 0xFFFFFFF0 for 0x20 later
+  startLoop();
+  setDeadline(Solar, 0xFFFFFFF0 + 0x20);
+  CHECK(!wakeRequired(0xFFFFFFF0) && !wakeRequired(0xFFFFFFFF) && !wakeRequired(0x0F), "woke early across the wrap");
+  CHECK(wakeRequired(0x10) && wakeRequired(0x11), "didn't wake across the wrap");
+  // The earlier of two deadlines either side of the wrap is the one before it
+  startLoop();
+  setDeadline(Solar, 0x10);
+  setDeadline(Solar, 0xFFFFFFF8);
+  CHECK(firstWake(0xFFFFFFF0, 0x100) == 0xFFFFFFF8, "kept the later deadline across the wrap");
+
+  if (failures)
+  {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  printf("All passed\n");
+  return 0;
+}
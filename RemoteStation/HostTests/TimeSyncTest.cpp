@@ -0,0 +1,209 @@
+// Runs TimeSync and TimerTwo's drift correction (TimeSync.h) against a simulated 32 kHz crystal that's off by a
+// few ppm either way, with pings every five minutes from a base on the true time.
+// Build and run with "make timesynctest". Exits non-zero on failure.
+// TimerTwo keeps its ticks in unsigned long, 64 bits here. TimeSync's own sums are 32 bits, as on the station.
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include "../ArduinoWeatherStation.h"
+#include "../TimeSync.h"
+#include "../TimerTwo.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond) && failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } while (0)
+
+void TIMER2_COMPA_vect();
+
+// A ping, from just after its callsign
+class PingSource : public MessageSource
+{
+  byte _data[9];
+
+public:
+  PingSource(uint32_t seconds, unsigned short ms, unsigned short delay)
+  {
+    memcpy(_data, &seconds, 4);
+    memcpy(_data + 4, &ms, 2);
+    memcpy(_data + 6, &delay, 2);
+    _data[8] = 1; // Hops
+    _length = sizeof(_data);
+    _currentLocation = 0;
+  }
+  bool beginMessage() override { return true; }
+  MESSAGE_RESULT endMessage() override { return MESSAGE_OK; }
+  MESSAGE_RESULT readByte(byte& dest) override
+  {
+    if (_currentLocation >= _length)
+      return MESSAGE_END;
+    dest = _data[_currentLocation++];
+    return MESSAGE_OK;
+  }
+  MESSAGE_RESULT accessBytes(byte**, byte) override { return MESSAGE_ERROR; }
+  MESSAGE_RESULT seek(const byte newPosition) override
+  {
+    _currentLocation = newPosition;
+    return MESSAGE_OK;
+  }
+};
+
+// The true time, and the crystal's idea of it
+class Station
+{
+  double _tickPeriod; // True ms
+  double _nextTick;
+  double _now = 0;
+  double _baseOffset = 0;
+
+public:
+  // Unix time the base is on when we start
+  static constexpr double epochMillis = 1760000000000.0;
+
+  Station(double ppm)
+  {
+    _tickPeriod = TimerTwo::MillisPerTick / (1 + ppm * 1e-6);
+    _nextTick = _tickPeriod;
+    TimerTwo::_ticks = 0;
+    TimerTwo::_ofTicks = 0;
+    TimerTwo::_correctionMillis = 0;
+    TimerTwo::_driftPerTick = 0;
+    TimerTwo::_driftFraction = 0;
+  }
+
+  double now() { return _now; }
+  // Someone sets the base's clock
+  void moveBaseClock(double ms) { _baseOffset += ms; }
+  double baseMillis() { return epochMillis + _baseOffset + _now; }
+
+  // Runs the timer up to the true time t
+  void advanceTo(double t)
+  {
+    while (_nextTick <= t)
+    {
+      TIMER2_COMPA_vect();
+      _nextTick += _tickPeriod;
+    }
+    _now = t;
+    TCNT2 = (byte)((1 - (_nextTick - t) / _tickPeriod) * (TIMER2_TOP + 1));
+  }
+
+  // How far ahead of the base our clock is
+  double error()
+  {
+    double base = fmod(baseMillis(), 4294967296.0);
+    double ours = (uint32_t)TimerTwo::millis();
+    double ret = ours - base;
+    return ret > 2147483648.0 ? ret - 4294967296.0 : ret < -2147483648.0 ? ret + 4294967296.0 : ret;
+  }
+
+  // The base sends a ping now. It takes delay ms through relays that report it, and lost ms that nobody does
+  // (CSMA, the modem). We handle it held ms after it arrives.
+  void ping(unsigned short delay, double lost, double held)
+  {
+    uint64_t sent = (uint64_t)baseMillis();
+    advanceTo(_now + delay + lost);
+    unsigned short rxTimestamp = millis16();
+    advanceTo(_now + held);
+    PingSource msg(sent / 1000, sent % 1000, delay);
+    TimeSync::handlePing(msg, rxTimestamp);
+  }
+};
+
+// The drift term that cancels a crystal ppm fast, in 1/65536 ms a tick
+static double idealDrift(double ppm)
+{
+  return -(double)TimerTwo::MillisPerTick * 65536.0 * ppm * 1e-6 / (1 + ppm * 1e-6);
+}
+
+constexpr double driftPerPpm = TimerTwo::MillisPerTick * 65536.0 * 1e-6;
+constexpr double pingInterval = 5 * 60 * 1000.0;
+constexpr double hour = 3600 * 1000.0;
+
+// The next ping, with up to jitter ms of unreported latency
+static void nextPing(Station& station, std::mt19937& rng, double jitter)
+{
+  std::uniform_real_distribution<double> unit(0, 1);
+  station.advanceTo(station.now() + pingInterval);
+  station.ping(rng() % 600, unit(rng) * jitter, unit(rng) * 50);
+}
+
+static void runPings(Station& station, std::mt19937& rng, double hours, double jitter)
+{
+  for (double end = station.now() + hours * hour; station.now() + pingInterval <= end; )
+    nextPing(station, rng, jitter);
+}
+
+static void testConvergence(double ppm, double jitter)
+{
+  std::mt19937 rng(7);
+  Station station(ppm);
+  double ideal = idealDrift(ppm);
+  // Within a few percent in a day (five windows, each halving the error), if the pings are clean
+  runPings(station, rng, 24, jitter);
+  CHECK(jitter || fabs(TimeSync::drift() - ideal) <= fabs(ideal) * 0.05 + driftPerPpm,
+    "%+g ppm: drift %d after a day, ideal %.0f", ppm, TimeSync::drift(), ideal);
+  // Two days to settle
+  runPings(station, rng, 24, jitter);
+  // Then it should stay there for the next one. Half of each four hour window's error goes back in, and the
+  // jitter's worth a few ppm over four hours.
+  double tolerance = jitter ? 10 : 1;
+  double worstDrift = 0, worstError = 0;
+  for (int i = 0; i < 24 * 12; i++)
+  {
+    station.advanceTo(station.now() + pingInterval - 1);
+    worstError = fmax(worstError, fabs(station.error()));
+    worstDrift = fmax(worstDrift, fabs(TimeSync::drift() - ideal) / driftPerPpm);
+    nextPing(station, rng, jitter);
+  }
+  double residual = (TimeSync::drift() - ideal) / driftPerPpm;
+  CHECK(worstDrift <= tolerance, "%+g ppm, %g ms jitter: drift was up to %.1f ppm out", ppm, jitter, worstDrift);
+  // Between pings the clock only drifts by the residual, plus the jitter we stepped to last time
+  double maxError = jitter + tolerance * 1e-6 * pingInterval + 3;
+  CHECK(worstError <= maxError, "%+g ppm, %g ms jitter: %.1f ms out before a ping", ppm, jitter, worstError);
+
+  // Without pings for a day, we stay closer than we would uncorrected
+  station.advanceTo(station.now() + 24 * hour);
+  double error = station.error();
+  double uncorrected = fabs(ppm) * 1e-6 * 24 * hour;
+  CHECK(fabs(error) <= jitter + fabs(residual) * 1e-6 * 24 * hour + 3,
+    "%+g ppm, %g ms jitter: %.0f ms out after a day without pings (%.0f uncorrected)", ppm, jitter, error, uncorrected);
+  printf("%+5g ppm, %3g ms jitter: drift %5d, up to %3.1f ppm out, %5.1f ms worst between pings, "
+    "%3.0f ms out after a day alone (%.0f uncorrected)\n",
+    ppm, jitter, TimeSync::drift(), worstDrift, worstError, error, uncorrected);
+}
+
+// Someone sets the base's clock: that's a jump, not drift.
+static void testClockChange()
+{
+  std::mt19937 rng(8);
+  Station station(80);
+  runPings(station, rng, 48, 0);
+  short before = TimeSync::drift();
+  // Ten minutes forward
+  station.advanceTo(station.now() + pingInterval);
+  station.moveBaseClock(600000);
+  station.ping(0, 0, 0);
+  CHECK(fabs(station.error()) < 3, "didn't follow the base's clock change: %.0f ms out", station.error());
+  runPings(station, rng, 8, 0);
+  CHECK(fabs(TimeSync::drift() - before) / driftPerPpm <= 1, "the clock change moved the drift from %d to %d",
+    before, TimeSync::drift());
+}
+
+int main()
+{
+  // The first ping after a jump sets the clock without counting as drift, so each run starts like a new station.
+  const double ppms[] = { 0, 20, -20, 100, -50, 500, -1500 };
+  for (double ppm : ppms)
+  {
+    testConvergence(ppm, 0);
+    testConvergence(ppm, 300);
+  }
+  testClockChange();
+  if (failures)
+  {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  printf("All passed\n");
+  return 0;
+}
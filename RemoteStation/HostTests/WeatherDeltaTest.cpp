@@ -0,0 +1,260 @@
+// Round trips weather records through the delta encoder (WeatherProcessing/WeatherDelta.h) and a port of
+// the receiver's decoder (DecodeWeatherPackets in dotNet_Receiver/PacketDecoder.cs), the way they'd arrive
+// in a relay buffer: several stations' full and delta records back to back, with some keyframes lost.
+// Build and run with "make weatherdeltatest". Exits non-zero on failure.
+#include <stdio.h>
+#include <map>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+#include "../WeatherProcessing/WeatherDelta.h"
+
+using namespace WeatherProcessing;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond) && failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } } while (0)
+
+struct Weather
+{
+  byte station, uniqueID;
+  byte direction, speed, gust, seconds;
+  int battery = -1, externalTemp = -1; // -1 if not in the record
+};
+
+// The receiver's side
+struct Keyframe
+{
+  byte uniqueID, direction, speed, gust;
+};
+static std::map<byte, Keyframe> keyframes;
+
+static int nibble(int b)
+{
+  return (int8_t)(b << 4) >> 4;
+}
+
+// Returns false if it's a delta against a keyframe we don't have
+static bool decodeRecord(const byte* data, int packetLen, Weather& ret)
+{
+  ret = Weather();
+  ret.station = data[0];
+  ret.uniqueID = data[1];
+  int cur = 3;
+  if (data[2] & deltaLengthFlag)
+  {
+    int age = data[cur] & 0x0F;
+    int dDirection = nibble(data[cur++] >> 4) * 2;
+    int dSpeed = nibble(data[cur]);
+    int dGust = nibble(data[cur++] >> 4);
+    auto keyframe = keyframes.find(ret.station);
+    if (keyframe == keyframes.end() || (byte)(ret.uniqueID - age) != keyframe->second.uniqueID)
+      return false;
+    ret.direction = keyframe->second.direction + dDirection;
+    ret.speed = keyframe->second.speed + dSpeed;
+    ret.gust = keyframe->second.gust + dGust;
+  }
+  else
+  {
+    ret.direction = data[cur++];
+    ret.speed = data[cur++];
+    ret.gust = data[cur++];
+    keyframes[ret.station] = { ret.uniqueID, ret.direction, ret.speed, ret.gust };
+  }
+  ret.seconds = data[cur++];
+  if (packetLen > cur)
+    ret.battery = data[cur++];
+  if (packetLen > cur)
+    ret.externalTemp = data[cur++];
+  return true;
+}
+
+static std::vector<Weather> decodeRecords(const byte* data, int length, int& skipped)
+{
+  std::vector<Weather> ret;
+  skipped = 0;
+  int cur = 0;
+  while (cur < length)
+  {
+    // The receiver's own idea of the length, independent of weatherRecordSize
+    int len = data[cur + 2];
+    if (len & deltaLengthFlag)
+      len &= ~deltaLengthFlag;
+    int packetLen = len + 3;
+    CHECK(cur + packetLen <= length, "record at %d runs off the end", cur);
+    Weather w;
+    if (decodeRecord(data + cur, packetLen, w))
+      ret.push_back(w);
+    else
+      skipped++;
+    cur += packetLen;
+  }
+  return ret;
+}
+
+// The station's side. createWeatherData sends a complex record every tenth time, and in between a delta if
+// it fits, else a simple full record (just the wind and seconds).
+struct Record
+{
+  std::vector<byte> bytes; // (SID)(UID)(Length)(Data)
+  Weather sent;
+  bool isDelta;
+};
+
+static Record createRecord(Weather& w, bool isComplex)
+{
+  Record ret;
+  ret.sent = w;
+  auto& bytes = ret.bytes;
+  bytes.push_back(w.station);
+  bytes.push_back(w.uniqueID);
+  ret.isDelta = !isComplex && deltaFits(w.uniqueID, w.direction, w.speed, w.gust);
+  if (ret.isDelta)
+  {
+    byte delta[maxDeltaSize];
+    byte length = encodeWeatherDelta(delta, w.uniqueID, w.direction, w.speed, w.gust,
+      w.seconds, w.battery, w.externalTemp);
+    CHECK(length >= 4 && length <= maxDeltaSize, "delta length %d", length);
+    bytes.insert(bytes.end(), delta, delta + length);
+    return ret;
+  }
+  // Padded out to the real complex length, the decoder only looks at the first few bytes
+  constexpr byte complexLength = 26;
+  bytes.push_back(isComplex ? complexLength : 4);
+  bytes.push_back(w.direction);
+  bytes.push_back(w.speed);
+  bytes.push_back(w.gust);
+  bytes.push_back(w.seconds);
+  setDeltaKeyframe(w.uniqueID, w.direction, w.speed, w.gust);
+  if (isComplex)
+  {
+    bytes.push_back(w.battery);
+    bytes.push_back(w.externalTemp);
+    bytes.insert(bytes.end(), complexLength - 6, 0);
+    setDeltaReferences(w.battery, w.externalTemp);
+  }
+  return ret;
+}
+
+static int step(std::mt19937& rng, int value, int maxStep, int low, int high)
+{
+  value += (int)(rng() % (2 * maxStep + 1)) - maxStep;
+  return value < low ? low : value > high ? high : value;
+}
+
+static int directionDistance(byte a, byte b)
+{
+  int d = abs((int)a - (int)b);
+  return d > 127 ? 256 - d : d;
+}
+
+int main()
+{
+  constexpr int stationCount = 4;
+  constexpr int rounds = 20000;
+  std::mt19937 rng(3);
+
+  // The encoder's state is global (one station per board), so make each station's whole series in turn.
+  // Each starts with a complex record, which sets the encoder up from scratch.
+  std::vector<Record> records[stationCount];
+  int deltas = 0;
+  for (int s = 0; s < stationCount; s++)
+  {
+    Weather w;
+    w.station = 'A' + s;
+    w.uniqueID = rng();
+    w.direction = rng();
+    w.speed = rng() % 60;
+    w.gust = w.speed + rng() % 20;
+    w.battery = 150;
+    w.externalTemp = 120;
+    for (int round = 0; round < rounds; round++)
+    {
+      // Mostly small moves with the odd big one, so we get plenty of both kinds of record
+      bool big = rng() % 8 == 0;
+      w.direction += big ? rng() : rng() % 17 - 8;
+      w.speed = step(rng, w.speed, big ? 20 : 4, 0, 200);
+      w.gust = step(rng, w.gust, big ? 20 : 4, w.speed, 255);
+      w.seconds = rng();
+      w.battery = step(rng, w.battery, 2, 0, 255);
+      w.externalTemp = step(rng, w.externalTemp, 2, 0, 255);
+      records[s].push_back(createRecord(w, round % 10 == 0));
+      deltas += records[s].back().isDelta;
+      // Other messages take unique IDs too, sometimes enough to age the keyframe out
+      w.uniqueID += rng() % 50 ? 1 : 1 + rng() % 20;
+    }
+  }
+
+  // Each round every station's record goes into one relay buffer, and some buffers never make it.
+  // Deltas against a lost keyframe have to be skipped, not misread.
+  bool keyframeLost[stationCount] = {};
+  int decoded = 0, skippedTotal = 0, expectedSkips = 0;
+  for (int round = 0; round < rounds; round++)
+  {
+    bool lost = rng() % 20 == 0;
+    std::vector<byte> relay;
+    std::vector<const Record*> expected;
+    for (int s = 0; s < stationCount; s++)
+    {
+      auto& record = records[s][round];
+      relay.insert(relay.end(), record.bytes.begin(), record.bytes.end());
+      if (!record.isDelta)
+        keyframeLost[s] = lost;
+      else if (keyframeLost[s] && !lost)
+      {
+        expectedSkips++;
+        continue;
+      }
+      expected.push_back(&record);
+    }
+    if (lost)
+      continue;
+
+    // Walk the buffer the way recordWeatherForRelay does
+    int walked = 0;
+    for (unsigned i = 0; i + 2 < relay.size(); i += weatherRecordSize(&relay[i]))
+    {
+      CHECK(walked < stationCount && relay[i] == 'A' + walked, "relay walk found station %d at %u", relay[i], i);
+      walked++;
+    }
+    CHECK(walked == stationCount, "relay walk found %d records", walked);
+
+    int skipped;
+    auto received = decodeRecords(relay.data(), relay.size(), skipped);
+    skippedTotal += skipped;
+    CHECK(received.size() == expected.size(), "decoded %d records, expected %d",
+      (int)received.size(), (int)expected.size());
+    for (size_t i = 0; i < received.size() && i < expected.size(); i++)
+    {
+      auto& got = received[i];
+      auto& want = expected[i]->sent;
+      decoded++;
+      CHECK(got.station == want.station && got.uniqueID == want.uniqueID,
+        "got %c/%d, expected %c/%d", got.station, got.uniqueID, want.station, want.uniqueID);
+      // Deltas halve the direction
+      CHECK(directionDistance(got.direction, want.direction) <= (expected[i]->isDelta ? 1 : 0),
+        "direction %d, expected %d", got.direction, want.direction);
+      CHECK(got.speed == want.speed && got.gust == want.gust && got.seconds == want.seconds,
+        "speed/gust/seconds %d/%d/%d, expected %d/%d/%d",
+        got.speed, got.gust, got.seconds, want.speed, want.gust, want.seconds);
+      // Deltas only carry these when they've moved, but what's there must be right
+      CHECK(got.battery < 0 || got.battery == want.battery, "battery %d, expected %d", got.battery, want.battery);
+      CHECK(got.externalTemp < 0 || got.externalTemp == want.externalTemp,
+        "temperature %d, expected %d", got.externalTemp, want.externalTemp);
+    }
+  }
+  CHECK(skippedTotal == expectedSkips, "skipped %d deltas, expected %d", skippedTotal, expectedSkips);
+  int fulls = stationCount * rounds - deltas;
+  CHECK(deltas > rounds && fulls > rounds, "only %d deltas and %d full records", deltas, fulls);
+
+  // The cost of deltas: records that arrived but had to be skipped because their keyframe didn't
+  printf("%d delta and %d full records, %d decoded, %d (%.1f%%) skipped after a lost keyframe\n",
+    deltas, fulls, decoded, skippedTotal, 100.0 * skippedTotal / (stationCount * rounds));
+  if (failures)
+  {
+    printf("%d failure(s)\n", failures);
+    return 1;
+  }
+  printf("All passed\n");
+  return 0;
+}
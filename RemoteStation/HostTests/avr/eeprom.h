@@ -0,0 +1,64 @@
+#pragma once
+// A simulated EEPROM. Tests can point it at memory of their own (to outlive a simulated reboot),
+// and have the power go out part way through a write.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define E2END 1023
+
+namespace SimulatedEeprom
+{
+  inline uint8_t defaultMemory[E2END + 1];
+  inline uint8_t* memory = defaultMemory;
+  // Byte writes so far
+  inline long writes = 0;
+  // The power goes out during this write (counting from 1), or 0 for never. powerCut is called and mustn't return.
+  inline long powerCutAt = 0;
+  inline void (*powerCut)() = nullptr;
+  // The cell's been erased but not all of its zeros written: these bits are left set in the interrupted byte.
+  inline uint8_t powerCutBits = 0xFF;
+
+  inline size_t check(const void* address)
+  {
+    size_t ret = (size_t)address;
+    if (ret > E2END)
+      abort();
+    return ret;
+  }
+}
+
+inline uint8_t eeprom_read_byte(const uint8_t* address)
+{
+  return SimulatedEeprom::memory[SimulatedEeprom::check(address)];
+}
+
+inline void eeprom_write_byte(uint8_t* address, uint8_t value)
+{
+  using namespace SimulatedEeprom;
+  size_t cell = check(address);
+  if (++writes == powerCutAt)
+  {
+    memory[cell] = value | powerCutBits;
+    powerCut();
+  }
+  memory[cell] = value;
+}
+
+inline void eeprom_update_byte(uint8_t* address, uint8_t value)
+{
+  if (eeprom_read_byte(address) != value)
+    eeprom_write_byte(address, value);
+}
+
+inline void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+}
+
+inline void eeprom_write_block(const void* src, void* dst, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    eeprom_write_byte((uint8_t*)dst + i, ((const uint8_t*)src)[i]);
+}
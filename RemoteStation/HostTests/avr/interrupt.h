@@ -0,0 +1,7 @@
+#pragma once
+// An ISR is a function the test calls when the hardware would
+#include "io.h"
+
+#define ISR(vector) void vector()
+inline void cli() { SREG &= ~_BV(SREG_I); }
+inline void sei() { SREG |= _BV(SREG_I); }
@@ -0,0 +1,29 @@
+#pragma once
+// The registers the code under test touches, as plain memory. Tests set them (TCNT2, say) to simulate the hardware.
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+
+inline volatile uint8_t SREG;
+#define SREG_C 0
+#define SREG_I 7
+
+inline volatile uint8_t PORTD;
+#define PD0 0
+#define PD1 1
+
+// Timer 2
+inline volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2, ASSR;
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+#define OCF2A 1
+#define TCR2BUB 0
+#define TCR2AUB 1
+#define OCR2BUB 2
+#define OCR2AUB 3
+#define TCN2UB 4
+#define AS2 5
@@ -0,0 +1,2 @@
+// gitver.sh makes the station's own
+#define REV_ID "host"
@@ -0,0 +1,10 @@
+#pragma once
+// avr-libc's C version of the CCITT CRC
+#include <stdint.h>
+
+inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= (uint8_t)crc;
+  data ^= data << 4;
+  return (((uint16_t)data << 8) | (uint8_t)(crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3);
+}
@@ -8,10 +8,12 @@ const size_t minPacketSize = 0; //15 for the argent data radioshield (station 1)
 //Ugh, come back to this to get rid of it. We're not that concerned about performance that we can't have virtual functions.
 #define STREAM Serial
 
-KissMessageDestination::KissMessageDestination(bool _corrupt)
+KissReceiver kissReceiver;
+
+KissMessageDestination::KissMessageDestination(bool _corrupt, byte type)
 {
-  STREAM.write(FEND);
-  STREAM.write(_corrupt ? (byte)0x01 : (byte)0x00);
+  writeRaw(FEND);
+  writeRaw(_corrupt ? kissCorruptFrame : type);
 
   if (s_prependCallsign)
     append((byte*)callSign, 6);
@@ -22,146 +24,248 @@ KissMessageDestination::~KissMessageDestination()
   finishAndSend();
 }
 
+// Rather than letting the serial library spin when its transmit buffer is full,
+// keep the radio and the incoming serial serviced while we wait.
+void KissMessageDestination::writeRaw(const byte data)
+{
+  while (STREAM.availableForWrite() == 0)
+    yield();
+  STREAM.write(data);
+}
+
 MESSAGE_RESULT KissMessageDestination::finishAndSend()
 {
-  if (_currentLocation == 255)
+  if (!_open)
     return MESSAGE_NOT_IN_MESSAGE;
 
   while(_currentLocation < minPacketSize)
     appendByte(0);
     
-  STREAM.write(FEND);
+  // Even if the frame filled up (_currentLocation reached 255) it has to be closed, or the next one joins onto it.
+  writeRaw(FEND);
+  _open = false;
   _currentLocation = 255;
   return MESSAGE_END;
 }
     
+void KissMessageDestination::abort()
+{
+  if (_open)
+    writeRaw(FEND);
+  _open = false;
+  _currentLocation = 255;
+}
+
 MESSAGE_RESULT KissMessageDestination::appendByte(const byte data)
 {
   if (_currentLocation == 255)
     return MESSAGE_NOT_IN_MESSAGE;
   if (data == FEND)
   {
-    STREAM.write(FESC);
-    STREAM.write(TFEND);
+    writeRaw(FESC);
+    writeRaw(TFEND);
   }
   else if (data == FESC)
   {
-    STREAM.write(FESC);
-    STREAM.write(TFESC);
+    writeRaw(FESC);
+    writeRaw(TFESC);
   }
   else
-    STREAM.write(data);
+    writeRaw(data);
   _currentLocation++;
   return MESSAGE_OK;
 }
 
-KissMessageSource::~KissMessageSource()
+void KissReceiver::processSerial()
 {
-  endMessage();
+  // Only take bytes off the UART when we have somewhere to put them.
+  // Otherwise leave them where they are until the frames in the queue are handled.
+  while (hasSpace() && STREAM.available() > 0)
+    processByte(STREAM.read());
 }
 
-bool KissMessageSource::readByteRaw(byte& dest)
+void KissReceiver::processByte(byte data)
 {
-  unsigned long startMillis = millis();
-  const unsigned long timeout = 1000;
-  int data = -1;
-  while (data == -1)
+  switch (_state)
   {
-    if (millis() - startMillis > timeout)
+  case States::Hunting:
+    if (data == FEND)
+      _state = States::AwaitingType;
+    break;
+  case States::AwaitingType:
+    if (data == FEND)
+      break; // Back to back FENDs are allowed
+    if (data == 0x00 || data == 0x06)
     {
-      _currentLocation = 255;
-      return false;
+      _partialType = data;
+      _partialLength = 0;
+      _state = States::InFrame;
     }
-    yield();
-    data = STREAM.read();
+    else
+      _state = States::Hunting;
+    break;
+  case States::InFrame:
+    if (data == FEND)
+    {
+      completeFrame();
+      _state = States::AwaitingType;
+    }
+    else if (data == FESC)
+      _state = States::Escaped;
+    else
+      appendToFrame(data);
+    break;
+  case States::Escaped:
+    _state = States::InFrame;
+    switch (data)
+    {
+    case TFEND: appendToFrame(FEND); break;
+    case TFESC: appendToFrame(FESC); break;
+    case FEND:
+      // Malformed, throw away what we've got.
+      _partialLength = 0;
+      _state = States::AwaitingType;
+      break;
+    default: appendToFrame(data); break;
+    }
+    break;
+  }
+}
+
+void KissReceiver::appendToFrame(byte data)
+{
+  if (_partialLength >= kissMaxFrameSize)
+  {
+    // Too big to ever send. Drop it and wait for the next frame.
+    _partialLength = 0;
+    _state = States::Hunting;
+    return;
   }
-  dest = data;
+  _buffer[_frameStart + _partialLength++] = data;
+}
+
+void KissReceiver::completeFrame()
+{
+  if (_partialLength == 0)
+    return;
+  _frameLengths[_writeFrameIdx] = _partialLength;
+  _frameTypes[_writeFrameIdx] = _partialType;
+  _writeFrameIdx++;
+  _frameStart += _partialLength;
+  _partialLength = 0;
+}
+
+bool KissReceiver::dequeueFrame(byte** buffer, byte* length, byte* type)
+{
+  processSerial();
+  if (_checkedOut || _readFrameIdx == _writeFrameIdx)
+    return false;
+  *buffer = _buffer + _readOffset;
+  *length = _frameLengths[_readFrameIdx];
+  *type = _frameTypes[_readFrameIdx];
+  _checkedOut = true;
   return true;
 }
 
-MESSAGE_RESULT KissMessageSource::accessBytes(byte** buffer, byte len)
+void KissReceiver::doneWithFrame()
+{
+  if (!_checkedOut)
+    return;
+  _checkedOut = false;
+  _readOffset += _frameLengths[_readFrameIdx];
+  _readFrameIdx++;
+  if (_readFrameIdx >= _writeFrameIdx)
+  {
+    // Everything has been read, move any partially received frame back to the start
+    if (_state == States::InFrame || _state == States::Escaped)
+      memmove(_buffer, _buffer + _frameStart, _partialLength);
+    _frameStart = 0;
+    _readOffset = 0;
+    _readFrameIdx = 0;
+    _writeFrameIdx = 0;
+  }
+}
+
+KissMessageSource::~KissMessageSource()
 {
-  return MESSAGE_ERROR;
+  endMessage();
 }
 
 bool KissMessageSource::beginMessage()
 {
-  byte data;
-  bool matchedFend = false;
-  //Wait for FEND + messageType:
-  while (true)
+  if (_incomingBuffer)
+    endMessage();
+  if (!kissReceiver.dequeueFrame(&_incomingBuffer, &_length, &_messageType))
   {
-    if (!readByteRaw(data))
-      return false;
-    if (data == FEND)
-      matchedFend = true;
-    else if (matchedFend && (data == 0x00 || data == 0x06))
-    {
-      _messageType = data;
-      break;
-    }
-    else
-      matchedFend = false;
+    _incomingBuffer = nullptr;
+    return false;
   }
   if (s_discardCallsign)
   {
-    //Read the callsign. Discard it for now, but we might want to filter on it later.
-    for (int i = 0; i < 6; i++)
+    //Discard the callsign for now, but we might want to filter on it later.
+    if (_length <= 6)
     {
-      if (!readByteRaw(data))
-        return false;
+      kissReceiver.doneWithFrame();
+      _incomingBuffer = nullptr;
+      return false;
     }
+    _currentLocation = 6;
   }
-  _currentLocation = 0;
+  else
+    _currentLocation = 0;
   return true;
 }
 
 MESSAGE_RESULT KissMessageSource::endMessage()
 {
+  if (_incomingBuffer)
+  {
+    kissReceiver.doneWithFrame();
+    _incomingBuffer = nullptr;
+  }
   if (_currentLocation == 255)
     return MESSAGE_NOT_IN_MESSAGE;
-  byte data;
-  while (true)
+  _currentLocation = 255;
+  return MESSAGE_END;
+}
+
+MESSAGE_RESULT KissMessageSource::readByte(byte& dest)
+{
+  if (_currentLocation == 255)
+    return MESSAGE_NOT_IN_MESSAGE;
+  if (_currentLocation >= _length)
   {
-    if (!readByteRaw(data))
-      return MESSAGE_TIMEOUT;
-    if (data == FEND)
-      return MESSAGE_END;
+    _currentLocation = 255;
+    return MESSAGE_END;
   }
+  dest = _incomingBuffer[_currentLocation++];
+  return MESSAGE_OK;
 }
 
-MESSAGE_RESULT KissMessageSource::seek(byte dest)
+MESSAGE_RESULT KissMessageSource::accessBytes(byte** dest, byte bytesToRead)
 {
-  return MESSAGE_ERROR;
+  if (_currentLocation == 255)
+    return MESSAGE_NOT_IN_MESSAGE;
+  if (_currentLocation >= _length)
+  {
+    _currentLocation = 255;
+    return MESSAGE_END;
+  }
+  byte endLocation = _currentLocation + bytesToRead;
+  if (endLocation < _currentLocation || endLocation > _length)
+    return MESSAGE_BUFFER_OVERRUN;
+  *dest = _incomingBuffer + _currentLocation;
+  _currentLocation += bytesToRead;
+  return MESSAGE_OK;
 }
 
-MESSAGE_RESULT KissMessageSource::readByte(byte& dest)
+MESSAGE_RESULT KissMessageSource::seek(const byte newPosition)
 {
+  if (_incomingBuffer == nullptr || newPosition >= _length)
   {
-    if (_currentLocation == 255)
-      return MESSAGE_NOT_IN_MESSAGE;
-    if (!readByteRaw(dest))
-      return MESSAGE_TIMEOUT;
-    if (dest == FEND)
-    {
-      _currentLocation = 255;
-      return MESSAGE_END;
-    }
-
-    _currentLocation++;
-    if (dest != FESC)
-      return MESSAGE_OK;
-    if (!readByteRaw(dest))
-      return MESSAGE_TIMEOUT;
-    switch (dest)
-    {
-    case TFEND: dest = FEND; break;
-    case TFESC: dest = FESC; break;
-    case FEND:
-      _currentLocation = 255;
-      return MESSAGE_END;
-    }
-
-    return MESSAGE_OK;
+    _currentLocation = 255;
+    return MESSAGE_END;
   }
-}
\ No newline at end of file
+  _currentLocation = newPosition;
+  return MESSAGE_OK;
+}
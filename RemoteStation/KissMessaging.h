@@ -1,10 +1,72 @@
+#pragma once
 #include "MessagingCommon.h"
 
+constexpr uint16_t kissBufferSize = 300;
+constexpr uint8_t kissMaxQueue = 4;
+constexpr uint8_t kissMaxFrameSize = 254;
+
+// KISS frame types we send to the host
+constexpr byte kissDataFrame = 0x00;
+constexpr byte kissCorruptFrame = 0x01;
+// One or more received packets, each preceded by its metadata:
+// (length:1)(flags:1)(rssi*2:2)(snr*4:1)(micros:4)(data...)
+constexpr byte kissExtendedFrame = 0x02;
+constexpr byte kissExtendedCrcMismatch = 0x01;
+constexpr byte kissExtendedHeaderSize = 9;
+
+// Incremental KISS decoder.
+// processSerial pulls whatever is sitting in the UART receive buffer and returns immediately,
+// completed frames are queued in _buffer until they are read by KissMessageSource.
+// If the queue is full we simply stop reading, leaving the bytes with the UART.
+class KissReceiver
+{
+  public:
+    void processSerial();
+
+    // Note that buffer is only valid until doneWithFrame is called
+    bool dequeueFrame(byte** buffer, byte* length, byte* type);
+    void doneWithFrame();
+    inline uint8_t framesWaiting() { return _writeFrameIdx - _readFrameIdx; }
+    // Used for flow control, so the host knows how much it can send before it should wait.
+    inline uint8_t freeFrames() { return kissMaxQueue - _writeFrameIdx; }
+    inline uint16_t freeBytes() { return kissBufferSize - _frameStart - _partialLength; }
+
+  private:
+    enum class States : byte {
+      Hunting, // Discarding until the next FEND
+      AwaitingType,
+      InFrame,
+      Escaped
+    };
+
+    inline bool hasSpace()
+    {
+      return _writeFrameIdx < kissMaxQueue && _frameStart + _partialLength < kissBufferSize;
+    }
+    void processByte(byte data);
+    void appendToFrame(byte data);
+    void completeFrame();
+
+    byte _buffer[kissBufferSize];
+    byte _frameLengths[kissMaxQueue];
+    byte _frameTypes[kissMaxQueue];
+    uint16_t _frameStart = 0; // Where the frame currently being received begins
+    byte _partialLength = 0;
+    byte _partialType;
+    uint8_t _readFrameIdx = 0;
+    uint8_t _writeFrameIdx = 0;
+    uint16_t _readOffset = 0; // Where the frame at _readFrameIdx begins
+    bool _checkedOut = false;
+    States _state = States::Hunting;
+};
+
+extern KissReceiver kissReceiver;
+
 class KissMessageSource : public MessageSource
 {
   private:
-    bool readByteRaw(byte& dest);
     uint8_t _messageType;
+    byte* _incomingBuffer = nullptr;
 
   public:
     ~KissMessageSource();
@@ -19,10 +81,17 @@ class KissMessageSource : public MessageSource
 class KissMessageDestination : public MessageDestination
 {
   private:
+    void writeRaw(const byte data);
 
   public:
-    KissMessageDestination(bool corrupt);
+    KissMessageDestination(bool corrupt, byte type = kissDataFrame);
     ~KissMessageDestination();
     MESSAGE_RESULT finishAndSend() override;
     MESSAGE_RESULT appendByte(const byte data) override;
-};
\ No newline at end of file
+    // What's been written can't be taken back, so this just ends the frame where it is.
+    // The host throws away a record that's shorter than its length says.
+    void abort();
+
+  private:
+    bool _open = true;
+};
@@ -4,6 +4,7 @@
 #include <spi.h>
 #include "PermanentStorage.h"
 #include "StackCanary.h"
+#include "DuplicateFilter.h"
 #include <avr/wdt.h>
 
 #define SERIALBAUD 38400
@@ -83,6 +84,94 @@ unsigned long lastFailMillis = 0;
 BatteryMode batteryMode = BatteryMode::Normal;
 bool stasisRequested = false;
 
+// Tell the host how much room we've got for frames headed to the radio.
+// Sent whenever that changes, and after every frame we handle, so the host can hold off instead of overrunning us.
+// The host waits on both the frames and the bytes, so it's repeated every so often in case one got lost on the way.
+constexpr unsigned long flowControlRefreshMillis = 1000;
+void sendFlowControl(bool force)
+{
+  static uint8_t lastFreeFrames = 255;
+  static unsigned long lastSentMillis = 0;
+  auto freeFrames = kissReceiver.freeFrames();
+  if (freeFrames == lastFreeFrames && !force && millis() - lastSentMillis < flowControlRefreshMillis)
+    return;
+  lastFreeFrames = freeFrames;
+  lastSentMillis = millis();
+
+  KissMessageDestination status(false);
+  status.appendByte('X');
+  status.appendByte(0x08); //Message type
+  status.appendByte(0x00); //Station ID
+  status.appendByte(0x00); //Unique ID
+  status.appendByte(freeFrames);
+  status.appendT(kissReceiver.freeBytes());
+  status.appendByte(csma.messagesWaiting());
+  status.finishAndSend();
+}
+
+// Maximum number of received packets to put in each extended KISS frame
+byte kissBatchSize = 1;
+
+MESSAGE_RESULT appendExtendedRecord(KissMessageDestination& dst, LoraMessageSource& src)
+{
+  byte flags = 0;
+#ifdef GET_CRC_FAILURES
+  if (src._crcMismatch)
+    flags |= kissExtendedCrcMismatch;
+#else
+  static_assert(false); //Because GET_CRC_FAILURES should be defined if MODEM is defined.
+#endif
+  dst.appendByte(src.getMessageLength() - src.getCurrentLocation());
+  dst.appendByte(flags);
+  dst.appendT(src._metadata.rssi_x2);
+  dst.appendT(src._metadata.snr_x4);
+  dst.appendT(src._metadata.micros);
+  return dst.appendData(src, maxPacketSize);
+}
+
+// A packet too big to go in an extended frame (the frame's length would hit 255, which means 'not in a message')
+// goes the old way: a data frame, then an 'X' 0x07 stats frame.
+bool sendLegacyPacket(LoraMessageSource& src)
+{
+  bool sent;
+  {
+    KissMessageDestination dst(src._crcMismatch);
+    dst.appendData(src, maxPacketSize);
+    sent = dst.finishAndSend() == MESSAGE_END;
+  }
+
+  KissMessageDestination stats(false);
+  stats.appendByte('X');
+  stats.appendByte(0x07); //Message type
+  stats.appendByte(0x00); //Station ID
+  stats.appendByte(0x00); //Unique ID
+  stats.appendT(src._metadata.rssi_x2 / 2.0f);
+  stats.appendT(src._metadata.snr_x4 / 4.0f);
+  stats.appendT(src._metadata.micros);
+  stats.finishAndSend();
+  return sent;
+}
+
+// Dequeues the next message that isn't a duplicate.
+// If waitingOnly, only considers messages already read off the radio that fit in room.
+bool beginUniqueMessage(LoraMessageSource& src, bool waitingOnly, size_t room)
+{
+  while (true)
+  {
+    if (waitingOnly)
+    {
+      auto nextLength = csma.peekMessageLength();
+      if (nextLength == 0 || kissExtendedHeaderSize + nextLength > room)
+        return false;
+    }
+    if (!src.beginMessage())
+      return false;
+    if (!DuplicateFilter::isDuplicate(src))
+      return true;
+    src.doneWithMessage();
+  }
+}
+
 int main()
 {
   //Enable the watchdog early to catch initialisation hangs (Side note: This limits initialisation to 8 seconds)
@@ -127,8 +216,10 @@ int main()
   Serial.print(F("Arduino LoRa modem. Version "));
   Serial.println(REV_ID);
   Serial.println();
+  byte codingRate;
+  GET_PERMANENT_S(codingRate);
   Serial.print(F("Coding Rate: "));
-  Serial.println(LORA_CR);
+  Serial.println(codingRate);
   Serial.println();
   Serial.println(F("Starting..."));
 
@@ -137,20 +228,44 @@ int main()
 
   while (1)
   {
+    // Each pass handles at most one frame in each direction so that neither
+    // a busy channel nor a chatty host can starve the other.
+    kissReceiver.processSerial();
+    sendFlowControl(false);
+
     LoraMessageSource loraSrc;
-    while (loraSrc.beginMessage())
+    if (beginUniqueMessage(loraSrc, false, 0))
     {
-      auto rssi = lora.getRSSI();
-      auto snr = lora.getSNR();
-      bool corrupt = false;
-#ifdef GET_CRC_FAILURES
-      corrupt = loraSrc._crcMismatch;
-#else
-      static_assert(false); //Because GET_CRC_FAILURES should be defined if MODEM is defined.
-#endif
-      KissMessageDestination dst(corrupt);
-      dst.appendData(loraSrc, maxPacketSize);
-      if (dst.finishAndSend() == MESSAGE_END)
+      bool sent;
+      if (kissExtendedHeaderSize + loraSrc.getMessageLength() - loraSrc.getCurrentLocation() > maxPacketSize)
+      {
+        sent = sendLegacyPacket(loraSrc);
+        loraSrc.doneWithMessage();
+      }
+      else
+      {
+        KissMessageDestination dst(false, kissExtendedFrame);
+        byte batched = 0;
+        MESSAGE_RESULT result;
+        while (true)
+        {
+          result = appendExtendedRecord(dst, loraSrc);
+          loraSrc.doneWithMessage();
+          // Didn't get all of it. Close the frame, the host drops the short record.
+          if (result != MESSAGE_END)
+          {
+            dst.abort();
+            break;
+          }
+          // Only batch what's already waiting, and only if it fits in a single frame.
+          if (++batched >= kissBatchSize ||
+              !beginUniqueMessage(loraSrc, true, maxPacketSize - dst.getCurrentLocation()))
+            break;
+        }
+        // An aborted frame didn't get anything to the host, so it mustn't hide a stuck link from the watchdog or the jiggle
+        sent = result == MESSAGE_END && dst.finishAndSend() == MESSAGE_END;
+      }
+      if (sent)
       {
         wdt_reset();
 #ifdef WATCHDOG_LOOPS
@@ -158,17 +273,10 @@ int main()
 #endif
         lastMessage = millis();
       }
-      dst.finishAndSend();
-
-      KissMessageDestination stats(false);
-      stats.appendByte('X');
-      stats.appendByte(0x07); //Message type
-      stats.appendByte(0x00); //Station ID
-      stats.appendByte(0x00); //Unique ID
-      stats.appendT(rssi);
-      stats.appendT(snr);
-      stats.finishAndSend();
     }
+    else if (loraSrc._lastBeginError == REENTRY_NOT_SUPPORTED)
+      csma.clearBuffer();
+    DuplicateFilter::sendExpired();
     
     auto thisMillis = millis();
     if (thisMillis - lastMessage > messageInterval &&
@@ -181,22 +289,60 @@ int main()
     }
     
     KissMessageSource kissSrc;
-    if (Serial.available() > 0 && kissSrc.beginMessage())
+    if (kissSrc.beginMessage())
     {
       if (kissSrc.getMessageType() == 0x00)
       {
         byte buffer[254];
         LoraMessageDestination dst(true, buffer, sizeof(buffer));
         auto result = dst.appendData(kissSrc, maxPacketSize);
+        kissSrc.endMessage();
         if (result != MESSAGE_END)
           dst.abort();
-        else
-          dst.finishAndSend();
+        else if (dst.finishAndSend() == MESSAGE_OK)
+        {
+          // The transmit put the radio back into receive, it doesn't need a jiggle.
+          lastMessage = millis();
+        }
       }
       else if (kissSrc.getMessageType() == 0x06)
       {
-        byte desc;
-        if (handleMessageCommand(kissSrc, &desc))
+        byte desc = 0;
+        auto commandStart = kissSrc.getCurrentLocation();
+        if (!kissSrc.readByte(desc) && desc == 'H')
+        {
+          KissMessageDestination reply(false);
+          reply.appendByte('X');
+          reply.appendByte(0x09); //Message type
+          reply.appendByte(0x00); //Station ID
+          reply.appendByte(0x00); //Unique ID
+          handleSetHardware(kissSrc, reply);
+          reply.finishAndSend();
+        }
+        else if (desc == 'D')
+        {
+          unsigned short windowMillis;
+          if (!kissSrc.read(windowMillis))
+          {
+            DuplicateFilter::windowMillis = windowMillis;
+            Serial.println(F("Command SUCCESS"));
+          }
+          else
+            Serial.println(F("Command FAILURE"));
+        }
+        else if (desc == 'K')
+        {
+          byte batchSize;
+          if (!kissSrc.read(batchSize) && batchSize > 0)
+          {
+            kissBatchSize = batchSize;
+            Serial.println(F("Command SUCCESS"));
+          }
+          else
+            Serial.println(F("Command FAILURE"));
+        }
+        else if (kissSrc.seek(commandStart) == MESSAGE_OK &&
+            handleMessageCommand(kissSrc, &desc))
           Serial.println(F("Command SUCCESS"));
         else if (desc == 'I')
         {
@@ -211,6 +357,8 @@ int main()
         else
           Serial.println(F("Command FAILURE"));
       }
+      kissSrc.endMessage();
+      sendFlowControl(true);
     }
   }
 
@@ -224,5 +372,6 @@ void yield()
     return;
   preventRecursion = true;
   LORA_CHECK(csma.readIfPossible());
+  kissReceiver.processSerial();
   preventRecursion = false;
 }
\ No newline at end of file
@@ -12,6 +12,15 @@ extern inline int16_t lora_check(const int16_t result, const __FlashStringHelper
 bool delayRequired = false;
 bool initMessagingRequired = false;
 
+#ifdef MODEM
+uint16_t outboundPreambleOverride = 0;
+// What the radio is currently using, and what the host has asked for without persisting it.
+// The latter is reapplied if we have to reinitialise the radio.
+static RadioSettings currentSettings;
+static RadioSettings liveSettings;
+static int16_t applyRadioSettings(const RadioSettings& settings);
+#endif
+
 //Hardware pins:
 Module mod(SX_SELECT, SX_DIO1, SX_BUSY);
 SX1262 lora = &mod;
@@ -86,6 +95,7 @@ void InitMessaging()
     AWS_DEBUG_PRINTLN(F("Freq OOR. Using Default"));
     frequency_i = defaultFreq;
     bandwidth_i = defaultBw;
+    PermanentStorage::Transaction transaction;
     SET_PERMANENT_S(frequency_i);
     SET_PERMANENT_S(bandwidth_i);
   }
@@ -99,6 +109,8 @@ void InitMessaging()
   GET_PERMANENT_S(csmaP);
   GET_PERMANENT_S(csmaTimeslot);
   GET_PERMANENT_S(codingRate);
+  if (codingRate < 5 || codingRate > 8)
+    codingRate = LORA_CR;
   
   int state = ERR_UNKNOWN;
   
@@ -143,7 +155,7 @@ void InitMessaging()
     state = LORA_CHECK(lora.begin_i(frequency_i,
       bandwidth_i,
       spreadingFactor,
-      LORA_CR,
+      codingRate,
       SX126X_SYNC_WORD_PRIVATE,
       txPower,
       (uint8_t)(140 / 2.5), //current limit
@@ -175,8 +187,161 @@ void InitMessaging()
   bool boostedRx;
   GET_PERMANENT_S(boostedRx);
   LORA_CHECK(lora.setRxGain(boostedRx));
+
+#ifdef MODEM
+  uint16_t outboundPreambleLength;
+  GET_PERMANENT_S(outboundPreambleLength);
+  currentSettings = { frequency_i, bandwidth_i, spreadingFactor, codingRate, outboundPreambleLength };
+  LORA_CHECK(applyRadioSettings(liveSettings));
+#endif
+}
+
+uint32_t symbolTime_us(uint16_t bandwidth_i, byte spreadingFactor)
+{
+  // bandwidth_i is in units of 100Hz
+  return ((uint32_t)10000 << spreadingFactor) / bandwidth_i;
+}
+
+uint32_t byteAirtime_us(uint16_t bandwidth_i, byte spreadingFactor, byte codingRate)
+{
+  auto symbolTime = symbolTime_us(bandwidth_i, spreadingFactor);
+  // Radiolib turns on low data rate optimisation for symbols over 16ms, which costs us two bits per symbol.
+  byte bitsPerSymbol = symbolTime > 16000 ? spreadingFactor - 2 : spreadingFactor;
+  // Each symbol carries bitsPerSymbol * 4/codingRate bits of payload.
+  return symbolTime * 2 * codingRate / bitsPerSymbol;
 }
 
+#ifdef MODEM
+static int16_t applyRadioSettings(const RadioSettings& settings)
+{
+  int16_t state = ERR_NONE;
+  if (settings.frequency_i)
+  {
+    if (settings.frequency_i < MIN_FREQ || settings.frequency_i > MAX_FREQ)
+      return ERR_INVALID_FREQUENCY;
+#ifdef USE_FP
+    state = LORA_CHECK(lora.setFrequency(settings.frequency_i / 1000000.0));
+#else
+    state = LORA_CHECK(lora.setFrequency_i(settings.frequency_i));
+#endif
+    if (state != ERR_NONE)
+      return state;
+    currentSettings.frequency_i = settings.frequency_i;
+  }
+  if (settings.bandwidth_i)
+  {
+#ifdef USE_FP
+    state = LORA_CHECK(lora.setBandwidth(settings.bandwidth_i / 10.0));
+#else
+    state = LORA_CHECK(lora.setBandwidth_i(settings.bandwidth_i));
+#endif
+    if (state != ERR_NONE)
+      return state;
+    currentSettings.bandwidth_i = settings.bandwidth_i;
+  }
+  if (settings.spreadingFactor)
+  {
+    state = LORA_CHECK(lora.setSpreadingFactor(settings.spreadingFactor));
+    if (state != ERR_NONE)
+      return state;
+    currentSettings.spreadingFactor = settings.spreadingFactor;
+  }
+  if (settings.codingRate)
+  {
+    state = LORA_CHECK(lora.setCodingRate(settings.codingRate));
+    if (state != ERR_NONE)
+      return state;
+    currentSettings.codingRate = settings.codingRate;
+  }
+  if (settings.outboundPreambleLength)
+  {
+    if (settings.outboundPreambleLength > 2048)
+      return ERR_UNKNOWN;
+    outboundPreambleOverride = settings.outboundPreambleLength;
+    currentSettings.outboundPreambleLength = settings.outboundPreambleLength;
+  }
+  return state;
+}
+
+// KISS SetHardware: 'H' (flags:1) (frequency:4) (bandwidth:2) (spreading factor:1) (coding rate:1) (outbound preamble:2)
+// Unless SET_HARDWARE_PERSIST is set, changes last until the modem is restarted or SET_HARDWARE_REVERT is sent.
+// The reply gives the settings now in use and how long they take on air.
+void handleSetHardware(MessageSource& src, MessageDestination& reply)
+{
+  byte flags;
+  RadioSettings settings;
+  int16_t state = ERR_UNKNOWN;
+  if (!src.read(flags) && !src.read(settings))
+  {
+    state = LORA_CHECK(lora.standby(SX126X_STANDBY_RC));
+    if (state == ERR_NONE && (flags & SET_HARDWARE_REVERT))
+    {
+      liveSettings = { };
+      outboundPreambleOverride = 0;
+      RadioSettings persisted;
+      GET_PERMANENT2(&persisted.frequency_i, frequency_i);
+      GET_PERMANENT2(&persisted.bandwidth_i, bandwidth_i);
+      GET_PERMANENT2(&persisted.spreadingFactor, spreadingFactor);
+      GET_PERMANENT2(&persisted.codingRate, codingRate);
+      persisted.outboundPreambleLength = 0;
+      state = applyRadioSettings(persisted);
+      GET_PERMANENT2(&currentSettings.outboundPreambleLength, outboundPreambleLength);
+    }
+    if (state == ERR_NONE)
+      state = applyRadioSettings(settings);
+    if (state == ERR_NONE && (flags & SET_HARDWARE_PERSIST))
+    {
+      // A live setting left behind would win over the persisted one when InitMessaging runs again.
+      PermanentStorage::Transaction transaction;
+      if (settings.frequency_i)
+      {
+        SET_PERMANENT2(&settings.frequency_i, frequency_i);
+        liveSettings.frequency_i = 0;
+      }
+      if (settings.bandwidth_i)
+      {
+        SET_PERMANENT2(&settings.bandwidth_i, bandwidth_i);
+        liveSettings.bandwidth_i = 0;
+      }
+      if (settings.spreadingFactor)
+      {
+        SET_PERMANENT2(&settings.spreadingFactor, spreadingFactor);
+        liveSettings.spreadingFactor = 0;
+      }
+      if (settings.codingRate)
+      {
+        SET_PERMANENT2(&settings.codingRate, codingRate);
+        liveSettings.codingRate = 0;
+      }
+      if (settings.outboundPreambleLength)
+      {
+        SET_PERMANENT2(&settings.outboundPreambleLength, outboundPreambleLength);
+        liveSettings.outboundPreambleLength = 0;
+      }
+    }
+    else if (state == ERR_NONE)
+    {
+      if (settings.frequency_i)
+        liveSettings.frequency_i = settings.frequency_i;
+      if (settings.bandwidth_i)
+        liveSettings.bandwidth_i = settings.bandwidth_i;
+      if (settings.spreadingFactor)
+        liveSettings.spreadingFactor = settings.spreadingFactor;
+      if (settings.codingRate)
+        liveSettings.codingRate = settings.codingRate;
+      if (settings.outboundPreambleLength)
+        liveSettings.outboundPreambleLength = settings.outboundPreambleLength;
+    }
+    LORA_CHECK(csma.enterIdleState());
+  }
+
+  reply.appendT(state);
+  reply.appendT(currentSettings);
+  reply.appendT(symbolTime_us(currentSettings.bandwidth_i, currentSettings.spreadingFactor));
+  reply.appendT(byteAirtime_us(currentSettings.bandwidth_i, currentSettings.spreadingFactor, currentSettings.codingRate));
+}
+#endif
+
 bool handleMessageCommand(MessageSource& src, byte* desc)
 {
   byte descByte;
@@ -365,6 +530,9 @@ bool LoraMessageSource::beginMessage()
     &_timestamp
 #ifdef GET_CRC_FAILURES
     , &_crcMismatch
+#endif
+#ifdef GET_PACKET_METADATA
+    , &_metadata
 #endif
   ));
   // The result of dequeueMessage is actually the result of readIfPossible
@@ -16,6 +16,26 @@ bool handleMessageCommand(MessageSource& src, byte* desc = nullptr);
 void appendMessageStatistics(MessageDestination& msg);
 void updateIdleState(); 
 void sleepRadio();
+uint32_t symbolTime_us(uint16_t bandwidth_i, byte spreadingFactor);
+uint32_t byteAirtime_us(uint16_t bandwidth_i, byte spreadingFactor, byte codingRate);
+
+#ifdef MODEM
+// Radio parameters the host can change on the fly. A zero field is left as it is.
+struct RadioSettings
+{
+  uint32_t frequency_i;
+  uint16_t bandwidth_i;
+  byte spreadingFactor;
+  byte codingRate;
+  uint16_t outboundPreambleLength;
+};
+
+constexpr byte SET_HARDWARE_PERSIST = 0x01;
+constexpr byte SET_HARDWARE_REVERT = 0x02;
+
+void handleSetHardware(MessageSource& src, MessageDestination& reply);
+extern uint16_t outboundPreambleOverride;
+#endif
 
 extern SX1262 lora;
 extern CSMAWrapper<SX1262> csma;
@@ -43,6 +63,9 @@ class LoraMessageSource : public MessageSource
 #ifdef GET_CRC_FAILURES
     bool _crcMismatch;
 #endif
+#ifdef GET_PACKET_METADATA
+    PacketMetadata _metadata;
+#endif
 
   private:
     byte* _incomingBuffer;
@@ -134,6 +157,10 @@ class LoraMessageDestination final : public MessageDestination
         uint16_t outboundPreambleLength;
         GET_PERMANENT_S(outboundPreambleLength);
         preambleLength = outboundPreambleLength;
+    #ifdef MODEM
+        if (outboundPreambleOverride)
+          preambleLength = outboundPreambleOverride;
+    #endif
       }
       else
       {
@@ -10,6 +10,11 @@
 #include "Commands.h"
 #include "TimerTwo.h"
 #include "Database.h"
+#include "Scheduler.h"
+#include "TimeSync.h"
+#include "StackCanary.h"
+#include "Trace.h"
+#include "Routing.h"
 
 #ifdef DEBUG_MSGPROC
 #define MSGPROC_PRINT AWS_DEBUG_PRINT
@@ -30,20 +35,21 @@ void* operator new(size_t size, void* ptr)
 namespace MessageHandling
 {
   bool haveRelayed(byte msgType, byte msgStatID, byte msgUniqueID);
-  void recordHeardStation(byte msgStatID);
+  void recordHeardStation(byte msgStatID, LoraMessageSource& msg);
   bool shouldRelay(byte msgType, byte msgStatID, byte msgUniqueID);
   bool shouldRecord(byte msgType, bool relayRequired,
     MessageSource& msg);
   bool recordWeatherForRelay(MessageSource& message, byte msgStatID, byte msgUniqueID);
-  void relayMessage(MessageSource& message, byte msgType, byte msgFirstByte, byte msgStatID, byte msgUniqueID);
+  void relayMessage(MessageSource& message, byte msgType, byte msgFirstByte, byte msgStatID, byte msgUniqueID, unsigned short rxTimestamp);
   void recordMessageRelay(byte msgType, byte msgStatID, byte msgUniqueID);
-  void checkPing(MessageSource& message);
+  void checkPing(LoraMessageSource& msg, unsigned short rxTimestamp);
   void readMessage(LoraMessageSource& msg);
   void resendRelayIfNecessary();
   void updateRelayResend(byte msgType, byte msgUniqueID, unsigned short msgTimestamp);
 
   //These arrays use 320 bytes.
   RecentlySeenStation recentlySeenStations[permanentArraySize]; //100
+  byte stationHeartbeats_4s[permanentArraySize];
   RecentlyRelayedMessage recentlyRelayedMessages[permanentArraySize]; //60
   byte recentlyRelayedMessageIndex = 0;
   byte curUniqueID = 0;
@@ -79,6 +85,7 @@ namespace MessageHandling
     {
       readMessage(msg);
       msg.doneWithMessage();
+      stackCheckpoint(StackMessages);
     }
     if (msg._lastBeginError == REENTRY_NOT_SUPPORTED)
       csma.clearBuffer();
@@ -122,6 +129,7 @@ namespace MessageHandling
     }
 
     byte afterHeader = msg.getCurrentLocation();
+    TRACE_EVENT(Received, msgType, msgStatID);
 
     MSGPROC_PRINT(F("Message Received. Type: "));
     MSGPROC_PRINT((char)msgType);
@@ -131,7 +139,7 @@ namespace MessageHandling
     MSGPROC_PRINTLN(msgUniqueID);
 
     if (msgType == 'P' && Commands::checkCommandUID(msgUniqueID))
-      checkPing(msg);
+      checkPing(msg, msg._timestamp);
 
     //If it's one of our messages relayed back to us, ignore it:
     if (msgType != 'C' && msgStatID == stationID)
@@ -143,7 +151,10 @@ namespace MessageHandling
 
     //Record the weather stations we hear:
     if (msgType == 'W')
-      recordHeardStation(msgStatID);
+    {
+      recordHeardStation(msgStatID, msg);
+      msg.seek(afterHeader);
+    }
 
     updateRelayResend(msgType, msgUniqueID, msg._timestamp);
 
@@ -171,7 +182,7 @@ namespace MessageHandling
           msgFirstByte = 'Q';
       }
       if (!relayed)
-        relayMessage(msg, msgType, msgFirstByte, msgStatID, msgUniqueID);
+        relayMessage(msg, msgType, msgFirstByte, msgStatID, msgUniqueID, msg._timestamp);
 
       recordMessageRelay(msgType, msgStatID, msgUniqueID);
     }
@@ -249,7 +260,7 @@ namespace MessageHandling
         }
       }
     }
-    return false;
+    return Routing::shouldRelay(msgType, msgStatID);
   }
 
   bool haveRelayed(byte msgType, byte msgStatID, byte msgUniqueID)
@@ -299,6 +310,11 @@ namespace MessageHandling
       _relayNeedsResend = false;
       updateResendStats(true);
     }
+    else if (_relayNeedsResend)
+    {
+      unsigned short waited = millis16() - _relayTimestamp;
+      Scheduler::setDeadline(Scheduler::Relay, millis() + relayListenPeriod + relayDelay + 1 - waited);
+    }
   }
 
   void updateRelayResend(byte msgType, byte msgUniqueID, unsigned short msgTimestamp)
@@ -318,7 +334,7 @@ namespace MessageHandling
     }
   }
 
-  void relayMessage(MessageSource& msg, byte msgType, byte msgFirstByte, byte msgStatID, byte msgUniqueID)
+  void relayMessage(MessageSource& msg, byte msgType, byte msgFirstByte, byte msgStatID, byte msgUniqueID, unsigned short rxTimestamp)
   {
     //Outbound messages are 'C' or 'P'
     byte buffer[254];
@@ -330,8 +346,11 @@ namespace MessageHandling
     // so we leave the sender station ID
     _relayMessage.appendByte2(msgStatID);
     _relayMessage.appendByte2(msgUniqueID);
+    if (msgType == 'P')
+      TimeSync::appendRelayedPing(_relayMessage, msg, rxTimestamp);
     _relayMessage.appendData(msg, 254);
     _relayMessage.finishAndSend();
+    TRACE_EVENT(Relayed, msgType, msgStatID);
     // Our relay timestamp only starts after the message is sent.
     // This means we will not consider messages received before we have sent as confirmation
     // 
@@ -368,16 +387,22 @@ namespace MessageHandling
       msg.readBytes(weatherRelayBuffer + offset, dataSize);
 
     if (sourceFaulted)
+    {
       weatherRelayLength = 0;
-    else
-      weatherRelayLength += dataSize;
+      return true;
+    }
+    weatherRelayLength += dataSize;
+    // (SID)(UID)(Length)(Data)... Everyone after the sender is further from the base than we are.
+    for (byte i = offset; i + 2 < weatherRelayLength; i += WeatherProcessing::weatherRecordSize(weatherRelayBuffer + i))
+    {
+      if (weatherRelayBuffer[i] != msgStatID)
+        Routing::heardDownstream(weatherRelayBuffer[i]);
+    }
     return true;
   }
 
-  void recordHeardStation(byte msgStatID)
+  void recordHeardStation(byte msgStatID, LoraMessageSource& msg)
   { 
-    uint32_t packetStatus = lora.getPacketStatus();
-
     RecentlySeenStation* cur = recentlySeenStations;
     RecentlySeenStation* end = recentlySeenStations + permanentArraySize;
     uint32_t oldest = 0;
@@ -396,10 +421,27 @@ namespace MessageHandling
     }
     if (cur == end)
       cur = oldestRecord;
+    byte index = cur - recentlySeenStations;
+    byte* heartbeat = stationHeartbeats_4s + index;
+    if (cur->id != msgStatID)
+      *heartbeat = 0;
+    Routing::heardNeighbour(index, cur->id != msgStatID);
     cur->id = msgStatID;
     cur->millis = curMillis;
-    cur->rssi_xn2 = packetStatus & 0xFF;
-    cur->snr_x4 = (packetStatus >> 8) & 0xFF;
+    cur->rssi_xn2 = -msg._metadata.rssi_x2;
+    cur->snr_x4 = msg._metadata.snr_x4;
+    byte dataLength;
+    if (msg.readByte(dataLength) == MESSAGE_OK &&
+        !(dataLength & WeatherProcessing::deltaLengthFlag) && dataLength >= WeatherProcessing::weatherHeartbeatByte)
+    {
+      // The sender's heartbeat and route, from their complex weather
+      byte afterLength = msg.getCurrentLocation();
+      msg.seek(afterLength + WeatherProcessing::weatherHeartbeatByte - 1);
+      msg.readByte(*heartbeat);
+      byte route[2];
+      if (dataLength >= WeatherProcessing::weatherRouteEndByte && msg.readBytes(route, sizeof(route)) == MESSAGE_OK)
+        Routing::heardAdvert(index, route[0], route[1]);
+    }
   }
 
   void sendWeatherMessage()
@@ -410,11 +452,17 @@ namespace MessageHandling
     //W (Station ID) (Unique ID) (8) (WS) (WD) (Batt) : (StationR) (UidR) (WsR) (WdR) (BattR)
     //If there are multiple relay messages included, each has an extra 5 bytes.
   
+    // On the heartbeat with nothing new - but always pass on what we've been asked to relay.
+    if (!WeatherProcessing::weatherReportDue() && weatherRelayLength == 0)
+      return;
+
     byte buffer[254];
-    LoraMessageDestination message(false, buffer, sizeof(buffer), 'W', getUniqueID());
+    byte uniqueID = getUniqueID();
+    LoraMessageDestination message(false, buffer, sizeof(buffer), 'W', uniqueID);
 
-    WeatherProcessing::createWeatherData(message);
+    WeatherProcessing::createWeatherData(message, uniqueID);
     message.append(weatherRelayBuffer, weatherRelayLength);
+    TRACE_EVENT(WeatherSent, batteryReading_mV, weatherRelayLength);
     weatherRelayLength = 0;
     message.finishAndSend();
   }
@@ -434,7 +482,7 @@ namespace MessageHandling
     lastStatusMillis = millis();
   }
 
-  void checkPing(MessageSource& msg)
+  void checkPing(LoraMessageSource& msg, unsigned short rxTimestamp)
   {
     byte callSignBuffer[sizeof(callSign) - 1];
     if (msg.readBytes(callSignBuffer, sizeof(callSignBuffer)) != MESSAGE_OK)
@@ -452,16 +500,17 @@ namespace MessageHandling
     else
     {
       MSGPROC_PRINTLN(F("Ping Successful"));
-      unsigned long seconds;
-      if (msg.read(seconds) == MESSAGE_OK)
-      {
-        MSGPROC_PRINTLN(F("Time set"));
-        TimerTwo::setSeconds(seconds);
-        MSGPROC_PRINTVAR(seconds);
-        MSGPROC_PRINTVAR(TimerTwo::_ticks);
-        MSGPROC_PRINTVAR(TimerTwo::_ofTicks);
-        MSGPROC_PRINTVAR(TimerTwo::MillisPerTick);
-      }
+      byte afterCallsign = msg.getCurrentLocation();
+      TimeSync::handlePing(msg, rxTimestamp);
+      // (Seconds:4)(Millis:2)(Delay_ms:2)(Hops:1)
+      // Only a ping that says it's come straight from the base is a route to it
+      byte hops;
+      if (msg.seek(afterCallsign + 8) == MESSAGE_OK && msg.read(hops) == MESSAGE_OK && hops == 0)
+        Routing::heardBase(msg._metadata.snr_x4);
+      MSGPROC_PRINTVAR(TimerTwo::_ticks);
+      MSGPROC_PRINTVAR(TimerTwo::_ofTicks);
+      MSGPROC_PRINTVAR(TimerTwo::_correctionMillis);
+      MSGPROC_PRINTVAR(TimerTwo::_driftPerTick);
       lastPingMillis = millis();
     }
   }
@@ -29,6 +29,9 @@ namespace MessageHandling
   };
 
   extern RecentlySeenStation recentlySeenStations[permanentArraySize]; //100 bytes
+  //The heartbeat each of those stations last told us (4 second units, 0 = reporting every interval),
+  //so a quiet station on its heartbeat isn't mistaken for one that's gone.
+  extern byte stationHeartbeats_4s[permanentArraySize];
   //We keep track of recently relayed messages to avoid relaying the same message multiple times
   extern RecentlyRelayedMessage recentlyRelayedMessages[permanentArraySize]; //3 bytes per record: msg type, stationID, uniqueID. 60 bytes
   //Every message is given a unique ID. This is so other stations can keep track of them
@@ -1,6 +1,6 @@
 
 #include <util/crc16.h>
-#include "LoraMessaging.h"
+#include "MessagingCommon.h"
 
 const bool MessageSource::s_discardCallsign = false;
 const bool MessageDestination::s_prependCallsign = false;
@@ -1,9 +1,17 @@
+#ifdef SOLAR_SIM
+// Built on the PC against the plant model in SolarSim/
+#include "SolarSim/SimHardware.h"
+#include "PWMSolar.h"
+#else
 #include <Arduino.h>
 #include "PermanentStorage.h"
 #include "ArduinoWeatherStation.h"
 #include "PWMSolar.h"
 #include "WeatherProcessing/WeatherProcessing.h"
 #include "TimerTwo.h"
+#include "AdcSampler.h"
+#include "Scheduler.h"
+#endif
 
 #ifdef DEBUG_SOLAR
 byte loopCount;
@@ -42,6 +50,7 @@ namespace PwmSolar
   unsigned short safeFreezingChargeLevel_mV;
   byte safeFreezingPwm;
   unsigned short chargeVoltage_mV;
+  bool solarMppt;
 
 #if defined(DEBUG_PWM)
   short debug_desired;
@@ -64,17 +73,24 @@ namespace PwmSolar
   short curCurrent_mA_x6;
   unsigned short lastCurrentCheckMillis;
 
-  int getNewPwmValue(bool* canIdle);
-  byte getMaxPwm(unsigned short batteryVoltage_mV);
+  int getNewPwmValue();
+  byte getMaxPwm(unsigned short batteryVoltage_mV, bool mpptRunning);
   unsigned short getDesiredBatteryVoltage();
-  void ensurePwmActive(bool canIdle);
-  byte readCurrentAndCalcMaxPwm(bool applyLimits);
+  void ensurePwmActive();
+  byte readCurrentAndCalcMaxPwm(bool applyLimits, bool mpptRunning);
 #ifdef CURRENT_SENSE_PWR
   void startupCurrentSensor();
 #endif
 #ifdef CURRENT_SENSE
   short readCurrent_x6();
 #endif
+#ifdef SOLAR_MPPT
+#ifndef CURRENT_SENSE
+#error SOLAR_MPPT needs CURRENT_SENSE
+#endif
+  bool mpptResting();
+  int trackPowerPoint(unsigned short batteryVoltage_mV);
+#endif
 
 #if defined(SOLAR_IMPEDANCE_SWITCHING) && (F_CPU < MAX_PWM_BASE_FREQ)
   constexpr byte minPwm = 8;
@@ -88,6 +104,7 @@ namespace PwmSolar
     GET_PERMANENT_S(safeFreezingChargeLevel_mV);
     GET_PERMANENT_S(safeFreezingPwm);
     GET_PERMANENT_S(chargeVoltage_mV);
+    GET_PERMANENT_S(solarMppt);
 #ifndef SOLAR_IMPEDANCE_SWITCHING
     pinMode(SOLAR_PWM_PIN, OUTPUT);
 #endif
@@ -101,15 +118,19 @@ namespace PwmSolar
 
   void doPwmLoop()
   {
-    if (micros() - lastPwmMicros < PwmUpdateInterval_uS)
+    unsigned long sinceUpdate_uS = micros() - lastPwmMicros;
+    if (sinceUpdate_uS < PwmUpdateInterval_uS)
+    {
+      Scheduler::setDeadline(Scheduler::Solar, millis() + (PwmUpdateInterval_uS - sinceUpdate_uS) / 1000);
       return;
+    }
+    Scheduler::setDeadline(Scheduler::Solar, millis() + PwmUpdateInterval_uS / 1000);
 #ifdef DEBUG_SOLAR
     loopCount++;
 #endif
     lastPwmMicros = micros();
     
-    bool canIdle;
-    short newValue = getNewPwmValue(&canIdle);
+    short newValue = getNewPwmValue();
     if (newValue < minPwm)
     {
       turnOffSolar();
@@ -125,38 +146,46 @@ namespace PwmSolar
     }
     else
     {
-      ensurePwmActive(canIdle);
+      ensurePwmActive();
       solarPwmValue = OCR0B = newValue;
     }
   }
 
-  int getNewPwmValue(bool* canIdle)
+  int getNewPwmValue()
   {
-    int batteryVoltageReading = analogRead(BATT_PIN);
+    int batteryVoltageReading = AdcSampler::read(BATT_PIN, 0);
     int batteryVoltage_mV = mV_Ref * BattVNumerator * batteryVoltageReading / (BattVDenominator  * 1023);
     
     int desiredVoltage_mV = getDesiredBatteryVoltage();
 
-    int maxPwm = getMaxPwm(batteryVoltage_mV);
-
     int change = (long)(desiredVoltage_mV - batteryVoltage_mV) * chargeResponseRate / 256;
 
+    // Below the charge voltage, MPPT decides how hard to charge. At it, the voltage controller still brings us back.
+#ifdef SOLAR_MPPT
+    // While it's resting the voltage controller has the switch fully on, and the sensor can sleep.
+    bool mpptRunning = solarMppt && change > 0 && !mpptResting();
+#else
+    constexpr bool mpptRunning = false;
+#endif
+
+    int maxPwm = getMaxPwm(batteryVoltage_mV, mpptRunning);
+
     int newValue = solarPwmValue + change;
+#ifdef SOLAR_MPPT
+    if (mpptRunning)
+      newValue = trackPowerPoint(batteryVoltage_mV);
+#endif
 
     SOLAR_PRINTVAR(batteryVoltage_mV);
     SOLAR_PRINTVAR(solarPwmValue);
     SOLAR_PRINTVAR(change);
 
-    *canIdle = true;
     if (newValue <= 0)
       return 0;
     else if (newValue >= maxPwm)
       return maxPwm;
     else
-    {
-      *canIdle = false;
       return newValue;
-    }
   }
 
   /*
@@ -176,7 +205,8 @@ namespace PwmSolar
   *   + No: Check current immediately.
   * */
 
-  byte readCurrentAndCalcMaxPwm(bool applyLimits)
+  // mpptRunning: trackPowerPoint will want the sensor straight after this, so leave it on.
+  byte readCurrentAndCalcMaxPwm(bool applyLimits, bool mpptRunning)
   {
 #ifndef CURRENT_SENSE
     if (applyLimits)
@@ -197,7 +227,6 @@ namespace PwmSolar
       return 255;
 #else
     //We can use shorts for all these millis values because the intervals are much less than 65 seconds.
-    static unsigned short powerUpMillis;
     unsigned short curMillis = millis();
 #if defined(DEBUG_PWM)
     debug_curMillis = curMillis;
@@ -209,10 +238,9 @@ namespace PwmSolar
     constexpr unsigned short currentCheckInterval_ms = 5000;
     if (currentState == CurrentSensorState::Off)
     {
-      if (curMillis - lastCurrentCheckMillis > currentCheckInterval_ms)
+      if ((unsigned short)(curMillis - lastCurrentCheckMillis) > currentCheckInterval_ms)
       {
         startupCurrentSensor();
-        powerUpMillis = curMillis;
         // Better to delay than to loop - we might sleep for 250ms
         // and leave the current sensor on the whole time (at ~70uA draw).
         delayMicroseconds(powerUpInterval_us);
@@ -220,13 +248,6 @@ namespace PwmSolar
       else
         return 255;
     }
-    /*if (currentState == CurrentSensorState::Startup)
-    {
-      if (curMillis - powerUpMillis > powerUpInterval_ms)
-        currentState = CurrentSensorState::Running;
-      else
-        return 255;
-    }*/
     // If we get here, the sensor is running.
     curCurrent_mA_x6 = readCurrent_x6();
     lastCurrentCheckMillis = curMillis;
@@ -240,7 +261,9 @@ namespace PwmSolar
 #endif
     if (!applyLimits || desired >= 255) {
       // If there is no limit due to the current, then shut the sensor down for a while to save power.
-      stopCurrentSensor();
+      // (Unless MPPT is about to use it)
+      if (!mpptRunning)
+        stopCurrentSensor();
       return 255;
     }
     if (desired < 0)
@@ -268,16 +291,89 @@ namespace PwmSolar
 #ifdef CURRENT_SENSE
   short readCurrent_x6()
   {
-    int reading = analogRead(CURRENT_SENSE);
-    constexpr unsigned long denominator = (CURRENT_SENSE_GAIN * 1023);
+    constexpr byte currentExtraBits = 2;
+    unsigned short reading = AdcSampler::read(CURRENT_SENSE, currentExtraBits);
+    constexpr unsigned long denominator = (CURRENT_SENSE_GAIN * (1023UL << currentExtraBits));
     return ((unsigned long)reading * REF_MV * 6) / denominator;
   }
+
+#endif
+
+#ifdef SOLAR_MPPT
+  // Perturb and observe: step the PWM, and if the charge power dropped, step the other way.
+  // Power is mV * mA_x6, at most ~4200 * 1530, so a long is plenty.
+  // Once the panel's giving nothing (night), or the best we found was the switch fully on, there's nothing to track.
+  // Then we let the sensor sleep and check back every mpptIdleInterval.
+  // Off unless the board defines SOLAR_MPPT: our boards switch the panel straight onto the battery, with no converter,
+  // so anything less than fully on only loses charge. In the SolarSim at --soc 0.3, tracking all the time harvested less
+  // than the voltage controller in every profile (clear 84% -> 83%, cloudy 82% -> 80%, winter 77% -> 76%) and held the
+  // current sensor on for ~12 hours a day. Resting at fully on gets back to within 0.3% (still never ahead), with the
+  // sensor on ~1.3 hours a day. It's worth another look on a board with a buck converter.
+  constexpr byte mpptStep = 4;
+  constexpr short mpptMinCurrent_mA_x6 = 6;
+  constexpr unsigned short mpptIdleInterval_ms = 5000;
+  long lastPower = 0;
+  signed char mpptDirection = -1;
+  unsigned short mpptIdleMillis;
+  bool mpptIdle = false;
+
+  bool mpptResting()
+  {
+    if (mpptIdle && (unsigned short)((unsigned short)millis() - mpptIdleMillis) >= mpptIdleInterval_ms)
+      mpptIdle = false;
+    return mpptIdle;
+  }
+
+  int trackPowerPoint(unsigned short batteryVoltage_mV)
+  {
+    unsigned short curMillis = millis();
+    if (currentState == CurrentSensorState::Off)
+    {
+      startupCurrentSensor();
+      delayMicroseconds(2000);
+    }
+    // The current limit (if any) has just read the sensor for this loop
+    short current_mA_x6 = lastCurrentCheckMillis == curMillis ? curCurrent_mA_x6 : readCurrent_x6();
+    curCurrent_mA_x6 = current_mA_x6;
+    lastCurrentCheckMillis = curMillis;
+    if (current_mA_x6 < mpptMinCurrent_mA_x6)
+    {
+      stopCurrentSensor();
+      mpptIdle = true;
+      mpptIdleMillis = curMillis;
+      lastPower = 0;
+      return 255;
+    }
+    long power = (long)batteryVoltage_mV * current_mA_x6;
+    // Ignore changes in the noise (1/64)
+    if (power < lastPower - (lastPower >> 6))
+      mpptDirection = -mpptDirection;
+    lastPower = power;
+    int newValue = solarPwmValue + mpptDirection * mpptStep;
+    if (newValue >= 255)
+    {
+      // Back up to fully on, so that's the best there is for now
+      stopCurrentSensor();
+      mpptIdle = true;
+      mpptIdleMillis = curMillis;
+      lastPower = 0;
+      mpptDirection = -1;
+      return 255;
+    }
+    else if (newValue < minPwm)
+    {
+      newValue = minPwm;
+      mpptDirection = 1;
+    }
+    SOLAR_PRINTVAR(power);
+    return newValue;
+  }
 #endif
 
   //In cold temperatures with lithium ion, we must perform current and voltage limitation. maxPwm limits the maximum chart current.
   //Internet sources suggest 0.02C charge rate is acceptable in very cold temperatures.
   //So we can calculate the maximum PWM because we know the maximum current from the panel and the battery capacity.
-  byte getMaxPwm(unsigned short batteryVoltage_mV)
+  byte getMaxPwm(unsigned short batteryVoltage_mV, bool mpptRunning)
   {
     bool applyLimits = false;
     if (WeatherProcessing::internalTemperature_x2 > 100)
@@ -289,9 +385,9 @@ namespace PwmSolar
     //If the battery voltage is less than 3.7V, we're unlikely to damage it with any current we throw at it.
     if (batteryVoltage_mV > safeFreezingChargeLevel_mV &&
         (WeatherProcessing::internalTemperature_x2 < 0 ||
-        (WeatherProcessing::internalTemperature_x2 < 4 && WeatherProcessing::externalTemperature < 2))) //The battery might be colder than the MCU - thermal capacity, inaccurate measurement, etc.
+        (WeatherProcessing::internalTemperature_x2 < 4 && WeatherProcessing::externalTemperature_x2 < 2 * 2))) //The battery might be colder than the MCU - thermal capacity, inaccurate measurement, etc.
       applyLimits = true;
-    return readCurrentAndCalcMaxPwm(applyLimits);
+    return readCurrentAndCalcMaxPwm(applyLimits, mpptRunning);
   }
 
   unsigned short getDesiredBatteryVoltage()
@@ -349,7 +445,7 @@ namespace PwmSolar
     solarSleepEnabled = SleepModes::powerSave;
   }
 
-  void ensurePwmActive(bool canIdle)
+  void ensurePwmActive()
   {
     // Set up the necessary registers
     // Ensure the MCU doesn't go to sleep.
@@ -368,7 +464,6 @@ namespace PwmSolar
 #else
     TCCR0B = _BV(CS01); // 8x prescaler: PWM at 3.9kHz for 8MHz
 #endif
-    //solarSleepEnabled = canIdle ? SleepModes::idle : SleepModes::disabled;
   }
 
 #ifdef SOLAR_IMPEDANCE_SWITCHING
@@ -4,6 +4,7 @@ namespace PwmSolar
   extern unsigned short safeFreezingChargeLevel_mV;
   extern byte safeFreezingPwm;
   extern unsigned short chargeVoltage_mV;
+  extern bool solarMppt;
   extern short curCurrent_mA_x6;
   extern byte solarPwmValue;
   extern unsigned short lastCurrentCheckMillis;
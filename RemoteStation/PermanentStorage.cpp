@@ -15,6 +15,226 @@
 char stationID = defaultStationID;
 
 bool PermanentStorage::_initialised = false;
+unsigned short PermanentStorage::_crc;
+bool PermanentStorage::_crcDirty = false;
+byte PermanentStorage::_transactionDepth = 0;
+
+// loop() checks the battery thresholds, updateIdleState walks the relay lists, and every message we hear
+// checks the relay and record lists. We keep those in RAM so they don't cost an EEPROM read each time.
+struct CachedRange
+{
+  byte start;
+  byte end;
+};
+constexpr CachedRange cachedRanges[] =
+{
+  // batteryThreshold_mV, batteryEmergencyThresh_mV, demandRelay, stationsToRelayCommands, stationsToRelayWeather
+  { offsetof(PermanentVariables, batteryThreshold_mV), offsetof(PermanentVariables, frequency_i) },
+  // messageTypesToRecord, recordNonRelayedMessages
+  { offsetof(PermanentVariables, messageTypesToRecord), offsetof(PermanentVariables, inboundPreambleLength) }
+};
+constexpr size_t cacheSize =
+  cachedRanges[0].end - cachedRanges[0].start + cachedRanges[1].end - cachedRanges[1].start;
+static_assert(sizeof(cachedRanges) / sizeof(CachedRange) == 2, "Update cacheSize");
+byte cache[cacheSize];
+
+// Versions:
+//  1: Up to recordWindSeries, wear levelled stationID and stasisRequested.
+//  2: solarMppt
+//  3: autoRoute
+constexpr byte permanentVersion = 3;
+constexpr byte legacyVersion = 0xFF;
+constexpr size_t versionAddress = E2END;
+// What the CRC covers, including itself. sizeof(PermanentVariables) on the AVR, but the PC (HostTests) pads the end.
+constexpr size_t crcEnd = offsetof(PermanentVariables, crc) + sizeof(PermanentVariables::crc);
+// The size of PermanentVariables in each version, so we can check its CRC before migrating it.
+const byte versionSizes[] PROGMEM =
+{
+  offsetof(PermanentVariables, solarMppt) + sizeof(PermanentVariables::crc),
+  offsetof(PermanentVariables, autoRoute) + sizeof(PermanentVariables::crc),
+  crcEnd
+};
+static_assert(sizeof(versionSizes) == permanentVersion, "Add the new size to versionSizes");
+
+// Each of these gets a ring of (sequence)(value) slots, the latest is the one before the sequence breaks.
+// The byte in PermanentVariables keeps its last value from before they were wear levelled.
+constexpr byte wearLevelledFields[] =
+{
+  offsetof(PermanentVariables, stationID),
+  offsetof(PermanentVariables, stasisRequested)
+};
+constexpr byte wearLevelledCount = sizeof(wearLevelledFields);
+constexpr size_t wearLevelStart = 256;
+constexpr size_t wearLevelRingSize = (versionAddress - wearLevelStart) / wearLevelledCount;
+constexpr byte wearLevelSlots = wearLevelRingSize / 2;
+static_assert(sizeof(PermanentVariables) <= wearLevelStart);
+static_assert(wearLevelSlots < 255, "The sequence needs to break somewhere");
+bool wearLevelReady = false;
+byte wearLevelSlot[wearLevelledCount];
+byte wearLevelValue[wearLevelledCount];
+
+static inline byte* slotAddress(byte field, byte slot)
+{
+  return (byte*)(wearLevelStart + field * wearLevelRingSize + 2 * slot);
+}
+
+static void findWearLevelSlots()
+{
+  for (byte field = 0; field < wearLevelledCount; field++)
+  {
+    byte slot = 0;
+    byte seq = eeprom_read_byte(slotAddress(field, 0));
+    while (slot + 1 < wearLevelSlots)
+    {
+      byte nextSeq = eeprom_read_byte(slotAddress(field, slot + 1));
+      if (nextSeq != (byte)(seq + 1))
+        break;
+      seq = nextSeq;
+      slot++;
+    }
+    wearLevelSlot[field] = slot;
+    wearLevelValue[field] = eeprom_read_byte(slotAddress(field, slot) + 1);
+  }
+  wearLevelReady = true;
+}
+
+static void writeWearLevelled(byte field, byte value)
+{
+  if (wearLevelValue[field] == value)
+    return;
+  byte* cur = slotAddress(field, wearLevelSlot[field]);
+  byte slot = wearLevelSlot[field] + 1;
+  if (slot >= wearLevelSlots)
+    slot = 0;
+  byte* next = slotAddress(field, slot);
+  // Value first: if we lose power before the sequence is written the old slot is still the latest.
+  eeprom_write_byte(next + 1, value);
+  eeprom_write_byte(next, eeprom_read_byte(cur) + 1);
+  wearLevelSlot[field] = slot;
+  wearLevelValue[field] = value;
+}
+
+// Start the rings off with what's in PermanentVariables
+static void createWearLevelRings()
+{
+  for (byte field = 0; field < wearLevelledCount; field++)
+  {
+    eeprom_update_byte(slotAddress(field, 0), 0);
+    eeprom_update_byte(slotAddress(field, 0) + 1, eeprom_read_byte((byte*)(size_t)wearLevelledFields[field]));
+    for (byte slot = 1; slot < wearLevelSlots; slot++)
+      eeprom_update_byte(slotAddress(field, slot), 0xFF);
+  }
+  findWearLevelSlots();
+}
+
+// Which ring holds this byte of PermanentVariables, or -1
+static inline signed char wearLevelledField(size_t offset)
+{
+  if (!wearLevelReady)
+    return -1;
+  for (byte field = 0; field < wearLevelledCount; field++)
+    if (wearLevelledFields[field] == offset)
+      return field;
+  return -1;
+}
+
+// Where the bytes are in the cache, or nullptr if they aren't (all) there
+static byte* cachedBytes(size_t offset, size_t size)
+{
+  byte* cur = cache;
+  for (const CachedRange& range : cachedRanges)
+  {
+    if (offset >= range.start && offset + size <= range.end)
+      return cur + (offset - range.start);
+    cur += range.end - range.start;
+  }
+  return nullptr;
+}
+
+static void updateCache(size_t offset, size_t size, const byte* src)
+{
+  byte* cur = cache;
+  for (const CachedRange& range : cachedRanges)
+  {
+    size_t start = offset > range.start ? offset : range.start;
+    size_t end = offset + size < range.end ? offset + size : range.end;
+    if (start < end)
+      memcpy(cur + (start - range.start), src + (start - offset), end - start);
+    cur += range.end - range.start;
+  }
+}
+
+void PermanentStorage::getBytes(const void* address, size_t size, void* buffer)
+{
+  // The cache is loaded at the end of initialise
+  byte* cached = _initialised ? cachedBytes((size_t)address, size) : nullptr;
+  if (cached)
+    memcpy(buffer, cached, size);
+  else
+    eeprom_read_block(buffer, address, size);
+  if (!wearLevelReady)
+    return;
+  size_t offset = (size_t)address;
+  for (byte field = 0; field < wearLevelledCount; field++)
+  {
+    size_t fieldOffset = wearLevelledFields[field];
+    if (fieldOffset >= offset && fieldOffset < offset + size)
+      ((byte*)buffer)[fieldOffset - offset] = wearLevelValue[field];
+  }
+}
+
+// The CRC is linear: CRC(new) = CRC(old) ^ CRC'(old ^ new), where CRC' starts from zero rather than 0xFFFF.
+// (old ^ new) is zero outside what we're writing, and zeros at the start leave CRC' at zero,
+// so we only need to run it over the changed bytes and then the zeros after them.
+void PermanentStorage::setBytes(void* address, size_t size, const void* buffer)
+{
+  size_t offset = (size_t)address;
+  const byte* src = (const byte*)buffer;
+  unsigned short crcChange = 0;
+  bool changed = false;
+  for (size_t i = 0; i < size; i++)
+  {
+    byte* eepromAddress = (byte*)(offset + i);
+    byte old = eeprom_read_byte(eepromAddress);
+    signed char field = wearLevelledField(offset + i);
+    if (field >= 0)
+    {
+      // Goes in its ring, the byte here (and so the CRC) doesn't change.
+      writeWearLevelled(field, src[i]);
+      crcChange = _crc_ccitt_update(crcChange, 0);
+      continue;
+    }
+    if (old != src[i])
+    {
+      eeprom_write_byte(eepromAddress, src[i]);
+      changed = true;
+    }
+    crcChange = _crc_ccitt_update(crcChange, old ^ src[i]);
+  }
+  updateCache(offset, size, src);
+
+  if (!_initialised || !changed)
+    return;
+  constexpr size_t crcOffset = offsetof(PermanentVariables, crc);
+  if (offset + size > crcOffset)
+  {
+    setCRC();
+    return;
+  }
+  for (size_t i = offset + size; i < crcOffset; i++)
+    crcChange = _crc_ccitt_update(crcChange, 0);
+  _crc ^= crcChange;
+  if (_transactionDepth)
+    _crcDirty = true;
+  else
+    writeCRC();
+}
+
+void PermanentStorage::writeCRC()
+{
+  eeprom_write_block(&_crc, (void*)offsetof(PermanentVariables, crc), sizeof(_crc));
+  _crcDirty = false;
+}
 
 //Just copied this out of the example documentation 
 unsigned short PermanentStorage::calcCRC(size_t max)
@@ -29,8 +249,8 @@ unsigned short PermanentStorage::calcCRC(size_t max)
 
 void PermanentStorage::setCRC()
 {
-  short crc = calcCRC(sizeof(PermanentVariables) - 2);
-  eeprom_write_block(&crc, (void*)offsetof(PermanentVariables, crc), sizeof(short));
+  _crc = calcCRC(offsetof(PermanentVariables, crc));
+  writeCRC();
 }
 
 const PermanentVariables defaultVars PROGMEM =
@@ -80,11 +300,76 @@ const PermanentVariables defaultVars PROGMEM =
   .codingRate = 5,
   // When transmitting programming packets, the next relay may take half a second to get their packet onto the air
   // So we wait for that long (+ a bit) before deciding to resend the packet
-  .relayListenPeriod = 600
+  .relayListenPeriod = 600,
+  .heartbeatIntervals = 1,
+  .reportSpeedThreshold_x2 = 3 * 2,
+  .reportGustThreshold_x2 = 5 * 2,
+  .reportDirectionThreshold = 16, // 22.5 degrees
+  .deltaWeather = false,
+  .recordWindSeries = false,
+  .solarMppt = false,
+  .autoRoute = false
 };
 
+// Fills in the fields after oldSize (which included its CRC) from defaultVars
+void PermanentStorage::appendDefaults(size_t oldSize)
+{
+  for (size_t i = oldSize - sizeof(PermanentVariables::crc); i < offsetof(PermanentVariables, crc); i++)
+  {
+    byte b = pgm_read_byte((byte*)&defaultVars + i);
+    setBytes((void*)i, 1, &b);
+  }
+  setCRC();
+}
+
+// Brings the variables from an older version up to date. False if we can't use them.
+bool PermanentStorage::migrate(byte version)
+{
+  if (version == legacyVersion)
+  {
+    if (checkCRC(crcEnd))
+      return true;
+    // Before versions, fields were only ever added to the end.
+    // Look for where the old CRC was and keep everything before it.
+    for (byte i = offsetof(PermanentVariables, inboundPreambleLength);
+      i < crcEnd - 1; i++)
+    {
+      if (checkCRC(i))
+      {
+        appendDefaults(i);
+        return true;
+      }
+    }
+    return false;
+  }
+  if (version > permanentVersion)
+    return false; // From newer firmware, we don't know its layout.
+  if (version == 0)
+    return false; // Versions start at 1: we lost power writing the defaults, or the cell's been corrupted. Don't trust any of it.
+  if (!checkCRC(pgm_read_byte(versionSizes + version - 1)))
+    return false;
+  // Each case takes it up one version and falls through to the next:
+  switch (version)
+  {
+  case 1:
+    appendDefaults(pgm_read_byte(versionSizes + 0));
+    [[fallthrough]];
+  case 2:
+    appendDefaults(pgm_read_byte(versionSizes + 1));
+    [[fallthrough]];
+  case permanentVersion:
+    return true;
+  }
+  return false;
+}
+
 void PermanentStorage::initialise()
 {
+  byte version = eeprom_read_byte((byte*)versionAddress);
+  // 0 is only there while we write the defaults over a layout without rings, so there are none to find.
+  if (version != 0 && version != legacyVersion && version <= permanentVersion)
+    findWearLevelSlots();
+
   bool initialised;
   GET_PERMANENT_S(initialised);
 
@@ -100,28 +385,7 @@ void PermanentStorage::initialise()
   bool completeCrc = false;
   static_assert(sizeof(PermanentVariables) < 0xFF);
   if (initialised)
-  {
-    completeCrc = checkCRC(sizeof(PermanentVariables));
-    if (!completeCrc)
-    {
-      for (byte i = offsetof(PermanentVariables, inboundPreambleLength);
-        i < sizeof(PermanentVariables) - 1; i++)
-      {
-        if (checkCRC(i))
-        {
-          i -= 2;
-          for (; i < offsetof(PermanentVariables, crc); i++)
-          {
-            byte b = pgm_read_byte((byte*)&defaultVars + i);
-            setBytes((void*)i, 1, &b);
-          }
-          setCRC();
-          completeCrc = true;
-          break;
-        }
-      }
-    }
-  }
+    completeCrc = migrate(version);
   if (completeCrc)
   {
     #if DEBUG && defined(DEBUG_PARAMETERS)
@@ -158,6 +422,10 @@ void PermanentStorage::initialise()
   else
   {
     PARAMETER_PRINTLN(F("Initialising Default Parameters"));
+    // If we lose power part way through, what's there mustn't pass for an older layout.
+    // (With rings we're already on this version, and a partial write fails its CRC.)
+    if (!wearLevelReady)
+      eeprom_update_byte((byte*)versionAddress, 0);
     PermanentVariables vars;
     memcpy_P(&vars, &defaultVars, sizeof(vars));
     vars.stationID = stationID;
@@ -167,5 +435,16 @@ void PermanentStorage::initialise()
     setCRC();
   }
 
+  if (!wearLevelReady)
+    createWearLevelRings();
+  eeprom_update_byte((byte*)versionAddress, permanentVersion);
+
+  GET_PERMANENT2(&_crc, crc);
+  byte* cur = cache;
+  for (const CachedRange& range : cachedRanges)
+  {
+    eeprom_read_block(cur, (void*)(size_t)range.start, range.end - range.start);
+    cur += range.end - range.start;
+  }
   _initialised = true;
 }
\ No newline at end of file
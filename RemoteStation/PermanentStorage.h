@@ -39,6 +39,14 @@ inline constexpr int messageTypeArraySize = 7;
 
 //Implements EEPROM storage of permanent setup variables.
 //In its own class so we can change processors more easily
+//The variables we read every loop or every message are mirrored in RAM (see cachedRanges)
+//
+//EEPROM layout:
+//  0 - 255: PermanentVariables
+//  256 - 1022: Rings of slots for the variables we write often (see wearLevelledFields)
+//  1023: Layout version (permanentVersion). 0xFF is from before we had versions.
+//When you change PermanentVariables, bump permanentVersion and add a migration to PermanentStorage::migrate.
+//New fields go before crc, and appendDefaults will fill them in.
 typedef struct PermanentVariables
 {
   bool initialised; //1
@@ -77,6 +85,16 @@ typedef struct PermanentVariables
   bool stasisRequested;
   byte codingRate;
   short relayListenPeriod;
+  // Event driven reporting: while the wind stays within these thresholds of the last report,
+  // only send every heartbeatIntervals weather intervals. <= 1 sends every interval.
+  byte heartbeatIntervals;
+  byte reportSpeedThreshold_x2;
+  byte reportGustThreshold_x2;
+  byte reportDirectionThreshold; // 1/255ths of a turn
+  bool deltaWeather; // Send wind as deltas against the last full record where we can
+  bool recordWindSeries; // One second wind to flash, for builds with WIND_SERIES
+  bool solarMppt; // Look for the panel's maximum power point rather than just ramping to the charge voltage (SOLAR_MPPT builds only)
+  bool autoRoute; // Pick who to relay for from what we hear (Routing.h). stationsToRelayWeather/Commands still apply.
   short crc;
 } PermanentVariables;
 
@@ -92,6 +110,21 @@ public:
     return crc == 0;
   }
   static void setCRC();
+
+  // Groups several sets so the CRC is only written once, when the outermost transaction ends:
+  //   PermanentStorage::Transaction transaction;
+  //   SET_PERMANENT_S(shortInterval);
+  //   SET_PERMANENT_S(longInterval);
+  class Transaction
+  {
+  public:
+    Transaction() { _transactionDepth++; }
+    ~Transaction()
+    {
+      if (--_transactionDepth == 0 && _crcDirty)
+        writeCRC();
+    }
+  };
 #ifdef DEBUG
   static inline void dump()
   {
@@ -105,19 +138,18 @@ public:
     }
   }
 #endif
-  static inline void getBytes(const void* address, size_t size, void* buffer)
-  {
-    eeprom_read_block(buffer, address, size);
-  }
-  static inline void setBytes(void* address, size_t size, const void* buffer)
-  {
-    eeprom_write_block(buffer, address, size);
-    if (_initialised)
-    {
-      setCRC();
-    }
-  }
+  static void getBytes(const void* address, size_t size, void* buffer);
+  // Only writes the bytes that have changed, and updates the CRC from the change rather than rereading everything.
+  static void setBytes(void* address, size_t size, const void* buffer);
 
 private:
+  static void writeCRC();
+  static bool migrate(byte version);
+  static void appendDefaults(size_t oldSize);
+
   static bool _initialised;
+  // Kept up to date by setBytes, written out by writeCRC
+  static unsigned short _crc;
+  static bool _crcDirty;
+  static byte _transactionDepth;
 };
\ No newline at end of file
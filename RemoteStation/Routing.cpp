@@ -0,0 +1,247 @@
+#include "Routing.h"
+#include "ArduinoWeatherStation.h"
+#include "LoraMessaging.h"
+#include "MessageHandling.h"
+#include "PermanentStorage.h"
+#include "Trace.h"
+
+#ifdef DEBUG_ROUTING
+#define ROUTING_PRINTLN AWS_DEBUG_PRINTLN
+#define ROUTING_PRINTVAR PRINT_VARIABLE
+#else
+#define ROUTING_PRINTLN(...) do { } while (0)
+#define ROUTING_PRINTVAR(...) do { } while (0)
+#endif
+
+using namespace MessageHandling;
+
+namespace Routing
+{
+  // A hop costs hopCost, plus one for every dB we hear it under goodSnr.
+  // So a link at -3dB costs as much as two good hops.
+  constexpr byte hopCost = 8;
+  constexpr int8_t goodSnr_x4 = 5 * 4;
+  constexpr byte maxLinkCost = 64;
+  // Another next hop has to be this much cheaper before we move to it, so we don't flap between two that are about the same.
+  constexpr byte hysteresis = 4;
+  // Routes that haven't been heard for this long are gone. Pings come more often than this.
+  constexpr unsigned long routeTimeout = maxMillisBetweenPings;
+  // downstreamSeen is in 65.5 second units
+  constexpr byte downstreamTimeout = routeTimeout >> 16;
+
+  // What each of recentlySeenStations told us
+  byte neighbourCost[permanentArraySize];
+  byte neighbourNextHop[permanentArraySize];
+  byte downstream[permanentArraySize];
+  byte downstreamSeen[permanentArraySize];
+  byte baseLinkCost = noRoute;
+  unsigned long basePingMillis;
+  byte routeCost = noRoute;
+  byte routeNextHop = 0;
+
+  static bool autoRouteEnabled()
+  {
+    bool autoRoute;
+    GET_PERMANENT_S(autoRoute);
+    return autoRoute;
+  }
+
+  static byte linkCost(int8_t snr_x4)
+  {
+    if (snr_x4 >= goodSnr_x4)
+      return hopCost;
+    short cost = hopCost + (goodSnr_x4 - snr_x4) / 4;
+    return cost > maxLinkCost ? maxLinkCost : cost;
+  }
+
+  static bool neighbourCurrent(byte index)
+  {
+    const RecentlySeenStation& station = recentlySeenStations[index];
+    return station.id != 0
+      && millis() - station.millis < routeTimeout + 8000UL * stationHeartbeats_4s[index];
+  }
+
+  // Cost to the base through the neighbour, noRoute if they can't take us.
+  static byte costThrough(byte index)
+  {
+    if (!neighbourCurrent(index) || neighbourCost[index] == noRoute
+      || neighbourNextHop[index] == stationID)
+      return noRoute;
+    short cost = neighbourCost[index] + linkCost(recentlySeenStations[index].snr_x4);
+    return cost >= noRoute ? noRoute : cost;
+  }
+
+  static void updateRoute()
+  {
+    byte bestCost = noRoute;
+    byte bestHop = 0;
+    // What the hop we've got costs now:
+    byte currentCost = noRoute;
+    if (baseLinkCost != noRoute && millis() - basePingMillis < routeTimeout)
+    {
+      bestCost = baseLinkCost;
+      if (routeNextHop == 0)
+        currentCost = baseLinkCost;
+    }
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      byte cost = costThrough(i);
+      if (cost == noRoute)
+        continue;
+      if (cost < bestCost)
+      {
+        bestCost = cost;
+        bestHop = recentlySeenStations[i].id;
+      }
+      if (recentlySeenStations[i].id == routeNextHop)
+        currentCost = cost;
+    }
+    if (currentCost != noRoute && currentCost <= bestCost + hysteresis)
+    {
+      routeCost = currentCost;
+      return;
+    }
+    if (bestHop != routeNextHop || (bestCost == noRoute) != (routeCost == noRoute))
+    {
+      ROUTING_PRINTVAR(bestHop);
+      ROUTING_PRINTVAR(bestCost);
+      TRACE_EVENT(RouteChange, bestHop, bestCost);
+    }
+    routeCost = bestCost;
+    routeNextHop = bestHop;
+  }
+
+  void heardNeighbour(byte index, bool newStation)
+  {
+    if (newStation)
+    {
+      neighbourCost[index] = noRoute;
+      neighbourNextHop[index] = 0;
+    }
+  }
+
+  void heardAdvert(byte index, byte cost, byte nextHop)
+  {
+    neighbourCost[index] = cost;
+    neighbourNextHop[index] = nextHop;
+    updateRoute();
+  }
+
+  void heardBase(int8_t snr_x4)
+  {
+    baseLinkCost = linkCost(snr_x4);
+    basePingMillis = millis();
+    updateRoute();
+  }
+
+  void heardDownstream(byte stationID)
+  {
+    byte now = millis() >> 16;
+    byte* slot = 0;
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if (downstream[i] == stationID)
+      {
+        slot = downstream + i;
+        break;
+      }
+      if (!slot && (downstream[i] == 0 || (byte)(now - downstreamSeen[i]) > downstreamTimeout))
+        slot = downstream + i;
+    }
+    if (!slot)
+      return;
+    *slot = stationID;
+    downstreamSeen[slot - downstream] = now;
+  }
+
+  // They've picked us to get to the base
+  static bool isChild(byte stationID)
+  {
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if (recentlySeenStations[i].id == stationID)
+        return neighbourNextHop[i] == ::stationID && neighbourCurrent(i);
+    }
+    return false;
+  }
+
+  static void expireDownstream()
+  {
+    byte now = millis() >> 16;
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if ((byte)(now - downstreamSeen[i]) > downstreamTimeout)
+        downstream[i] = 0;
+    }
+  }
+
+  // A child, or a station our children relay for. 0 for any of them.
+  static bool isDownstream(byte stationID)
+  {
+    expireDownstream();
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if (downstream[i] && (stationID == 0 || downstream[i] == stationID))
+        return true;
+    }
+    if (stationID)
+      return isChild(stationID);
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if (neighbourNextHop[i] == ::stationID && neighbourCurrent(i))
+        return true;
+    }
+    return false;
+  }
+
+  bool shouldRelay(byte msgType, byte msgStatID)
+  {
+    if (!autoRouteEnabled() || routeCost == noRoute)
+      return false;
+    if (msgType == 'W')
+      return isChild(msgStatID);
+    return isDownstream(msgStatID);
+  }
+
+  void appendAdvert(LoraMessageDestination& msg)
+  {
+    bool enabled = autoRouteEnabled();
+    if (enabled)
+      updateRoute();
+    // If we're not routing, nobody should pick us.
+    msg.appendByte2(enabled ? routeCost : noRoute);
+    msg.appendByte2(routeNextHop);
+  }
+
+  void appendRouteQuery(LoraMessageDestination& msg)
+  {
+    updateRoute();
+    msg.appendByte2(autoRouteEnabled());
+    msg.appendByte2(routeCost);
+    msg.appendByte2(routeNextHop);
+    msg.appendByte2(millis() - basePingMillis < routeTimeout ? baseLinkCost : noRoute);
+    byte count = 0;
+    for (byte i = 0; i < permanentArraySize; i++)
+      count += recentlySeenStations[i].id != 0;
+    msg.appendByte2(count);
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if (!recentlySeenStations[i].id)
+        continue;
+      msg.appendByte2(recentlySeenStations[i].id);
+      msg.appendByte2(linkCost(recentlySeenStations[i].snr_x4));
+      msg.appendByte2(neighbourCost[i]);
+      msg.appendByte2(neighbourNextHop[i]);
+    }
+    expireDownstream();
+    count = 0;
+    for (byte i = 0; i < permanentArraySize; i++)
+      count += downstream[i] != 0;
+    msg.appendByte2(count);
+    for (byte i = 0; i < permanentArraySize; i++)
+    {
+      if (downstream[i])
+        msg.appendByte2(downstream[i]);
+    }
+  }
+}
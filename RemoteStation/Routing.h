@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+class LoraMessageDestination;
+
+// Works out which stations we should relay for, so relays don't have to be set by hand (R command, autoRoute).
+// Distance vector with one destination, the base:
+//  - Hearing a ping straight from the base (its hop count is there and still 0) gives us a link to it.
+//  - Complex weather carries the sender's (RouteCost)(NextHop) (see createWeatherData), so we learn
+//    what our neighbours cost to get to the base, and who they go through.
+//  - Our cost is the cheapest of those plus the link to that neighbour, which costs more the weaker we hear it.
+//    We only move to a new next hop if it's clearly better, and never through a neighbour that goes through us.
+//  - We relay weather from the stations that picked us as their next hop, and commands to (and replies from)
+//    them and the stations whose weather they've passed to us.
+// The stationsToRelay lists still work as before, on top of this.
+namespace Routing
+{
+  constexpr byte noRoute = 0xFF;
+  // 0 as a next hop is the base
+
+  // From recordHeardStation, for the neighbour in recentlySeenStations[index].
+  // newStation: that slot has just been given to a different station.
+  void heardNeighbour(byte index, bool newStation);
+  // Their advertisement from the weather they sent
+  void heardAdvert(byte index, byte cost, byte nextHop);
+  // A ping that hasn't been relayed
+  void heardBase(int8_t snr_x4);
+  // A station whose weather came to us inside a message we're relaying
+  void heardDownstream(byte stationID);
+
+  bool shouldRelay(byte msgType, byte msgStatID);
+
+  // (RouteCost:1)(NextHop:1) for our weather
+  void appendAdvert(LoraMessageDestination& msg);
+  // QR: (AutoRoute:1)(Cost:1)(NextHop:1)(BaseLinkCost:1)
+  //     (NeighbourCount:1)((ID:1)(LinkCost:1)(Cost:1)(NextHop:1))...(DownstreamCount:1)(ID:1)...
+  void appendRouteQuery(LoraMessageDestination& msg);
+}
@@ -0,0 +1,43 @@
+#include "Scheduler.h"
+
+namespace Scheduler
+{
+  volatile byte pendingEvents = 0;
+  byte armedDeadlines = 0;
+  uint32_t deadlines[DeadlineCount];
+  static_assert(DeadlineCount <= 8, "armedDeadlines is a byte");
+
+  void startLoop()
+  {
+    noInterrupts();
+    pendingEvents = 0;
+    interrupts();
+    armedDeadlines = 0;
+  }
+
+  void setDeadline(Deadline deadline, uint32_t atMillis)
+  {
+    byte mask = 1 << deadline;
+    // Keep the earlier of the two if it's armed twice in one loop
+    if (armedDeadlines & mask && (int32_t)(atMillis - deadlines[deadline]) >= 0)
+      return;
+    deadlines[deadline] = atMillis;
+    armedDeadlines |= mask;
+  }
+
+  bool wakeRequired(uint32_t now)
+  {
+#ifdef DEBUG
+    // Serial input doesn't post anything.
+    return true;
+#endif
+    if (pendingEvents)
+      return true;
+    for (byte i = 0; i < DeadlineCount; i++)
+    {
+      if (armedDeadlines & (1 << i) && (int32_t)(now - deadlines[i]) >= 0)
+        return true;
+    }
+    return false;
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+
+// Decides whether an interrupt is worth a trip round the main loop.
+// Timer2 ticks and wind ticks wake us far more often than there's anything to do, so sleep() goes straight back to sleep
+// unless an ISR has posted an event or one of the loop's deadlines has passed.
+// The loop still checks its own flags when it does run - this only saves the wake-ups where none of them would be set.
+// Deadlines are cleared at the start of each loop, so anything that wants to run again has to re-arm itself.
+namespace Scheduler
+{
+  enum Event : byte
+  {
+    RadioEvent = 0x01,   // Packet received (DIO1)
+    WeatherEvent = 0x02, // Weather message, vane sample or wind series batch due (timer2 tick)
+    AdcEvent = 0x04,     // Queued conversions finished
+    WireEvent = 0x08,    // Async TWI read finished
+  };
+
+  enum Deadline : byte
+  {
+    Watchdog,
+    Ping,
+    Status,
+    Solar,
+    Relay,
+    Database,
+    DeadlineCount
+  };
+
+  extern volatile byte pendingEvents;
+
+  // ISR context only (the ISRs don't nest, so the read-modify-write is safe there)
+  inline void post(byte events)
+  {
+    pendingEvents |= events;
+  }
+
+  // Start of the main loop: forget the events and deadlines we're about to deal with
+  void startLoop();
+  // Due after the first interrupt at or after atMillis. Arming it at millis() means 'on the next tick'.
+  // In millis() time, so it wraps every 49 days. (uint32_t is the AVR's unsigned long, and keeps it so on the PC.)
+  void setDeadline(Deadline deadline, uint32_t atMillis);
+  bool wakeRequired(uint32_t now);
+}
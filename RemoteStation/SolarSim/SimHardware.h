@@ -0,0 +1,85 @@
+#pragma once
+// Just enough of the station for PWMSolar.cpp to build on the PC, in place of its usual includes (see SOLAR_SIM there).
+// The registers are plain variables, the clock is SolarSim's virtual time, and the ADC reads the plant model.
+// Careful: int is 32 bits here, so this won't show up anything that only overflows on the AVR.
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A6 20
+#define A7 21
+
+#define _BV(bit) (1 << (bit))
+#define ISR(vector, ...) void vector()
+#define reti() do { } while (0)
+
+// Timer0 and port D, as the PWM code uses them
+#define COM0B1 5
+#define COM0B0 4
+#define WGM01 1
+#define WGM00 0
+#define CS01 1
+#define CS00 0
+#define OCIE0B 2
+#define TOIE0 0
+#define OCF0B 2
+#define TOV0 0
+#define PORTD5 5
+#define DDD5 5
+extern byte TCCR0A, TCCR0B, TIMSK0, TIFR0, OCR0B, PORTD, DDRD;
+
+unsigned long millis();
+unsigned long micros();
+void delayMicroseconds(unsigned int us);
+void pinMode(byte pin, byte mode);
+void digitalWrite(byte pin, byte value);
+
+#define AWS_DEBUG_PRINT(...) do { } while (0)
+#define AWS_DEBUG_PRINTLN(...) do { } while (0)
+#define PRINT_VARIABLE(a) do { } while (0)
+
+// The permanent variables come from the command line
+struct SimSettings
+{
+  unsigned short chargeResponseRate;
+  unsigned short safeFreezingChargeLevel_mV;
+  byte safeFreezingPwm;
+  unsigned short chargeVoltage_mV;
+  bool solarMppt;
+};
+extern SimSettings simSettings;
+#define GET_PERMANENT_S(member) do { member = simSettings.member; } while (0)
+
+enum SleepModes { disabled = 0, idle = 1, powerSave = 2 };
+extern SleepModes solarSleepEnabled;
+
+namespace AdcSampler
+{
+  unsigned short read(byte pin, byte extraBits);
+}
+
+namespace WeatherProcessing
+{
+  extern short internalTemperature_x2;
+  extern short externalTemperature_x2;
+}
+
+namespace TimerTwo
+{
+  unsigned long seconds();
+}
+
+namespace Scheduler
+{
+  enum Deadline : byte { Solar };
+  inline void setDeadline(Deadline, unsigned long) { }
+}
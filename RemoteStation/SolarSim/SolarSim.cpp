@@ -0,0 +1,599 @@
+// Runs the real PwmSolar controller (PWMSolar.cpp) against a model of the station's power system,
+// so we can see what a change to the charge settings or the control loop does before it goes up a mountain.
+//
+// The plant:
+//  - A 10 cell panel (single diode model) switched straight onto the battery by the PWM.
+//  - Irradiance from a daily profile, optionally with clouds.
+//  - A single lithium cell: open circuit voltage from state of charge, internal resistance rising in the cold,
+//    and a battery temperature that lags the air.
+//  - The 110k/10nF filter on the battery sense line, and the current sensor (only reads while it's powered).
+//  - The station's load: a sleep current plus the radio transmitting every few seconds.
+// Averaged over the PWM period - we don't model the 3.9kHz ripple, only what the ADC sees through the filter.
+//
+// Build with 'make solarsim' (host g++, the current BOARD's defines), then e.g.
+//   solarsim --profile cloudy --days 2 --mppt 1 --csv trace.csv
+// Run solarsim --help for the rest of the options.
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "SimHardware.h"
+#include "../PWMSolar.h"
+
+SimSettings simSettings = {
+  .chargeResponseRate = 40,
+  .safeFreezingChargeLevel_mV = 3750,
+  .safeFreezingPwm = 85,
+  .chargeVoltage_mV = 4050,
+  .solarMppt = false
+};
+
+// --- The station side of SimHardware.h ---
+
+byte TCCR0A, TCCR0B, TIMSK0, TIFR0, OCR0B, PORTD, DDRD;
+SleepModes solarSleepEnabled;
+namespace WeatherProcessing
+{
+  short internalTemperature_x2;
+  short externalTemperature_x2;
+}
+
+static unsigned long long simMicros = 0;
+static byte pinStates[32];
+
+unsigned long millis() { return simMicros / 1000; }
+unsigned long micros() { return simMicros; }
+void delayMicroseconds(unsigned int us) { simMicros += us; }
+void pinMode(byte, byte) { }
+void digitalWrite(byte pin, byte value) { pinStates[pin] = value; }
+
+// Start the sim at local midnight, PST (the non current sense boards work out the hour from UTC)
+static constexpr unsigned long startSeconds = 1700006400UL + 8 * 3600;
+unsigned long TimerTwo::seconds() { return startSeconds + simMicros / 1000000; }
+
+// --- Options ---
+
+struct Options
+{
+  const char* profile = "clear";
+  double days = 1;
+  double soc = 0.5;
+  double capacity_mAh = 3000;
+  double ambient_C = -1000; // Profile's default
+  double swing_C = -1000;
+  double panelIsc_mA = 100;
+  double panelVoc_mV = 6000;
+  double sleep_mA = 0.15;
+  double tx_mA = 45;
+  double tx_ms = 80;
+  double txInterval_s = 4;
+  double loop_ms = 250;
+  double noise_lsb = 1;
+  unsigned seed = 1;
+  const char* csv = nullptr;
+};
+
+static void usage()
+{
+  printf(
+    "solarsim [options]\n"
+    "  --profile clear|cloudy|winter   Irradiance and temperature (clear)\n"
+    "  --days N                        (1)\n"
+    "  --soc 0-1                       Starting state of charge (0.5)\n"
+    "  --capacity mAh                  (3000)\n"
+    "  --ambient C / --swing C         Mean and +/- of the air temperature (from the profile)\n"
+    "  --isc mA / --voc mV             Panel at 1000W/m2, 25C (100, 6000)\n"
+    "  --sleep mA                      Station load between transmissions (0.15)\n"
+    "  --tx mA / --txms ms / --txevery s  Radio load (45, 80, 4)\n"
+    "  --loop ms                       How often the main loop runs the PWM. 250 = once per timer2 tick (250)\n"
+    "  --noise LSB                     ADC noise (1)\n"
+    "  --seed N                        For the clouds and noise (1)\n"
+    "  --csv file                      Trace every second\n"
+    " Permanent variables:\n"
+    "  --chargeV mV --rate N --freezingV mV --freezingPwm N --mppt 0|1\n");
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+      return false;
+    if (i + 1 >= argc)
+    {
+      fprintf(stderr, "%s needs a value\n", arg);
+      return false;
+    }
+    const char* val = argv[++i];
+    double d = atof(val);
+    if (!strcmp(arg, "--profile")) opt.profile = val;
+    else if (!strcmp(arg, "--days")) opt.days = d;
+    else if (!strcmp(arg, "--soc")) opt.soc = d;
+    else if (!strcmp(arg, "--capacity")) opt.capacity_mAh = d;
+    else if (!strcmp(arg, "--ambient")) opt.ambient_C = d;
+    else if (!strcmp(arg, "--swing")) opt.swing_C = d;
+    else if (!strcmp(arg, "--isc")) opt.panelIsc_mA = d;
+    else if (!strcmp(arg, "--voc")) opt.panelVoc_mV = d;
+    else if (!strcmp(arg, "--sleep")) opt.sleep_mA = d;
+    else if (!strcmp(arg, "--tx")) opt.tx_mA = d;
+    else if (!strcmp(arg, "--txms")) opt.tx_ms = d;
+    else if (!strcmp(arg, "--txevery")) opt.txInterval_s = d;
+    else if (!strcmp(arg, "--loop")) opt.loop_ms = d;
+    else if (!strcmp(arg, "--noise")) opt.noise_lsb = d;
+    else if (!strcmp(arg, "--seed")) opt.seed = atoi(val);
+    else if (!strcmp(arg, "--csv")) opt.csv = val;
+    else if (!strcmp(arg, "--chargeV")) simSettings.chargeVoltage_mV = atoi(val);
+    else if (!strcmp(arg, "--rate")) simSettings.chargeResponseRate = atoi(val);
+    else if (!strcmp(arg, "--freezingV")) simSettings.safeFreezingChargeLevel_mV = atoi(val);
+    else if (!strcmp(arg, "--freezingPwm")) simSettings.safeFreezingPwm = atoi(val);
+    else if (!strcmp(arg, "--mppt")) simSettings.solarMppt = atoi(val) != 0;
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", arg);
+      return false;
+    }
+  }
+  if (opt.loop_ms < 4)
+  {
+    fprintf(stderr, "The PWM loop won't run faster than every 4ms\n");
+    return false;
+  }
+  return true;
+}
+
+// Deterministic, so runs can be compared
+static unsigned rngState;
+static double random01()
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return (rngState & 0xFFFFFF) / (double)0x1000000;
+}
+
+// --- Weather ---
+
+struct Profile
+{
+  double sunrise_h;
+  double daylight_h;
+  double peak_Wm2;
+  double ambient_C;
+  double swing_C;
+  bool clouds;
+};
+
+static bool getProfile(const char* name, Profile& profile)
+{
+  if (!strcmp(name, "clear"))
+    profile = { 6, 12, 1000, 15, 8, false };
+  else if (!strcmp(name, "cloudy"))
+    profile = { 6, 12, 1000, 10, 5, true };
+  else if (!strcmp(name, "winter"))
+    profile = { 7.5, 9.5, 600, -5, 6, false };
+  else
+    return false;
+  return true;
+}
+
+struct Weather
+{
+  Profile profile;
+  // Clouds: the sky's transmittance ramps between random levels every few minutes
+  double cloudFrom = 1, cloudTo = 1;
+  double cloudStart_s = 0, cloudEnd_s = 0;
+  static constexpr double cloudRamp_s = 20;
+
+  double irradiance(double t_s)
+  {
+    double hour = fmod(t_s / 3600, 24);
+    double sinceRise = hour - profile.sunrise_h;
+    if (sinceRise <= 0 || sinceRise >= profile.daylight_h)
+      return 0;
+    double clear = profile.peak_Wm2 * pow(sin(M_PI * sinceRise / profile.daylight_h), 1.2);
+    if (!profile.clouds)
+      return clear;
+    if (t_s >= cloudEnd_s)
+    {
+      cloudFrom = cloudTo;
+      cloudTo = random01() < 0.4 ? 1 : 0.15 + 0.6 * random01();
+      cloudStart_s = t_s;
+      cloudEnd_s = t_s + 60 + 540 * random01();
+    }
+    double ramp = (t_s - cloudStart_s) / cloudRamp_s;
+    double transmittance = ramp >= 1 ? cloudTo : cloudFrom + (cloudTo - cloudFrom) * ramp;
+    return clear * transmittance;
+  }
+
+  // Warmest mid afternoon
+  double ambient(double t_s)
+  {
+    double hour = fmod(t_s / 3600, 24);
+    return profile.ambient_C + profile.swing_C * sin(2 * M_PI * (hour - 9) / 24);
+  }
+};
+
+// --- Panel ---
+
+struct Panel
+{
+  static constexpr byte cells = 10;
+  static constexpr double ideality = 1.3;
+  static constexpr double vocTempco = -0.0033; // per C
+  static constexpr double diodeDrop_mV = 300;  // Reverse blocking, in series with the switch
+  double isc_mA, voc_mV;
+  // For the current sun and temperature
+  double photo_mA = 0, thermal_mV = 1, saturation_mA = 0;
+
+  void setConditions(double irradiance, double temp_C)
+  {
+    thermal_mV = cells * ideality * 0.08617 * (temp_C + 273.15);
+    double voc = voc_mV * (1 + vocTempco * (temp_C - 25));
+    saturation_mA = isc_mA / (exp(voc / thermal_mV) - 1);
+    photo_mA = isc_mA * irradiance / 1000;
+  }
+
+  // Single diode model, ignoring the series and shunt resistance
+  double current_mA(double v_mV)
+  {
+    if (photo_mA <= 0)
+      return 0;
+    double i = photo_mA - saturation_mA * (exp(v_mV / thermal_mV) - 1);
+    return i > 0 ? i : 0;
+  }
+
+  // What a perfect MPPT would get
+  double maxPower_mW()
+  {
+    if (photo_mA <= 0)
+      return 0;
+    // Coarse, then fine around the best
+    double best = 0, bestV = 0;
+    for (double v = 0; v < voc_mV * 1.2; v += 100)
+    {
+      double p = v * current_mA(v) / 1000;
+      if (p > best)
+      {
+        best = p;
+        bestV = v;
+      }
+    }
+    for (double v = bestV - 100; v < bestV + 100; v += 5)
+    {
+      double p = v * current_mA(v) / 1000;
+      if (p > best)
+        best = p;
+    }
+    return best;
+  }
+};
+
+// --- Battery ---
+
+struct Battery
+{
+  double capacity_mAh;
+  double soc;
+  double temp_C;
+  static constexpr double thermalTau_s = 3600;
+
+  double openCircuit_mV()
+  {
+    static constexpr double socs[] = { 0, 0.05, 0.1, 0.2, 0.4, 0.6, 0.8, 0.9, 1 };
+    static constexpr double volts[] = { 3000, 3350, 3450, 3580, 3700, 3800, 3950, 4050, 4200 };
+    constexpr int count = sizeof(socs) / sizeof(socs[0]);
+    if (soc <= socs[0])
+      return volts[0];
+    for (int i = 1; i < count; i++)
+    {
+      if (soc <= socs[i])
+        return volts[i - 1] + (volts[i] - volts[i - 1]) * (soc - socs[i - 1]) / (socs[i] - socs[i - 1]);
+    }
+    // Overcharged: keeps climbing
+    return volts[count - 1] + 2000 * (soc - 1);
+  }
+
+  // Rises in the cold. Updated with the temperature, once a second.
+  double resistance_mOhm = 150;
+
+  void updateResistance()
+  {
+    resistance_mOhm = 150 * exp(0.03 * (25 - temp_C));
+  }
+
+  double terminal_mV(double current_mA)
+  {
+    return openCircuit_mV() + current_mA * resistance_mOhm / 1000;
+  }
+};
+
+// --- Plant state, as seen by the ADC ---
+
+static Options opt;
+static double senseFiltered_mV;
+static double chargeCurrent_mA;
+
+static double dutyCycle()
+{
+#ifdef SOLAR_IMPEDANCE_SWITCHING
+  if (TIMSK0)
+    return OCR0B / 256.0;
+  return DDRD & _BV(DDD5) ? 0 : 1;
+#else
+  if (TCCR0A)
+    return (OCR0B + 1) / 256.0;
+#ifdef SOLAR_INVERSE
+  return pinStates[5] == HIGH ? 1 : 0;
+#else
+  return pinStates[5] == LOW ? 1 : 0;
+#endif
+#endif
+}
+
+static unsigned short adcReading(double mV, byte extraBits)
+{
+  double reading = mV * 1023 / REF_MV + opt.noise_lsb * (2 * random01() - 1);
+  if (reading < 0)
+    reading = 0;
+  if (reading > 1023)
+    reading = 1023;
+  return (unsigned short)(reading * (1 << extraBits) + 0.5);
+}
+
+unsigned short AdcSampler::read(byte pin, byte extraBits)
+{
+  if (pin == BATT_PIN)
+    return adcReading(senseFiltered_mV * BATTV_DEN / BATTV_NUM, extraBits);
+#ifdef CURRENT_SENSE
+  if (pin == CURRENT_SENSE)
+  {
+#ifdef CURRENT_SENSE_PWR
+    if (pinStates[CURRENT_SENSE_PWR] != HIGH)
+      return 0;
+#endif
+    return adcReading(chargeCurrent_mA * CURRENT_SENSE_GAIN, extraBits);
+  }
+#endif
+  return 0;
+}
+
+// --- Results ---
+
+struct Stats
+{
+  double available_mWh = 0;
+  double harvested_mWh = 0;
+  double load_mWh = 0;
+  double overshoot_mV = 0;
+  double above_s = 0;
+  double full_s = 0, off_s = 0, pwm_s = 0;
+  double coldLimited_s = 0;
+  double sensorOn_s = 0;
+  double minSoc = 1, maxSoc = 0;
+  // Settling: from the battery first getting within settleBand_mV of the charge voltage, until it stays there for settleHold_s
+  int settles = 0;
+  double settleTotal_s = 0, settleMax_s = 0;
+  int unsettled = 0;
+};
+
+static constexpr double settleBand_mV = 25;
+static constexpr double settleHold_s = 60;
+// Below this it has to reach the charge voltage again before we time another settle
+static constexpr double settleRearm_mV = 100;
+
+static void printStats(const char* label, const Stats& s)
+{
+  printf("%s\n", label);
+  printf("  Harvested %.1f mWh of %.1f available (%.0f%%), load %.1f mWh\n",
+    s.harvested_mWh, s.available_mWh, s.available_mWh > 0 ? 100 * s.harvested_mWh / s.available_mWh : 0, s.load_mWh);
+  printf("  SoC %.1f%% - %.1f%%\n", 100 * s.minSoc, 100 * s.maxSoc);
+  printf("  Overshoot %.0f mV, %.0f s more than %.0f mV over\n", s.overshoot_mV, s.above_s, settleBand_mV);
+  if (s.settles)
+    printf("  Settling %d times: mean %.1f s, max %.1f s", s.settles, s.settleTotal_s / s.settles, s.settleMax_s);
+  else
+    printf("  Never settled at the charge voltage");
+  printf(s.unsettled ? " (%d never settled)\n" : "\n", s.unsettled);
+  printf("  Clamped full %.0f s, off %.0f s, PWM %.0f s", s.full_s, s.off_s, s.pwm_s);
+#ifdef CURRENT_SENSE
+  printf(", cold current limit %.0f s", s.coldLimited_s);
+#endif
+#ifdef CURRENT_SENSE_PWR
+  printf(", current sensor on %.0f s", s.sensorOn_s);
+#endif
+  printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+  if (!parseArgs(argc, argv, opt))
+  {
+    usage();
+    return 1;
+  }
+  Weather weather;
+  if (!getProfile(opt.profile, weather.profile))
+  {
+    fprintf(stderr, "Unknown profile %s\n", opt.profile);
+    return 1;
+  }
+  if (opt.ambient_C > -1000)
+    weather.profile.ambient_C = opt.ambient_C;
+  if (opt.swing_C > -1000)
+    weather.profile.swing_C = opt.swing_C;
+  rngState = opt.seed ? opt.seed : 1;
+
+  Panel panel = { opt.panelIsc_mA, opt.panelVoc_mV };
+  Battery battery = { opt.capacity_mAh, opt.soc, weather.ambient(0) };
+  FILE* csv = nullptr;
+  if (opt.csv)
+  {
+    csv = fopen(opt.csv, "w");
+    if (!csv)
+    {
+      perror(opt.csv);
+      return 1;
+    }
+    fprintf(csv, "t_s,irradiance,ambient_C,battery_C,soc,battery_mV,sense_mV,duty,charge_mA,load_mA\n");
+  }
+
+  PwmSolar::setupPwm();
+  senseFiltered_mV = battery.openCircuit_mV();
+
+  constexpr double senseTau_us = 1100; // 110k, 10nF
+  constexpr unsigned long long step_us = 1000;
+  const unsigned long long loop_us = opt.loop_ms * 1000;
+  const unsigned long long end_us = opt.days * 86400e6;
+  const double chargeV = simSettings.chargeVoltage_mV;
+
+  Stats total, day;
+  Stats* const both[] = { &total, &day };
+  int dayNumber = 0;
+  unsigned long long plantMicros = 0, nextLoopMicros = 0, nextSecondMicros = 0, nextCsvMicros = 0;
+  unsigned long long nextDayMicros = 86400000000ULL;
+  double battery_mV = battery.openCircuit_mV();
+  double irradiance = 0, ambient = 0, maxPower_mW = 0;
+  double senseAlpha = 0, senseAlphaDt_s = 0;
+  bool settling = false, armed = true;
+  double settleStart_s = 0, inBandSince_s = -1;
+
+  while (simMicros < end_us)
+  {
+    simMicros += step_us;
+    // The PWM loop may have delayed for the current sensor, so this isn't always one step
+    double dt_s = (simMicros - plantMicros) / 1e6;
+    plantMicros = simMicros;
+    double t_s = simMicros / 1e6;
+
+    // Once a second: the slow stuff
+    if (simMicros >= nextSecondMicros)
+    {
+      nextSecondMicros += 1000000;
+      irradiance = weather.irradiance(t_s);
+      ambient = weather.ambient(t_s);
+      panel.setConditions(irradiance, ambient + 25 * irradiance / 1000);
+      maxPower_mW = panel.maxPower_mW();
+      battery.updateResistance();
+      WeatherProcessing::internalTemperature_x2 = (short)lround(2 * battery.temp_C);
+      WeatherProcessing::externalTemperature_x2 = (short)lround(2 * ambient);
+    }
+
+    double load_mA = opt.sleep_mA;
+    if (fmod(t_s, opt.txInterval_s) < opt.tx_ms / 1000)
+      load_mA += opt.tx_mA;
+#ifdef CURRENT_SENSE_PWR
+    if (pinStates[CURRENT_SENSE_PWR] == HIGH)
+      load_mA += 0.07;
+#endif
+
+    double duty = dutyCycle();
+    // The panel sits at the battery voltage (plus the diode) while the switch is on
+    chargeCurrent_mA = duty * panel.current_mA(battery_mV + Panel::diodeDrop_mV);
+    double battery_mA = chargeCurrent_mA - load_mA;
+    battery_mV = battery.terminal_mV(battery_mA);
+    if (dt_s != senseAlphaDt_s)
+    {
+      senseAlphaDt_s = dt_s;
+      senseAlpha = 1 - exp(-dt_s * 1e6 / senseTau_us);
+    }
+    senseFiltered_mV += (battery_mV - senseFiltered_mV) * senseAlpha;
+
+    battery.soc += battery_mA * dt_s / 3600 / battery.capacity_mAh;
+    if (battery.soc < 0)
+      battery.soc = 0;
+    battery.temp_C += (ambient - battery.temp_C) * dt_s / battery.thermalTau_s;
+
+    // Results
+    for (Stats* s : both)
+    {
+      s->available_mWh += maxPower_mW * dt_s / 3600;
+      s->harvested_mWh += battery_mV * chargeCurrent_mA / 1000 * dt_s / 3600;
+      s->load_mWh += battery_mV * load_mA / 1000 * dt_s / 3600;
+      if (battery_mV - chargeV > s->overshoot_mV)
+        s->overshoot_mV = battery_mV - chargeV;
+      if (battery_mV > chargeV + settleBand_mV)
+        s->above_s += dt_s;
+      if (duty >= 1)
+        s->full_s += dt_s;
+      else if (duty <= 0)
+        s->off_s += dt_s;
+      else
+        s->pwm_s += dt_s;
+#ifdef CURRENT_SENSE
+      if (PwmSolar::debug_applyLimits && PwmSolar::debug_desired < 255)
+        s->coldLimited_s += dt_s;
+#endif
+#ifdef CURRENT_SENSE_PWR
+      if (pinStates[CURRENT_SENSE_PWR] == HIGH)
+        s->sensorOn_s += dt_s;
+#endif
+      if (battery.soc < s->minSoc)
+        s->minSoc = battery.soc;
+      if (battery.soc > s->maxSoc)
+        s->maxSoc = battery.soc;
+    }
+
+    if (armed && battery_mV >= chargeV - settleBand_mV)
+    {
+      armed = false;
+      settling = true;
+      settleStart_s = t_s;
+      inBandSince_s = -1;
+    }
+    if (settling)
+    {
+      if (fabs(battery_mV - chargeV) > settleBand_mV)
+        inBandSince_s = -1;
+      else if (inBandSince_s < 0)
+        inBandSince_s = t_s;
+      else if (t_s - inBandSince_s >= settleHold_s)
+      {
+        settling = false;
+        double settle_s = inBandSince_s - settleStart_s;
+        for (Stats* s : both)
+        {
+          s->settles++;
+          s->settleTotal_s += settle_s;
+          if (settle_s > s->settleMax_s)
+            s->settleMax_s = settle_s;
+        }
+      }
+    }
+    if (battery_mV < chargeV - settleRearm_mV)
+    {
+      if (settling)
+      {
+        total.unsettled++;
+        day.unsettled++;
+      }
+      settling = false;
+      armed = true;
+    }
+
+    if (csv && simMicros >= nextCsvMicros)
+    {
+      nextCsvMicros += 1000000;
+      fprintf(csv, "%.0f,%.0f,%.1f,%.1f,%.4f,%.0f,%.0f,%.3f,%.1f,%.2f\n",
+        t_s, irradiance, ambient, battery.temp_C, battery.soc, battery_mV, senseFiltered_mV, duty, chargeCurrent_mA, load_mA);
+    }
+
+    if (simMicros >= nextLoopMicros)
+    {
+      nextLoopMicros += loop_us;
+      PwmSolar::doPwmLoop();
+    }
+
+    if (simMicros >= nextDayMicros || simMicros >= end_us)
+    {
+      nextDayMicros += 86400000000ULL;
+      char label[32];
+      snprintf(label, sizeof(label), "Day %d", ++dayNumber);
+      printStats(label, day);
+      day = Stats();
+    }
+  }
+  if (dayNumber > 1)
+    printStats("Total", total);
+  if (csv)
+    fclose(csv);
+  return 0;
+}
@@ -5,6 +5,7 @@
 #include <avr/wdt.h>
 #include <string.h>
 #include "StackCanary.h"
+#include "ArduinoWeatherStation.h"
 
 extern uint8_t _end;
 extern uint8_t __stack;
@@ -13,7 +14,9 @@ void StackPaint(void) __attribute__ ((naked)) __attribute__ ((section (".init1")
 volatile uint16_t oldSP __attribute__ ((section (".noinit")));
 volatile uint8_t& oldStack = _end; // [STACK_DUMP_SIZE] __attribute__ ((section (".noinit")));
 volatile uint8_t MCUSR_Mirror __attribute__ ((section (".noinit")));
+volatile uint8_t oldBatteryMode __attribute__ ((section (".noinit")));
 volatile bool wdt_dontRestart = false;
+volatile uint16_t stackLowWater[StackSectionCount] __attribute__ ((section (".noinit")));
 
 #if defined(WATCHDOG_LOOPS) && WATCHDOG_LOOPS > 0
 unsigned volatile char watchdogLoops = 0;
@@ -90,6 +93,39 @@ uint16_t StackCount(void)
     return c;
 }
 
+uint16_t stackCheckpoint(StackSection section)
+{
+    uint16_t remaining = StackCount();
+    if (remaining < stackLowWater[section])
+        stackLowWater[section] = remaining;
+    // Out of canary: leave it that way for loop() to notice.
+    if (remaining == 0)
+        return 0;
+    // Everything under SP is free. An interrupt might scribble on it while we paint, but that's stack use too.
+    uint8_t* p = &_end + remaining;
+    uint8_t* sp = (uint8_t*)SP;
+    while (p < sp)
+        *p++ = STACK_CANARY;
+    return remaining;
+}
+
+uint16_t stackLowWaterMin()
+{
+    uint16_t ret = 0xFFFF;
+    for (uint8_t i = 0; i < StackSectionCount; i++)
+    {
+        if (stackLowWater[i] < ret)
+            ret = stackLowWater[i];
+    }
+    return ret;
+}
+
+void resetStackLowWater()
+{
+    for (uint8_t i = 0; i < StackSectionCount; i++)
+        stackLowWater[i] = 0xFFFF;
+}
+
 ISR (WDT_vect, ISR_NAKED)
 {
   //Be very careful if modifying this function:
@@ -170,6 +206,7 @@ ISR (WDT_vect, ISR_NAKED)
 
   //Dump the stack:
   oldSP = SP;
+  oldBatteryMode = (uint8_t)batteryMode;
   //auto stackSize = (uint16_t)(&__stack) - oldSP;
   //if (stackSize > STACK_DUMP_SIZE)
   //  stackSize = STACK_DUMP_SIZE;
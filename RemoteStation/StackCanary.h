@@ -13,8 +13,31 @@ extern unsigned volatile char watchdogLoops;
 uint16_t StackCount(void);
 void canarifyStackDump();
 
+// Low water marks for the big users of the stack: the least canary left after each of them ran.
+// They're in .noinit, so they survive the watchdog and go out with the crash dump.
+// Keep in sync with StackSections in the receiver's QueryStackResponse.cs
+enum StackSection : uint8_t
+{
+  StackOther,       // The rest of the loop, and interrupts while we slept
+  StackMessages,    // Reading, handling and relaying messages
+  StackDatabase,    // Database searches and reads
+  StackWeather,     // Sending weather
+  StackProgramming, // Remote programming and flash reads
+  StackSectionCount
+};
+extern volatile uint16_t stackLowWater[StackSectionCount];
+// Records how deep the stack has gone since the last checkpoint against section,
+// then repaints the canary under us so the next section is measured on its own.
+// Nested sections: the inner one gets the credit for everything before it.
+// Returns the canary left - if that's 0, the canary stays gone.
+uint16_t stackCheckpoint(StackSection section);
+uint16_t stackLowWaterMin();
+void resetStackLowWater();
+
 extern volatile uint16_t oldSP;
 extern volatile uint8_t& oldStack; //[STACK_DUMP_SIZE];
 extern volatile uint8_t MCUSR_Mirror;
+// batteryMode when the watchdog caught us
+extern volatile uint8_t oldBatteryMode;
 extern volatile bool wdt_dontRestart;
 
@@ -0,0 +1,102 @@
+#include "TimeSync.h"
+#include "TimerTwo.h"
+#include "Callsign.h"
+#include "ArduinoWeatherStation.h"
+#include "Trace.h"
+
+namespace TimeSync
+{
+  // A step bigger than this isn't drift: it's the first ping, or someone has changed the base's clock.
+  constexpr long maxDriftStep = 5000;
+  // Long enough that a few hundred ms of CSMA and relay jitter is only tens of ppm
+  constexpr uint32_t driftInterval = 4UL * 3600 * MILLIS_PER_SECOND;
+  constexpr long maxDrift = 32767; // About 2000 ppm
+
+  bool synced = false;
+  // On the base's clock. These are 32 bits, like millis(), and wrap with it.
+  uint32_t driftStartMillis;
+  // How far the pings have moved our clock since driftStartMillis
+  int32_t driftSteps;
+  // So if we relay the ping that moved our clock, we can take the step back out of its hold time
+  unsigned short lastStepRxTimestamp;
+  int32_t lastStep = 0;
+
+  short drift()
+  {
+    return TimerTwo::_driftPerTick;
+  }
+
+  static void updateDrift(uint32_t now)
+  {
+    uint32_t elapsed = now - driftStartMillis;
+    if (elapsed < driftInterval)
+      return;
+    // driftSteps / elapsed is how much slow we've run. Only take half of it out, the pings are noisy.
+    int32_t change = (int64_t)driftSteps * (int32_t)TimerTwo::MillisPerTick * 65536 / (int32_t)elapsed / 2;
+    int32_t newDrift = TimerTwo::_driftPerTick + change;
+    if (newDrift > maxDrift)
+      newDrift = maxDrift;
+    if (newDrift < -maxDrift)
+      newDrift = -maxDrift;
+    noInterrupts();
+    TimerTwo::_driftPerTick = newDrift;
+    interrupts();
+    driftStartMillis = now;
+    driftSteps = 0;
+  }
+
+  void handlePing(MessageSource& msg, unsigned short rxTimestamp)
+  {
+    uint32_t seconds;
+    if (msg.read(seconds) != MESSAGE_OK)
+      return;
+    unsigned short ms, delay;
+    if (msg.read(ms) != MESSAGE_OK || msg.read(delay) != MESSAGE_OK || ms >= MILLIS_PER_SECOND)
+    {
+      // An old base, only good to the second.
+      TimerTwo::setSeconds(seconds);
+      synced = false;
+      return;
+    }
+    unsigned short held = millis16() - rxTimestamp;
+    uint32_t sinceSent = (uint32_t)ms + delay + held;
+    seconds += sinceSent / MILLIS_PER_SECOND;
+    ms = sinceSent % MILLIS_PER_SECOND;
+    uint32_t baseMillis = seconds * MILLIS_PER_SECOND + ms;
+    int32_t step = baseMillis - (uint32_t)TimerTwo::millis();
+    TimerTwo::setTime(seconds, ms);
+    lastStepRxTimestamp = rxTimestamp;
+    lastStep = step;
+    TRACE_EVENT(TimeStep, step > 32767 ? 32767 : step < -32768 ? -32768 : (short)step, TimerTwo::_driftPerTick);
+
+    if (!synced || abs(step) > maxDriftStep)
+    {
+      synced = true;
+      driftStartMillis = baseMillis;
+      driftSteps = 0;
+      return;
+    }
+    driftSteps += step;
+    updateDrift(baseMillis);
+  }
+
+  void appendRelayedPing(MessageDestination& dest, MessageSource& src, unsigned short rxTimestamp)
+  {
+    // Callsign, seconds and millis go as they are
+    if (dest.appendData(src, sizeof(callSign) - 1 + sizeof(uint32_t) + sizeof(unsigned short)) != MESSAGE_OK)
+      return;
+    unsigned short delay;
+    if (src.read(delay) != MESSAGE_OK)
+      return;
+    long held = (unsigned short)(millis16() - rxTimestamp);
+    if (rxTimestamp == lastStepRxTimestamp)
+      held -= lastStep;
+    if (held < 0)
+      held = 0;
+    unsigned long total = delay + held;
+    dest.appendT((unsigned short)(total > 0xFFFF ? 0xFFFF : total));
+    byte hops = 0;
+    src.read(hops);
+    dest.appendT((byte)(hops == 0xFF ? hops : hops + 1));
+  }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+#include "MessagingCommon.h"
+
+// Keeps our clock on the base station's time, to the millisecond rather than the second.
+// Pings are P(0)(UID)(Callsign:6)(Seconds:4)[(Millis:2)(Delay_ms:2)[(Hops:1)]]:
+//   Seconds.Millis is the base's time when it sent the ping,
+//   Delay is how long relays have held it since - each relay adds the time from receiving it to sending it on.
+//   Hops counts the relays, so a station can tell it heard the base itself (Routing.h). The base sends 0.
+//   Missing, we can't tell: an older base, or a ping without Millis that a relay passed on untouched.
+// Every ping steps the clock to Seconds.Millis + Delay + however long it's waited in our buffer.
+// Over hours the steps tell us how fast our crystal runs, and TimerTwo's drift correction takes that out between pings.
+// Pings without Millis just set the seconds, as they always have.
+namespace TimeSync
+{
+  // After the callsign of a ping addressed to us. rxTimestamp is millis16() when the radio received it.
+  void handlePing(MessageSource& msg, unsigned short rxTimestamp);
+  // Copies the rest of a ping we're relaying, adding our hold time to its delay.
+  void appendRelayedPing(MessageDestination& dest, MessageSource& src, unsigned short rxTimestamp);
+  // In 1/65536 ms per timer tick. (Positive: our crystal is slow)
+  short drift();
+}
@@ -2,6 +2,10 @@
 
 volatile unsigned long TimerTwo::_ticks __attribute__ ((section (".noinit")));
 volatile unsigned char TimerTwo::_ofTicks __attribute__ ((section (".noinit")));
+volatile unsigned long TimerTwo::_bootTicks __attribute__ ((section (".noinit")));
+volatile short TimerTwo::_correctionMillis = 0;
+volatile short TimerTwo::_driftPerTick = 0;
+volatile unsigned short TimerTwo::_driftFraction = 0;
 
 void timer2InterruptAction(void) __attribute__((weak));
 void timer2InterruptAction(void) {}
@@ -76,6 +80,29 @@ ISR(TIMER2_COMPA_vect)
   TimerTwo::_ticks++;
   if (bit_is_set(SREG, SREG_C))
     TimerTwo::_ofTicks++;
+  if (TimerTwo::_driftPerTick)
+  {
+    // Carry whole milliseconds of drift into the correction, and whole ticks of correction into the tick count.
+    // Only the time moves: the wind and weather code counts interrupts, not ticks.
+    unsigned short oldFraction = TimerTwo::_driftFraction;
+    TimerTwo::_driftFraction += TimerTwo::_driftPerTick;
+    if (TimerTwo::_driftPerTick > 0 && TimerTwo::_driftFraction < oldFraction)
+      TimerTwo::_correctionMillis++;
+    else if (TimerTwo::_driftPerTick < 0 && TimerTwo::_driftFraction > oldFraction)
+      TimerTwo::_correctionMillis--;
+    if (TimerTwo::_correctionMillis >= (short)TimerTwo::MillisPerTick)
+    {
+      TimerTwo::_correctionMillis -= TimerTwo::MillisPerTick;
+      if (++TimerTwo::_ticks == 0)
+        TimerTwo::_ofTicks++;
+    }
+    else if (TimerTwo::_correctionMillis < 0)
+    {
+      TimerTwo::_correctionMillis += TimerTwo::MillisPerTick;
+      if (TimerTwo::_ticks-- == 0)
+        TimerTwo::_ofTicks--;
+    }
+  }
   timer2InterruptAction();
 }
 
@@ -137,11 +164,12 @@ unsigned long TimerTwo::seconds()
   static_assert(MILLIS_PER_SECOND / MillisPerTick == 4);
   static_assert(MILLIS_PER_SECOND % MillisPerTick == 0);
   *(((byte*)&ret) + 3) = _ofTicks << 6;
+  // _correctionMillis < MillisPerTick, so it never carries into the seconds here.
   ret |= _ticks >> 2;
 #else
   unsigned long long ticks = _ticks;
   *(((unsigned long*)&ticks) + 1) = _ofTicks;
-  ret = ticks * (short)MillisPerTick / 1000;
+  ret = (ticks * (short)MillisPerTick + _correctionMillis) / 1000;
 #endif
   SREG = sreg;
   return ret;
@@ -155,12 +183,46 @@ void TimerTwo::setSeconds(unsigned long seconds)
   static_assert(MILLIS_PER_SECOND / MillisPerTick == 4);
   static_assert(MILLIS_PER_SECOND % MillisPerTick == 0);
   _ofTicks = (seconds >> 30) & 0b11;
-  _ticks = seconds * (MILLIS_PER_SECOND / MillisPerTick);
+  unsigned long ticks = seconds * (MILLIS_PER_SECOND / MillisPerTick);
 #else
   unsigned long long ticks = (unsigned long long)seconds * 1000 / (short)MillisPerTick;
   _ofTicks = ticks >> 32;
-  _ticks = ticks;
 #endif
+  _bootTicks += (unsigned long)ticks - _ticks;
+  _ticks = ticks;
+  _correctionMillis = 0;
+  SREG = sreg;
+}
+
+void TimerTwo::setTime(unsigned long seconds, unsigned short ms)
+{
+  auto sreg = SREG;
+  cli();
+  // The part of the current tick that's already gone, which millis() will keep adding
+  unsigned short elapsed = millis() - (_ticks * MillisPerTick + _correctionMillis);
+  unsigned long long target = (unsigned long long)seconds * MILLIS_PER_SECOND + ms - elapsed;
+  unsigned long long ticks = target / MillisPerTick;
+  _ofTicks = ticks >> 32;
+  _bootTicks += (unsigned long)ticks - _ticks;
+  _ticks = ticks;
+  _correctionMillis = target % MillisPerTick;
+  SREG = sreg;
+}
+
+unsigned long TimerTwo::uptime()
+{
+  auto sreg = SREG;
+  cli();
+  unsigned long ticks = _ticks - _bootTicks;
+  SREG = sreg;
+  return (unsigned long long)ticks * MillisPerTick / MILLIS_PER_SECOND;
+}
+
+void TimerTwo::resetUptime()
+{
+  auto sreg = SREG;
+  cli();
+  _bootTicks = _ticks;
   SREG = sreg;
 }
 
@@ -175,18 +237,19 @@ unsigned long TimerTwo::millis()
   byte t = TCNT2;
   if (TIFR2 & _BV(OCF2A) && t < 249)
     m++;
+  short correction = _correctionMillis;
   SREG = sreg;
 #ifdef CRYSTAL_FREQ
   if (!TimerTwo::_crystalFailed)
-    return (m * MillisPerTick) + t * MillisPerTick / (TIMER2_TOP + 1);
+    return (m * MillisPerTick + correction) + t * MillisPerTick / (TIMER2_TOP + 1);
   else
 #if F_CPU > 1000000
-    return (m * MillisPerTick) + ((unsigned short)st * (TIMER2_TOP_ALT + 1) + t) * MillisPerTick / ((unsigned short)subsPerTick * (TIMER2_TOP_ALT + 1));
+    return (m * MillisPerTick + correction) + ((unsigned short)st * (TIMER2_TOP_ALT + 1) + t) * MillisPerTick / ((unsigned short)subsPerTick * (TIMER2_TOP_ALT + 1));
 #else
-    return (m * MillisPerTick) + t * MillisPerTick / (TIMER2_TOP_ALT + 1);
+    return (m * MillisPerTick + correction) + t * MillisPerTick / (TIMER2_TOP_ALT + 1);
 #endif
 #else
-  return (m * MillisPerTick) + t * MillisPerTick / (TIMER2_TOP + 1);
+  return (m * MillisPerTick + correction) + t * MillisPerTick / (TIMER2_TOP + 1);
 #endif
 }
 
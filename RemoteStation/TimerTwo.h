@@ -1,3 +1,4 @@
+#pragma once
 #include <Arduino.h>
 
 #define MILLIS_PER_SECOND 1000UL
@@ -36,6 +37,13 @@ public:
   static constexpr byte slowFactor = 32;
   static volatile unsigned long _ticks;
   static volatile unsigned char _ofTicks;
+  // Sub tick part of the time, kept in [0, MillisPerTick). Drift carries into it and it carries into _ticks.
+  static volatile short _correctionMillis;
+  // Added every tick, in 1/65536 ms. Set by TimeSync to cancel the crystal's drift.
+  static volatile short _driftPerTick;
+  static volatile unsigned short _driftFraction;
+  // _ticks when we started, moved along with the clock when it's set. Survives the watchdog, like _ticks.
+  static volatile unsigned long _bootTicks;
 
   static void initialise();
   // Slows the timer to run on a 1024 prescaler - this is 32x slower than usual.
@@ -47,6 +55,11 @@ public:
 
   static unsigned long seconds();
   static void setSeconds(unsigned long seconds);
+  // Sets the time to the millisecond: millis() and seconds() read seconds + ms right after this.
+  static void setTime(unsigned long seconds, unsigned short ms);
+  // Seconds since resetUptime(), which setup calls once it's done with the last run's crash.
+  static unsigned long uptime();
+  static void resetUptime();
 
   static XtalInfo testFailedOsc();
 #ifdef CRYSTAL_FREQ
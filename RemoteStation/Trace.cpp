@@ -0,0 +1,162 @@
+#include "Trace.h"
+#ifdef TRACE
+#include "LoraMessaging.h"
+#include "StackCanary.h"
+#ifdef TRACE_FLASH
+#include "Flash.h"
+#endif
+
+namespace Trace
+{
+  // Not cleared on reset, see initialise
+  Record records[TRACE_RECORDS] __attribute__ ((section (".noinit")));
+  volatile byte nextSequence __attribute__ ((section (".noinit")));
+
+#ifdef TRACE_FLASH
+  constexpr unsigned long regionLen = Flash::crashLogStart - Flash::traceStart;
+  constexpr byte blockCount = regionLen / Flash::flashBlockSize;
+  constexpr unsigned short regionRecords = regionLen / sizeof(Record);
+  // Where the next record goes, from traceStart.
+  // The block after it is always erased, which is how we find our place again after a reset.
+  unsigned long writeOffset;
+  byte spilledSequence = 0;
+
+  static bool recordErased(unsigned long offset)
+  {
+    return Flash::flash.readByte(Flash::traceStart + offset) == 0xFF;
+  }
+
+  static void eraseBlockAfter(unsigned long offset)
+  {
+    unsigned long next = (offset / Flash::flashBlockSize + 1) % blockCount * Flash::flashBlockSize;
+    Flash::flash.blockErase4K(Flash::traceStart + next);
+  }
+
+  static void findFlashPosition()
+  {
+    if (!Flash::flashOK)
+      return;
+    Flash::flash.wakeup();
+    // We were writing the block before the erased one
+    bool found = false;
+    byte block;
+    for (byte i = 0; i < blockCount && !found; i++)
+    {
+      block = (i + blockCount - 1) % blockCount;
+      found = recordErased((unsigned long)i * Flash::flashBlockSize) &&
+        !recordErased((unsigned long)block * Flash::flashBlockSize);
+    }
+    if (found)
+    {
+      writeOffset = (unsigned long)block * Flash::flashBlockSize;
+      unsigned long blockEnd = writeOffset + Flash::flashBlockSize;
+      while (writeOffset < blockEnd && !recordErased(writeOffset))
+        writeOffset += sizeof(Record);
+      // A full block: carry on in the erased one after it
+      writeOffset %= regionLen;
+    }
+    else
+    {
+      // New flash, or something else has written here. Start again.
+      writeOffset = 0;
+      Flash::flash.blockErase4K(Flash::traceStart);
+      eraseBlockAfter(0);
+    }
+    Flash::flash.sleep();
+  }
+#endif
+
+  void initialise()
+  {
+    if (!(MCUSR_Mirror & _BV(WDRF)))
+    {
+      memset(records, 0, sizeof(records));
+      nextSequence = 0;
+    }
+#ifdef TRACE_FLASH
+    // Whatever survived the watchdog is in the crash log
+    spilledSequence = nextSequence;
+    findFlashPosition();
+#endif
+  }
+
+#ifdef TRACE_FLASH
+  void spill()
+  {
+    byte pending = nextSequence - spilledSequence;
+    if (pending < TRACE_RECORDS / 2 || !Flash::flashOK)
+      return;
+    if (pending > TRACE_RECORDS)
+    {
+      // The ring has lapped us. The gap in the sequence numbers will show it.
+      spilledSequence = nextSequence - TRACE_RECORDS;
+      pending = TRACE_RECORDS;
+    }
+    Flash::flash.wakeup();
+    for (; pending > 0; pending--)
+    {
+      Record r;
+      noInterrupts();
+      r = records[spilledSequence & (TRACE_RECORDS - 1)];
+      interrupts();
+      if (writeOffset % Flash::flashBlockSize == 0)
+        eraseBlockAfter(writeOffset);
+      Flash::flash.writeBytes(Flash::traceStart + writeOffset, &r, sizeof(r));
+      writeOffset = (writeOffset + sizeof(r)) % regionLen;
+      spilledSequence++;
+    }
+    Flash::flash.sleep();
+  }
+#endif
+
+  bool handleTraceCommand(MessageSource& msg, byte uniqueID, bool* ackRequired)
+  {
+    constexpr byte recordsSize = TRACE_RECORDS * sizeof(Record);
+    static_assert(TRACE_RECORDS * sizeof(Record) <= 200, "The trace must fit in one message");
+    byte msgBuffer[recordsSize + 20];
+    LoraMessageDestination dest(false, msgBuffer, sizeof(msgBuffer), 'K', uniqueID);
+    dest.appendByte2('F');
+    dest.appendByte2('T');
+    dest.appendT((unsigned short)TimerTwo::MillisPerTick);
+    dest.appendT((unsigned short)(TIMER2_TOP + 1));
+    byte* buffer;
+    if (dest.getBuffer(&buffer, 2 + recordsSize))
+    {
+      dest.abort();
+      return false;
+    }
+#ifdef TRACE_FLASH
+    unsigned short index;
+    if (msg.read(index) == MESSAGE_OK)
+    {
+      if (!Flash::flashOK || index > regionRecords - TRACE_RECORDS)
+      {
+        dest.abort();
+        return false;
+      }
+      *buffer++ = 'F';
+      *buffer++ = nextSequence;
+      Flash::flash.wakeup();
+      Flash::flash.readBytes(Flash::traceStart + (unsigned long)index * sizeof(Record), buffer, recordsSize);
+      Flash::flash.sleep();
+      *ackRequired = false;
+      return true;
+    }
+#endif
+    *buffer++ = 'R';
+    *buffer = copyRecords(buffer + 1, TRACE_RECORDS);
+    *ackRequired = false;
+    return true;
+  }
+
+  byte copyRecords(byte* dest, byte count)
+  {
+    noInterrupts();
+    byte sequence = nextSequence;
+    for (byte i = 0; i < count; i++)
+      memcpy(dest + i * sizeof(Record), &records[(byte)(sequence - count + i) & (TRACE_RECORDS - 1)], sizeof(Record));
+    interrupts();
+    return sequence;
+  }
+}
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+#include <Arduino.h>
+#include "MessagingCommon.h"
+#include "TimerTwo.h"
+
+// Binary event trace, for field problems that go away in a DEBUG build.
+// TRACE_EVENT() writes a fixed size record into a RAM ring: a few loads and stores with interrupts off.
+// Build with TRACE=1, otherwise TRACE_EVENT() compiles to nothing and the ring doesn't exist.
+// The ring survives the watchdog, so the crash log (CrashLog.h) gets the events leading up to it.
+// With TRACE_FLASH=1 as well, the loop spills the ring to the top of the SPI flash (the database gives the space up)
+// so it covers more time.
+// Read it back with GT (see handleTraceCommand).
+//
+// Add new events to the end of the list as X(Name, "First arg", "Second arg"), so old traces still decode.
+// gentrace.sh makes the receiver's dictionary (TraceEvents.cs) from this list - run it after changing it.
+#define TRACE_EVENT_LIST(X) \
+  X(Boot, "MCUSR", "Old SP") \
+  X(Received, "Type", "Station") \
+  X(Command, "Command", "Handled") \
+  X(Relayed, "Type", "Station") \
+  X(WeatherSent, "Battery mV", "Relayed bytes") \
+  X(TimeStep, "Step ms", "Drift") \
+  X(BatteryModeChange, "Mode", "Battery mV") \
+  X(Error, "Code", "") \
+  X(NoPing, "Minutes since ping", "") \
+  X(RouteChange, "Next hop", "Cost")
+
+#ifdef TRACE
+namespace Trace
+{
+#define TRACE_ENUM(name, a, b) name,
+  enum Event : byte { TRACE_EVENT_LIST(TRACE_ENUM) EventCount };
+#undef TRACE_ENUM
+
+  struct Record
+  {
+    byte event;          // 0xFF is erased flash
+    byte sequence;       // Counts every record, so gaps show what the ring lost
+    unsigned short time; // (Low byte of the timer2 ticks)(TCNT2): wraps every 256 ticks
+    unsigned short a;
+    unsigned short b;
+  };
+  static_assert(sizeof(Record) == 8, "Records tile the flash blocks");
+
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 16
+#endif
+  static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "TRACE_RECORDS must be a power of 2");
+
+  extern Record records[TRACE_RECORDS];
+  extern volatile byte nextSequence;
+
+  inline void record(Event event, unsigned short a, unsigned short b)
+  {
+    byte sreg = SREG;
+    cli();
+    byte sequence = nextSequence++;
+    Record& r = records[sequence & (TRACE_RECORDS - 1)];
+    r.event = event;
+    r.sequence = sequence;
+    // Not quite millis: ignores a tick that's pending, but it's cheap.
+    r.time = (unsigned short)(byte)TimerTwo::_ticks << 8 | TCNT2;
+    r.a = a;
+    r.b = b;
+    SREG = sreg;
+  }
+
+  // The last count records, oldest first, into dest. Returns NextSequence: dest[i] should be number NextSequence - count + i
+  byte copyRecords(byte* dest, byte count);
+
+  // After the 'GT' of a flash command:
+  // GT            : The RAM ring.
+  // GT(Index:2)   : With TRACE_FLASH, TRACE_RECORDS records from the flash region starting at record Index.
+  // Replies FT(MillisPerTick:2)(TicksTop:2)(Source:1)(NextSequence:1)(Records:8)...
+  // Source is 'R' for the ring (oldest first) or 'F' for the flash.
+  bool handleTraceCommand(MessageSource& msg, byte uniqueID, bool* ackRequired);
+  // After the crash log has had the ring. Clears it unless the watchdog reset us.
+  // With TRACE_FLASH, after Flash::flashInit: finds where we got up to.
+  void initialise();
+#ifdef TRACE_FLASH
+  // From the loop: writes the ring out once it's half full
+  void spill();
+#endif
+}
+
+#define TRACE_EVENT(event, a, b) Trace::record(Trace::event, (a), (b))
+#else
+#define TRACE_EVENT(event, a, b) do { } while (0)
+#endif
@@ -1,11 +1,32 @@
 #ifdef ARGENTDATA_WIND
 #include <Arduino.h>
 #include "WeatherProcessing.h"
+#include "Wind.h"
 namespace WeatherProcessing
 {
+  byte argentDataDirection(int wdVoltage);
+
   //Get the wind direction for an argent data wind vane (8 distinct directions, sometimes landing between them).
   //This assumes a 4kOhm resistor in series to form a voltage divider
-  byte getCurWindDirection()
+  byte getArgentDataDirection()
+  {
+    return argentDataDirection(AdcSampler::read(WIND_DIR_PIN, 0));
+  }
+
+  void argentDataReady(unsigned short reading)
+  {
+    windPowerOff();
+    accumulateDirection(argentDataDirection(reading));
+  }
+
+  void sampleArgentDataVane()
+  {
+    windPowerOn();
+    if (!AdcSampler::request(WIND_DIR_PIN, 0, argentDataReady))
+      windPowerOff();
+  }
+
+  byte argentDataDirection(int wdVoltage)
   {
     //Ver 2: We're going to use the full range of a byte for wind. 0 = N, 255 =~ 1 degree west.
     //N  0
@@ -24,7 +45,6 @@ namespace WeatherProcessing
     //WNW 208
     //NW 224
     //NNW 240
-    int wdVoltage = analogRead(WIND_DIR_PIN);
 #ifdef INVERSE_AD_WIND
     wdVoltage = 1023 - wdVoltage;
 #endif
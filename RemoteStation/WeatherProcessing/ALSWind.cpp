@@ -1,6 +1,7 @@
 #ifdef ALS_WIND
 #include "WeatherProcessing.h"
 #include "Wind.h"
+#include "WindStats.h"
 //#include <Wire.h>
 #include "TwoWire.h"
 #include "../PermanentStorage.h"
@@ -26,6 +27,7 @@ namespace WeatherProcessing
 {
   short SignExtendBitfield(unsigned short data, int width);
   void takeReading(short* sX, short* sY);
+  void decodeReading(const byte* data, short* sX, short* sY);
   constexpr byte alsAddress = 96;
   void read(byte regAddress, void* data, byte count);
   void write(byte regAddress, void* data, byte count);
@@ -37,14 +39,14 @@ namespace WeatherProcessing
   wdCalibStruct wdCalibOffset;
 
 #ifdef WIND_DIR_AVERAGING
-  extern float curWindX, curWindY;
+  extern long curWindX, curWindY;
 #endif
 #ifdef ALS_FIELD_STRENGTH
   unsigned long curFieldSquared;
   short curSampleCount;
 #endif
 
-  void initWind()
+  void initAls()
   {
     bool doWriteEeprom = false;
 
@@ -57,7 +59,7 @@ namespace WeatherProcessing
       writeAlsEeprom();
     }
 
-    setWindNormal();
+    setAlsNormal();
 
     ALS_PRINTLN(F("ALS Low power set"));
 
@@ -99,7 +101,7 @@ namespace WeatherProcessing
 #endif
   }
 
-  void sleepWind()
+  void sleepAls()
   {
     byte data[4];
     read(0x27, data, 4);
@@ -107,7 +109,7 @@ namespace WeatherProcessing
     write(0x27, data, 4);
   }
 
-  void setWindNormal()
+  void setAlsNormal()
   {
     byte data[4];
     read(0x27, data, 4);
@@ -115,7 +117,7 @@ namespace WeatherProcessing
     write(0x27, data, 4);
   }
 
-  void setWindLowPower()
+  void setAlsLowPower()
   {
     byte data[4];
     read(0x27, data, 4);
@@ -139,6 +141,7 @@ namespace WeatherProcessing
   void read(byte regAddress, void* data, byte count)
   {
     byte* dataB = (byte*)data;
+    while (Wire_busy());
     Wire_beginTransmission(alsAddress);
     ALS_PRINTLN(F("begun tx"));
     Wire_write(regAddress);
@@ -160,6 +163,7 @@ namespace WeatherProcessing
   void write(byte regAddress, void* data, byte count)
   {
     byte* dataB = (byte*)data;
+    while (Wire_busy());
     Wire_beginTransmission(alsAddress);
     ALS_PRINTLN(F("begun write tx"));
     Wire_write(regAddress);
@@ -171,36 +175,48 @@ namespace WeatherProcessing
     ALS_PRINTLN(F("ended true"));
   }
   
-  byte getCurWindDirection()
+  byte getAlsDirection()
   {
     short sX, sY;
     takeReading(&sX, &sY);
     return atan2ToByte(sX - wdCalibOffset.x, sY - wdCalibOffset.y);
   }
   
-  void doSampleWind()
-  {
 #ifdef WIND_DIR_AVERAGING
+  byte sampleBuffer[8];
+
+  void sampleReady(byte* data, bool ok)
+  {
+    if (!ok)
+      return;
     short sX, sY;
-    //AWS_DEBUG(auto entryMicros = micros());
-    takeReading(&sX, &sY);
-    //AWS_DEBUG(auto postRead = micros());
+    decodeReading(data, &sX, &sY);
     auto calibX = sX - wdCalibOffset.x;
     auto calibY = sY - wdCalibOffset.y;
     curWindX += calibX;
     curWindY += calibY;
-    //AWS_DEBUG(auto endMicros = micros());
-    //PRINT_VARIABLE(postRead - entryMicros);
-    //PRINT_VARIABLE(endMicros - postRead);
+    addDirectionSample(directionToAngle(atan2ToByte(calibX, calibY)));
 #ifdef ALS_FIELD_STRENGTH
     curFieldSquared += (long)calibX * calibX + (long)calibY * calibY;
     curSampleCount++;
 #endif // ALS_FIELD_STRENGTH
-    
+  }
+#endif
+
+  // Start the read and return. We idle through the transfer and sampleReady gets it from pollAls.
+  void sampleAls()
+  {
+#ifdef WIND_DIR_AVERAGING
+    Wire_readRegisterAsync(alsAddress, 0x28, sampleBuffer, sizeof(sampleBuffer), sampleReady);
 #endif
   }
 
-  void calibrateWindDirection()
+  void pollAls()
+  {
+    Wire_dispatch();
+  }
+
+  void calibrateAls()
   {
     short sX, sY;
     long tX = 0,
@@ -245,7 +261,11 @@ namespace WeatherProcessing
     byte data[8];
     read(0x28, data, 8);
     ALS_DEBUG_WRITE(data, 8);
+    decodeReading(data, sX, sY);
+  }
 
+  void decodeReading(const byte* data, short* sX, short* sY)
+  {
     auto x = ((unsigned short)data[0] << 4) | (data[5] & 0x0F);
     auto y = ((unsigned short)data[1] << 4) | ((data[6] & 0xF0) >> 4);
   
@@ -1,35 +1,71 @@
 #ifdef DAVIS_WIND
 #include "WeatherProcessing.h"
 #include "../PermanentStorage.h"
+#include "Wind.h"
 
 namespace WeatherProcessing
 {
   void signalWindCalibration(unsigned long durationRemaining);
+  byte davisDirection(int pwrVoltage, int wdVoltage);
+
+  // Oversample the pot for a couple of extra bits of direction resolution.
+  constexpr byte davisExtraBits = 2;
+  constexpr int davisFullScale = 1023 << davisExtraBits;
+
   //Get the wind direction for a davis vane.
   //Davis vane is a potentiometer sweep. 0 and full resistance correspond to 'north'.
   //We connect the ends of pot to +VCC and GND. So we just measure the centre pin and it linearly correlates with angle.
   //We're going to ignore the dead zone for now. Maybe test for it later. But given we intend to replace it all with ultrasonics, probably don't waste time.  
-  byte getCurWindDirection()
+  byte getDavisDirection()
   {
-    int maxVoltage = 1023;
-    int minVoltage = 0;
-    int wdCalib1, wdCalib2;
-    int pwrVoltage = 1023;
-    GET_PERMANENT_S(wdCalib1);
-    GET_PERMANENT_S(wdCalib2);
+    int pwrVoltage = davisFullScale;
   #ifdef WIND_PWR_PIN
-    pwrVoltage = analogRead(WIND_PWR_PIN);
+    pwrVoltage = AdcSampler::read(WIND_PWR_PIN, davisExtraBits);
     WX_PRINTVAR(pwrVoltage);
   #endif
-    maxVoltage = ((long)wdCalib2 * pwrVoltage) / 1023;
-    minVoltage = ((long)wdCalib1 * pwrVoltage) / 1023;
+    int wdVoltage = AdcSampler::read(WIND_DIR_PIN, davisExtraBits);
+    return davisDirection(pwrVoltage, wdVoltage);
+  }
+
+  // Queued conversions for direction averaging, the power reading comes back first.
+  int davisPwrVoltage = davisFullScale;
+
+  void davisPwrReady(unsigned short reading)
+  {
+    davisPwrVoltage = reading;
+  }
+
+  void davisDirReady(unsigned short reading)
+  {
+    windPowerOff();
+    accumulateDirection(davisDirection(davisPwrVoltage, reading));
+  }
+
+  void sampleDavisVane()
+  {
+    windPowerOn();
+  #ifdef WIND_PWR_PIN
+    AdcSampler::request(WIND_PWR_PIN, davisExtraBits, davisPwrReady);
+  #endif
+    if (!AdcSampler::request(WIND_DIR_PIN, davisExtraBits, davisDirReady))
+      windPowerOff();
+  }
+
+  // Voltages are in 1/davisFullScale of the reference, the calibration is stored in 1/1023.
+  byte davisDirection(int pwrVoltage, int wdVoltage)
+  {
+    int wdCalib1, wdCalib2;
+    GET_PERMANENT_S(wdCalib1);
+    GET_PERMANENT_S(wdCalib2);
+    int maxVoltage = ((long)wdCalib2 * pwrVoltage) / 1023;
+    int minVoltage = ((long)wdCalib1 * pwrVoltage) / 1023;
     int voltageDiff = maxVoltage - minVoltage;
 
-    int wdVoltage = analogRead(WIND_DIR_PIN);
     WX_PRINT(F("wdVoltage: "));
     WX_PRINTLN(wdVoltage);
 
-    int scaled = ((long)(wdVoltage - minVoltage + 2) * 255) / voltageDiff; //(The +2 is to make it do nearest rounding. Approximate voltageDiff ~1023)
+    //(The rounding term is to make it do nearest rounding. Approximate voltageDiff ~davisFullScale)
+    int scaled = ((long)(wdVoltage - minVoltage + (2 << davisExtraBits)) * 255) / voltageDiff;
     if (scaled < 0)
       scaled = 0;
     if (scaled > 255)
@@ -38,7 +74,7 @@ namespace WeatherProcessing
     return scaled;
   }
 
-  void calibrateWindDirection()
+  void calibrateDavisVane()
   {
 #ifdef WIND_PWR_PIN
     digitalWrite(WIND_PWR_PIN, HIGH);
@@ -53,7 +89,7 @@ namespace WeatherProcessing
     while (millis() - entryMillis < calibrationDuration)
     {
       #ifdef WIND_PWR_PIN
-        pwrVoltage = analogRead(WIND_PWR_PIN);
+        pwrVoltage = AdcSampler::read(WIND_PWR_PIN, 0);
         if (pwrVoltage == 0)
         {
           WX_PRINTLN(F("Power voltage is zero!"));
@@ -61,7 +97,7 @@ namespace WeatherProcessing
           continue;
         }
       #endif
-      int wdVoltageScaled = (analogRead(WIND_DIR_PIN) * 1023L) / pwrVoltage;
+      int wdVoltageScaled = (AdcSampler::read(WIND_DIR_PIN, 0) * 1023L) / pwrVoltage;
       if (wdVoltageScaled < minValue)
         minValue = wdVoltageScaled;
       if (wdVoltageScaled > maxValue)
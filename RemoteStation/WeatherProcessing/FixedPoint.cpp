@@ -0,0 +1,122 @@
+#include "FixedPoint.h"
+#include <avr/pgmspace.h>
+
+namespace WeatherProcessing
+{
+  // atan(2^-i) in 1/65536ths of a turn
+  const unsigned short cordicAngles[] PROGMEM = {
+    8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1
+  };
+  constexpr byte cordicIterations = sizeof(cordicAngles) / sizeof(cordicAngles[0]);
+
+  // sin(i * 90 / 64 degrees) * 255
+  const byte quarterSine[65] PROGMEM = {
+    0, 6, 13, 19, 25, 31, 37, 44, 50, 56, 62, 68, 74, 80, 86, 92,
+    98, 103, 109, 115, 120, 126, 131, 136, 142, 147, 152, 157, 162, 167, 171, 176,
+    180, 185, 189, 193, 197, 201, 205, 208, 212, 215, 219, 222, 225, 228, 231, 233,
+    236, 238, 240, 242, 244, 246, 247, 249, 250, 251, 252, 253, 254, 254, 255, 255,
+    255
+  };
+
+  // Temperature * 16 at every 16th ADC reading, from 1/T = 1/T0 + ln(R/R0) / B
+  // with B = 3892, T0 = 25C. Linear interpolation between entries stays within half a degree.
+  constexpr byte thermistorStep = 16;
+  const short thermistorTable_x16[65] PROGMEM = {
+    1760, 1760, 1760, 1760, 1648, 1512, 1403, 1312, 1235, 1167, 1107, 1053, 1003, 957, 915, 875,
+    838, 802, 769, 737, 706, 677, 648, 620, 594, 568, 542, 517, 493, 469, 445, 422,
+    399, 377, 354, 331, 309, 287, 264, 242, 219, 197, 174, 151, 127, 103, 79, 54,
+    28, 2, -25, -54, -83, -115, -148, -183, -221, -263, -309, -362, -424, -499, -601, -640,
+    -640
+  };
+
+  short atan2_i(int32_t y, int32_t x)
+  {
+    // Scale down so the CORDIC gain (~1.65) can't overflow.
+    while (x > 0x1FFFFFFF || x < -0x1FFFFFFF || y > 0x1FFFFFFF || y < -0x1FFFFFFF)
+    {
+      x >>= 1;
+      y >>= 1;
+    }
+    // And up, so small vectors don't lose precision to the shifts.
+    // (Multiplied, because shifting a negative number left is undefined. It's still a shift on the AVR.)
+    while (x != 0 || y != 0)
+    {
+      if (x > 0x0FFFFFFF || x < -0x0FFFFFFF || y > 0x0FFFFFFF || y < -0x0FFFFFFF)
+        break;
+      x *= 2;
+      y *= 2;
+    }
+
+    unsigned short angle = 0;
+    if (x < 0)
+    {
+      x = -x;
+      y = -y;
+      angle = 0x8000;
+    }
+    for (byte i = 0; i < cordicIterations; i++)
+    {
+      int32_t dx = x >> i;
+      int32_t dy = y >> i;
+      unsigned short step = pgm_read_word(&cordicAngles[i]);
+      if (y > 0)
+      {
+        x += dy;
+        y -= dx;
+        angle += step;
+      }
+      else
+      {
+        x -= dy;
+        y += dx;
+        angle -= step;
+      }
+    }
+    return (short)angle;
+  }
+
+  short sin_i(byte angle)
+  {
+    byte index = angle & 0x3F;
+    if (angle & 0x40)
+      index = 64 - index;
+    short ret = pgm_read_byte(&quarterSine[index]);
+    return (angle & 0x80) ? -ret : ret;
+  }
+
+  short thermistorTemperature_x2(unsigned short reading)
+  {
+    if (reading == 0)
+      return -64; // Matches the old float path. Really it means the thermistor is disconnected.
+    if (reading > 1023)
+      reading = 1023;
+    byte index = reading / thermistorStep;
+    byte fraction = reading % thermistorStep;
+    short low = pgm_read_word(&thermistorTable_x16[index]);
+    short high = pgm_read_word(&thermistorTable_x16[index + 1]);
+    short t_x16 = low + (short)(high - low) * fraction / thermistorStep;
+    // Floor rather than truncate towards zero:
+    return t_x16 >= 0 ? t_x16 / 8 : -((-t_x16 + 7) / 8);
+  }
+
+  unsigned short isqrt_i(uint32_t value)
+  {
+    // Digit by digit, two bits of value per bit of result.
+    uint32_t result = 0;
+    uint32_t bit = (uint32_t)1 << 30;
+    while (bit > value)
+      bit >>= 2;
+    while (bit)
+    {
+      if (value >= result + bit)
+      {
+        value -= result + bit;
+        result = (result >> 1) + bit;
+      }
+      else
+        result >>= 1;
+      bit >>= 2;
+    }
+    return result;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <Arduino.h>
+
+// Integer replacements for the float maths in weather processing.
+// The 328 has no FPU, and atan2/sin/log drag in a lot of soft float code.
+// The fixed width types are the AVR's long and unsigned long, and keep the PC host tests at the same width.
+namespace WeatherProcessing
+{
+  // Angle of (x, y) in 1/65536ths of a turn, with the same convention as atan2(y, x).
+  short atan2_i(int32_t y, int32_t x);
+
+  // Direction byte (1/255ths of a turn) of the vector sum (x, y), before the vane's offset.
+  // Equivalent to (byte)((atan2(-x, -y) / (2 * PI) + 0.5) * 255 + 0.5)
+  inline byte atan2ToDirection(int32_t x, int32_t y)
+  {
+    short angle = atan2_i(-x, -y);
+    return ((int32_t)angle * 255 + (int32_t)128 * 65536) >> 16;
+  }
+
+  // sin and cos of an angle in 1/256ths of a turn, scaled by 255.
+  short sin_i(byte angle);
+  inline short cos_i(byte angle) { return sin_i(angle + 64); }
+
+  // Thermistor ADC reading (0-1023) to temperature in half degrees.
+  // Clamped to -40 to 110 C, which is wider than we can send.
+  short thermistorTemperature_x2(unsigned short reading);
+
+  inline uint16_t absDiff(uint16_t a, uint16_t b)
+  {
+    return a > b ? a - b : b - a;
+  }
+
+  // floor(sqrt(value))
+  unsigned short isqrt_i(uint32_t value);
+}
@@ -1,5 +1,6 @@
 #include <util/twi.h>
 #include "TwoWire.h"
+#include "../Scheduler.h"
 #include <Arduino.h>
 
 byte wire_count;
@@ -95,4 +96,96 @@ void Wire_begin()
   digitalWrite(SCL, 1);
   TWBR = GetWireClock(100000);
   TWCR = _BV(TWEN);
-}
\ No newline at end of file
+}
+#ifdef ALS_WIND
+namespace
+{
+  volatile bool asyncBusy = false;
+  volatile bool asyncComplete = false;
+  volatile bool asyncOk;
+  byte asyncAddress;
+  byte asyncRegister;
+  byte* asyncBuffer;
+  byte asyncCount;
+  volatile byte asyncIdx;
+  WireCallback asyncCallback;
+}
+
+bool Wire_readRegisterAsync(byte address, byte regAddress, byte* buffer, byte count, WireCallback callback)
+{
+  if (asyncBusy || asyncComplete || count == 0)
+    return false;
+  // Don't start until the previous STOP has gone out
+  while (TWCR & _BV(TWSTO));
+  asyncAddress = address;
+  asyncRegister = regAddress;
+  asyncBuffer = buffer;
+  asyncCount = count;
+  asyncIdx = 0;
+  asyncCallback = callback;
+  asyncBusy = true;
+  TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTA) | _BV(TWIE);
+  return true;
+}
+
+bool Wire_busy()
+{
+  return asyncBusy;
+}
+
+void Wire_dispatch()
+{
+  if (!asyncComplete)
+    return;
+  asyncComplete = false;
+  asyncCallback(asyncBuffer, asyncOk);
+}
+
+static inline void finishAsync(bool ok)
+{
+  TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+  asyncOk = ok;
+  asyncBusy = false;
+  asyncComplete = true;
+  Scheduler::post(Scheduler::WireEvent);
+}
+
+// Write the register address, repeated start, then read asyncCount bytes, NACKing the last.
+ISR(TWI_vect)
+{
+  switch (TW_STATUS)
+  {
+  case TW_START:
+    TWDR = (asyncAddress << 1) | TW_WRITE;
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+    break;
+  case TW_MT_SLA_ACK:
+    TWDR = asyncRegister;
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+    break;
+  case TW_MT_DATA_ACK:
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTA) | _BV(TWIE);
+    break;
+  case TW_REP_START:
+    TWDR = (asyncAddress << 1) | TW_READ;
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+    break;
+  case TW_MR_DATA_ACK:
+    asyncBuffer[asyncIdx++] = TWDR;
+    // fall through
+  case TW_MR_SLA_ACK:
+    if (asyncIdx + 1 < asyncCount)
+      TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+    else
+      TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+    break;
+  case TW_MR_DATA_NACK:
+    asyncBuffer[asyncIdx++] = TWDR;
+    finishAsync(true);
+    break;
+  default: // NACKed address or data, lost arbitration or bus error.
+    finishAsync(false);
+    break;
+  }
+}
+#endif
@@ -1,3 +1,4 @@
+#pragma once
 typedef unsigned char byte;
 byte Wire_read();
 void Wire_endTransmission(bool close);
@@ -5,3 +6,14 @@ void Wire_requestFrom(byte address, byte count);
 void Wire_beginTransmission(byte address);
 void Wire_write(byte data);
 void Wire_begin();
+
+// Interrupt driven register read, so we can sleep through the transfer rather than spinning on TWINT.
+// callback is called from Wire_dispatch (not the ISR) with ok = false if the device didn't respond.
+typedef void (*WireCallback)(byte* data, bool ok);
+#ifdef ALS_WIND
+bool Wire_readRegisterAsync(byte address, byte regAddress, byte* buffer, byte count, WireCallback callback);
+bool Wire_busy();
+void Wire_dispatch();
+#else
+inline bool Wire_busy() { return false; }
+#endif
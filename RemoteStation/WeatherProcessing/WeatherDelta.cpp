@@ -0,0 +1,76 @@
+#include "WeatherDelta.h"
+#include "FixedPoint.h"
+
+namespace WeatherProcessing
+{
+  // The last full record we sent, which the deltas are against
+  static bool haveKeyframe = false;
+  static byte keyframeID, keyframeDirection, keyframeSpeed, keyframeGust;
+  // What the receiver last heard for the battery and temperature
+  static byte deltaBattery, deltaExternalTemp;
+  // Less than this and it's just ADC noise, not worth the byte
+  constexpr byte deltaRefreshThreshold = 2;
+
+  static inline bool fitsNibble(short val)
+  {
+    return val >= -8 && val <= 7;
+  }
+
+  // Direction is halved to cover the default report threshold, the receiver gets it to within one unit.
+  static inline short directionDelta(byte windDirection)
+  {
+    return ((int8_t)(windDirection - keyframeDirection) + 1) >> 1;
+  }
+
+  void setDeltaKeyframe(byte uniqueID, byte windDirection, byte wsByte, byte wgByte)
+  {
+    haveKeyframe = true;
+    keyframeID = uniqueID;
+    keyframeDirection = windDirection;
+    keyframeSpeed = wsByte;
+    keyframeGust = wgByte;
+  }
+
+  void setDeltaReferences(byte batteryByte, byte externalTempByte)
+  {
+    deltaBattery = batteryByte;
+    deltaExternalTemp = externalTempByte;
+  }
+
+  bool deltaFits(byte uniqueID, byte windDirection, byte wsByte, byte wgByte)
+  {
+    byte age = uniqueID - keyframeID;
+    return haveKeyframe && age != 0 && age <= 15 &&
+      fitsNibble(directionDelta(windDirection)) &&
+      fitsNibble((short)wsByte - keyframeSpeed) &&
+      fitsNibble((short)wgByte - keyframeGust);
+  }
+
+  byte encodeWeatherDelta(byte* dest, byte uniqueID, byte windDirection, byte wsByte, byte wgByte,
+    byte seconds, byte batteryByte, byte externalTempByte)
+  {
+    byte age = uniqueID - keyframeID;
+    byte dDirection = directionDelta(windDirection);
+    byte dSpeed = wsByte - keyframeSpeed;
+    byte dGust = wgByte - keyframeGust;
+    bool sendTemp = absDiff(externalTempByte, deltaExternalTemp) >= deltaRefreshThreshold;
+    bool sendBattery = sendTemp || absDiff(batteryByte, deltaBattery) >= deltaRefreshThreshold;
+
+    byte length = 3 + sendBattery + sendTemp;
+    *dest++ = deltaLengthFlag | length;
+    *dest++ = age | (dDirection << 4);
+    *dest++ = (dSpeed & 0x0F) | (dGust << 4);
+    *dest++ = seconds;
+    if (sendBattery)
+    {
+      *dest++ = batteryByte;
+      deltaBattery = batteryByte;
+    }
+    if (sendTemp)
+    {
+      *dest++ = externalTempByte;
+      deltaExternalTemp = externalTempByte;
+    }
+    return 1 + length;
+  }
+}
@@ -4,16 +4,18 @@
 #include "../ArduinoWeatherStation.h"
 #include "../PermanentStorage.h"
 #include "Wind.h"
+#include "FixedPoint.h"
+#include "WindStats.h"
+#include "WindSeries.h"
+#include "WindFaults.h"
 #include <avr/boot.h>
 #include "../PWMSolar.h"
+#include "../AdcSampler.h"
+#include "../Scheduler.h"
+#include "../Routing.h"
 
 //#define DEBUG_IT
 
-#if (defined(DAVIS_WIND) && defined(ARGENTDATA_WIND)) || \
-    (defined(DAVIS_WIND) && defined(ALS_WIND)) || \
-    (defined(ARGENTDATA_WIND) && defined(ALS_WIND))
-#error Multiple wind systems defined
-#endif
 #if !defined(DAVIS_WIND) && !defined(ARGENTDATA_WIND) && !defined(ALS_WIND)
 #error No wind system defined
 #endif
@@ -26,10 +28,11 @@ namespace WeatherProcessing
   unsigned long requiredTicks = 0xFFFFFF;
 
   short internalTemperature_x2;
-  float externalTemperature;
+  short externalTemperature_x2;
 
   #ifdef WIND_DIR_AVERAGING
-  float curWindX = 0, curWindY = 0;
+  // ALS readings are 12 bit and we sample at 10Hz, so these are good for hours.
+  long curWindX = 0, curWindY = 0;
   volatile bool sampleWind = false;
   #endif
 
@@ -40,12 +43,9 @@ namespace WeatherProcessing
   void setupWindCounter();
   byte getExternalTemperature();
   byte getInternalTemperature(short& reading);
-  byte getCurWindDirection();
 
   volatile unsigned short windCounts = 0;
   volatile unsigned short windCountStored = 0;
-  volatile unsigned short minInterval_x4 = 0xFFFF;
-  byte gustCount;
 
   //We use unsigned long for these because they are involved in 32-bit calculations.
   constexpr unsigned long mV_Ref = REF_MV;
@@ -63,9 +63,16 @@ namespace WeatherProcessing
     = 10;
   #endif
 
+  // Event driven reporting: what we last sent, and how many intervals ago.
+  byte intervalsSinceReport = 0;
+  uint16_t reportedSpeed_x2, reportedGust_x2;
+  byte reportedDirection;
+  // Below this the vane wanders too much to be worth reporting on
+  constexpr uint16_t minDirectionSpeed_x2 = 5 * 2;
+
+
   // We can use shorts here rather than longs because we don't care if the wind is ticking less than once per minute.
   unsigned short lastWindCountMillis;
-  unsigned short gustTickMillis;
   constexpr byte minWindIntervalTest = 3; //Debounce. 330 kph = broken station;
   constexpr byte windSampleShortTicks = 100 / TimerTwo::MillisPerTick;
   constexpr byte windSampleLongTicks = 1000 / TimerTwo::MillisPerTick;
@@ -83,21 +90,15 @@ namespace WeatherProcessing
       return ret;
     }
     else
-      return getCurWindDirection();
+      return Vane::readDirection();
 #else
-    return getCurWindDirection();
+    return Vane::readDirection();
 #endif
   }
 
-  byte __attribute__ ((noinline)) atan2ToByte(float x, float y)
+  byte __attribute__ ((noinline)) atan2ToByte(long x, long y)
   {
-    //These two are equivalent, just the implemented one has only one mult operation and only one add operation.
-    //(byte)((atan2(-curWindX, -curWindY) / (2 * PI) + 0.5) * 255 + 0.5);
-    auto ret = (byte)(atan2(-x, -y) * (255 / (2 * PI)) + (0.5* 255 + 0.5));
-#ifdef ALS_WIND
-    ret -= 96; //Account for the fact that we put the sensor in 135 degree out.
-#endif
-    return ret;
+    return atan2ToDirection(x, y) - Vane::directionOffset;
   }
 
   inline uint16_t getWindSpeed_x2()
@@ -106,28 +107,43 @@ namespace WeatherProcessing
     short localCounts = windCountStored;
     windCountStored = 0;
     interrupts();
-  #if defined(ARGENTDATA_WIND) || defined(ALS_WIND)
-    return (2UL * 2400 * localCounts) / weatherInterval;
-  #elif defined(DAVIS_WIND)
-    return (2UL * 3600 * localCounts) / weatherInterval;
-  #else
-    #error Cannot get Wind Speed
-  #endif
+    return countsToSpeed_x2<Cups>(localCounts, weatherInterval);
   }
 
-  inline uint16_t getWindGust_x2()
+  bool weatherReportDue()
   {
+    byte heartbeatIntervals;
+    GET_PERMANENT_S(heartbeatIntervals);
+    if (heartbeatIntervals <= 1 || ++intervalsSinceReport >= heartbeatIntervals)
+      return true;
+
+    byte reportSpeedThreshold_x2, reportGustThreshold_x2, reportDirectionThreshold;
+    GET_PERMANENT_S(reportSpeedThreshold_x2);
+    GET_PERMANENT_S(reportGustThreshold_x2);
+    GET_PERMANENT_S(reportDirectionThreshold);
+
     noInterrupts();
-    unsigned short localInterval_x4 = minInterval_x4;
-    minInterval_x4 = 0xFFFF;
+    unsigned short localCounts = windCountStored;
     interrupts();
-  #if defined (ARGENTDATA_WIND) || defined(ALS_WIND)
-    return ((unsigned short)2 * 4 * 2400) / localInterval_x4;
-  #elif defined (DAVIS_WIND)
-    return ((unsigned short)2 * 4 * 3600) / localInterval_x4;
-  #else
-    #error Cannot get wind gust
-  #endif
+    uint16_t windSpeed_x2 = countsToSpeed_x2<Cups>(localCounts, weatherInterval);
+    if (absDiff(windSpeed_x2, reportedSpeed_x2) >= reportSpeedThreshold_x2)
+      return true;
+    if (absDiff(peekGust_x2(), reportedGust_x2) >= reportGustThreshold_x2)
+      return true;
+#ifdef WIND_DIR_AVERAGING
+    if (windSpeed_x2 >= minDirectionSpeed_x2 && (curWindX != 0 || curWindY != 0))
+    {
+      // Shortest way round:
+      byte diff = atan2ToByte(curWindX, curWindY) - reportedDirection;
+      if (diff > 127)
+        diff = -diff;
+      if (diff >= reportDirectionThreshold)
+        return true;
+    }
+#endif
+    // Skipping this one. The direction, gust and histogram keep accumulating into the next report,
+    // and windCountStored is replaced by the next interval.
+    return false;
   }
 
   uint8_t getWindSpeedByte(const uint16_t windSpeed_x2)
@@ -143,7 +159,27 @@ namespace WeatherProcessing
       return 255;
   }
 
-  void createWeatherData(LoraMessageDestination& message)
+  // The thermistor reading from the last complex report. Deltas reuse it rather than powering the thermistor
+  // and running its conversions on the path that's meant to be cheap, so the temperature only moves with complex reports.
+  static byte complexExternalTempByte;
+
+  bool appendWeatherDelta(LoraMessageDestination& message, byte uniqueID,
+    byte windDirection, byte wsByte, byte wgByte, byte batteryByte)
+  {
+    bool deltaWeather;
+    GET_PERMANENT_S(deltaWeather);
+    if (!deltaWeather || !deltaFits(uniqueID, windDirection, wsByte, wgByte))
+      return false;
+
+    byte delta[maxDeltaSize];
+    byte length = encodeWeatherDelta(delta, uniqueID, windDirection, wsByte, wgByte,
+      (byte)TimerTwo::seconds(), batteryByte, complexExternalTempByte);
+    for (byte i = 0; i < length; i++)
+      message.appendByte2(delta[i]);
+    return true;
+  }
+
+  void createWeatherData(LoraMessageDestination& message, byte uniqueID)
   {
   #ifdef DEBUG
     unsigned long entryMicros = micros();
@@ -156,15 +192,47 @@ namespace WeatherProcessing
 
     bool isComplex = simpleMessagesSent >= complexMessageFrequency - 1 || batteryMode == BatteryMode::DeepSleep;
 
-    byte length = isComplex ? 9 : 4;
+    //Message format is W(StationID)(UniqueID)(Length)(DirHex)(Spd * 2)(Gust * 2)(Seconds)[Complex data...]
+  
+    WX_DEBUG(auto localCounts = windCountStored);
+    uint16_t windSpeed_x2 = getWindSpeed_x2();
+    byte wsByte = getWindSpeedByte(windSpeed_x2);
+
+    WindStatistics windStats;
+    takeWindStatistics(windStats);
+    // Before we look at the errors, so a new fault goes out with the next complex message.
+    checkWindFaults();
+    // Until the ring has filled the mean is the best we've got:
+    uint16_t windGust_x2 = windStats.gust_x2 > windSpeed_x2 ? windStats.gust_x2 : windSpeed_x2;
+    byte wgByte = getWindSpeedByte(windGust_x2);
+
+    //Update the send interval only after we calculate windSpeed, because windSpeed is dependent on weatherInterval
+    unsigned short batt_mV = readBattery();
+    
+    byte windDirection = getWindDirection();
+
+    intervalsSinceReport = 0;
+    reportedSpeed_x2 = windSpeed_x2;
+    reportedGust_x2 = windGust_x2;
+    reportedDirection = windDirection;
+
+    byte batteryByte = (byte)(255UL * batt_mV / MaxBatt_mV);
+    if (!isComplex && appendWeatherDelta(message, uniqueID, windDirection, wsByte, wgByte, batteryByte))
+    {
+      simpleMessagesSent++;
+    #ifdef WIND_PWR_PIN
+      digitalWrite(WIND_PWR_PIN, LOW);
+    #endif
+      return;
+    }
+
+    // Complex messages always carry the error pair (zeros if nothing new) so the wind statistics after it are unambiguous.
+    byte length = isComplex ? complexWeatherLength : 4;
 
     static short lastErrorSecondsSent = 0;
     bool errorOccurred = lastErrorSecondsSent != lastErrorSeconds;
     if (errorOccurred && isComplex)
-    {
-      length += 4;
       lastErrorSecondsSent = lastErrorSeconds;
-    }
 
     if (isComplex)
     {
@@ -178,24 +246,11 @@ namespace WeatherProcessing
       length += 4;
 #endif
     }
+    static_assert(complexWeatherLength + 15 < deltaLengthFlag, "Weather length collides with the delta flag");
     
     message.appendByte2(length);
 
-    //Message format is W(StationID)(UniqueID)(DirHex)(Spd * 2)(Voltage)
-  
-    WX_DEBUG(auto localCounts = windCountStored);
-    uint16_t windSpeed_x2 = getWindSpeed_x2();
-    byte wsByte = getWindSpeedByte(windSpeed_x2);
-
-    uint16_t windGust_x2 = getWindGust_x2();
-    byte wgByte = getWindSpeedByte(windGust_x2);
-
-    //Update the send interval only after we calculate windSpeed, because windSpeed is dependent on weatherInterval
-    unsigned short batt_mV = readBattery();
-    
-    byte windDirection = getWindDirection();
     message.appendByte2(windDirection); //1
-
     message.appendByte2(wsByte); //2
     message.appendByte2(wgByte); //3
 
@@ -203,15 +258,19 @@ namespace WeatherProcessing
 #ifdef DEBUG_WEATHER_TIMING
     message.appendT((short)millis());
 #endif
+
+    // Every full record is a keyframe for the deltas that follow
+    setDeltaKeyframe(uniqueID, windDirection, wsByte, wgByte);
     
-    byte batteryByte, externalTempByte, internalTempByte;
+    byte externalTempByte, internalTempByte;
     if (isComplex)
     {
-      batteryByte = (byte)(255UL * batt_mV / MaxBatt_mV);
       message.appendByte2(batteryByte); //5
 
       externalTempByte = getExternalTemperature();
+      complexExternalTempByte = externalTempByte;
       message.appendByte2(externalTempByte); //6
+      setDeltaReferences(batteryByte, externalTempByte);
 
       short iTReading;
       internalTempByte = getInternalTemperature(iTReading);
@@ -220,11 +279,21 @@ namespace WeatherProcessing
       message.appendByte2(PwmSolar::solarPwmValue); //8
       message.appendByte2(PwmSolar::curCurrent_mA_x6/6); //9
 
-      if (errorOccurred)
-      {
-        message.appendT(lastErrorSeconds); //11
-        message.appendT(lastErrorCode); //13
-      }
+      message.appendT(errorOccurred ? lastErrorSeconds : (unsigned short)0); //11
+      message.appendT(errorOccurred ? lastErrorCode : (short)0); //13
+      message.appendByte2(getWindSpeedByte(windStats.speedStdDev_x2)); //14
+      message.appendByte2(windStats.directionVariability); //15
+      byte histogram[packedHistogramSize];
+      takeDirectionHistogram(histogram);
+      for (byte i = 0; i < packedHistogramSize; i++)
+        message.appendByte2(histogram[i]); //23
+      // So relays and the ground know how long we might be quiet for, in 4 second units
+      byte heartbeatIntervals;
+      GET_PERMANENT_S(heartbeatIntervals);
+      unsigned long heartbeat_4s = heartbeatIntervals > 1 ? heartbeatIntervals * weatherInterval / 4000 : 0;
+      message.appendByte2(heartbeat_4s > 255 ? 255 : heartbeat_4s); //weatherHeartbeatByte
+      // So our neighbours can route through us
+      Routing::appendAdvert(message); //weatherRouteEndByte
 #ifdef DEBUG_IT
       message.appendT(iTReading);
 #endif
@@ -236,6 +305,8 @@ namespace WeatherProcessing
       message.appendT(PwmSolar::debug_curMillis); //2
 #endif
 #if defined(ALS_WIND) && defined(ALS_FIELD_STRENGTH)
+      if (curSampleCount > 0)
+        checkFieldStrength(curFieldSquared / curSampleCount);
       message.appendT(curFieldSquared / curSampleCount);
       curFieldSquared = 0;
       curSampleCount = 0;
@@ -274,8 +345,14 @@ namespace WeatherProcessing
 
   unsigned short readBattery()
   {
-    int batteryVoltageReading = analogRead(BATT_PIN);
-    batteryReading_mV = mV_Ref * BattVNumerator * batteryVoltageReading / (BattVDenominator  * 1023);
+    // 16 conversions for two extra bits.
+    constexpr byte battExtraBits = 2;
+    constexpr unsigned long battFullScale = 1023UL << battExtraBits;
+    // mV_Ref * BattVNumerator / (BattVDenominator * battFullScale) as a 16.16 multiplier, to avoid a 32 bit division.
+    constexpr unsigned long battScale = (mV_Ref * BattVNumerator * 65536ULL + BattVDenominator * battFullScale / 2) / (BattVDenominator * battFullScale);
+    static_assert(battScale <= 0xFFFFFFFFUL / battFullScale, "Battery scale overflow");
+    unsigned short batteryVoltageReading = AdcSampler::read(BATT_PIN, battExtraBits);
+    batteryReading_mV = (battScale * batteryVoltageReading) >> 16;
     return batteryReading_mV;
   }
 
@@ -307,44 +384,33 @@ namespace WeatherProcessing
         && batteryMode != BatteryMode::Stasis)
       return;
     lastWindCountMillis = thisMillis;
-    if ((gustCount & 0b11) == 0)
-    {
-      auto thisInterval = thisMillis - gustTickMillis;
-      if (thisInterval < minInterval_x4)
-        minInterval_x4 = thisInterval;
-      gustTickMillis = thisMillis;
-    }
     windCounts++;
-    gustCount++;
+    windStatsCount();
   }
 
   void processWeather()
   {
+    flushWindSeries();
     #ifdef WIND_DIR_AVERAGING
+    Vane::poll();
     cli();
     bool localSample = sampleWind;
     sampleWind = false;
     sei();
     if (localSample)
     {
-      doSampleWind();
+      Vane::sample();
     }
     #endif
   }
 
-#if !defined(ALS_WIND) && defined(WIND_DIR_AVERAGING)
-  void doSampleWind()
+#ifdef WIND_DIR_AVERAGING
+  void accumulateDirection(byte wd)
   {
-      #ifdef WIND_PWR_PIN
-        digitalWrite(WIND_PWR_PIN, HIGH);
-        delayMicroseconds(1000); //use delayuS instead of standard to avoid putting the device to sleep.
-      #endif
-      byte wd = getCurWindDirection();
-      #ifdef WIND_PWR_PIN
-        digitalWrite(WIND_PWR_PIN, LOW);
-      #endif
-      curWindX += sin(2 * PI * wd / 255);
-      curWindY += cos(2 * PI * wd / 255);
+      byte angle = directionToAngle(wd);
+      curWindX += sin_i(angle);
+      curWindY += cos_i(angle);
+      addDirectionSample(angle);
 #if 0
       WX_PRINTVAR(windCounts);
       WX_PRINTVAR(wd);
@@ -352,7 +418,7 @@ namespace WeatherProcessing
       WX_PRINTVAR(curWindY);
 #endif
   }
-#endif // !ALS_WIND
+#endif // WIND_DIR_AVERAGING
 
   void setupWindCounter()
   {
@@ -373,8 +439,9 @@ namespace WeatherProcessing
   {
     weatherRequired = false;
     tickCounts = 0;
-    initWind();
+    Vane::init();
     setupWindCounter();
+    setupWindSeries();
   #ifdef WIND_PWR_PIN
     pinMode(WIND_PWR_PIN, OUTPUT);
     digitalWrite(WIND_PWR_PIN, LOW);
@@ -390,9 +457,7 @@ namespace WeatherProcessing
     GET_PERMANENT2(&weatherInterval, longInterval);
     weatherInterval *= complexMessageFrequency;
     WeatherProcessing::setTimerInterval();
-#ifdef ALS_WIND
-    sleepWind();
-#endif
+    Vane::sleep();
   }
 
   void enterBatterySave()
@@ -400,9 +465,7 @@ namespace WeatherProcessing
     windSampleTicks = windSampleLongTicks;
     GET_PERMANENT2(&weatherInterval, longInterval);
     WeatherProcessing::setTimerInterval();
-#ifdef ALS_WIND
-    setWindLowPower();
-#endif
+    Vane::lowPower();
   }
 
   void enterNormalMode()
@@ -410,9 +473,7 @@ namespace WeatherProcessing
     windSampleTicks = windSampleShortTicks;
     GET_PERMANENT2(&weatherInterval, shortInterval);
     WeatherProcessing::setTimerInterval();
-#ifdef ALS_WIND
-    setWindNormal();
-#endif
+    Vane::normal();
   }
 
   byte getInternalTemperature(short& reading)
@@ -435,6 +496,8 @@ namespace WeatherProcessing
     GET_PERMANENT_S(tsOffset);
     GET_PERMANENT_S(tsGain);
 
+    // We're driving the ADC ourselves, make sure nothing is queued
+    AdcSampler::waitIdle();
     auto oldMux = ADMUX;
     // Set 1.1V internal reference, set to channel 8 (internal temperature reference)
     ADMUX = _BV(REFS0) | _BV(REFS1) | _BV(MUX3);
@@ -496,30 +559,18 @@ namespace WeatherProcessing
     digitalWrite(TEMP_PWR_PIN, HIGH);
     delay(3);
 #endif
-    auto tempReading = analogRead(TEMP_SENSE);
+    // Average 16 conversions, the table only wants 10 bits.
+    auto tempReading = (AdcSampler::read(TEMP_SENSE, 2) + 2) >> 2;
 #ifdef TEMP_PWR_PIN
     digitalWrite(TEMP_PWR_PIN, LOW);
 #endif
     // V = Vref * R1 / (R1 + R2)
-    // V / (Vref * R1) = 1 / (R1 + R2)
-    // R1 * Vref / V = R1 + R2
-    // 0 = (1 - Vref / V) R1 + R2
-    // R1 = R2 / (Vref / V - 1)
-    // R2 / R1 = Vref / V - 1
-    // Vref / V = 1023 / reading
-    float r2_r1 = 1023.0 / tempReading - 1;
-    constexpr float invB = 1/3892.0;
-    constexpr float T0 = 273.15 + 25;
-    float T = 1/(1/T0 - invB * log(r2_r1));
-
-    //If tempReading = 1000, r2_r1 is v. small
-    //then log(r2_r1) = large negative
-    //then T = 1/(C - large negative) = 1/(C + large positive) = small!
-    //So at low temperatures we want large reading. Thermistor between sense and GND.
-
-    T -= 273.15;
-    
-    externalTemperature = T;
+    // R2 / R1 = Vref / V - 1 = 1023 / reading - 1
+    // 1/T = 1/T0 + ln(R2/R1) / B
+    // At low temperatures we get a large reading. Thermistor between sense and GND.
+    // (See FixedPoint.cpp for the table)
+    short T_x2 = thermistorTemperature_x2(tempReading);
+    externalTemperature_x2 = T_x2;
 
     //WX_PRINTVAR(tempReading);
   #else
@@ -528,11 +579,11 @@ namespace WeatherProcessing
   #endif
 #if defined(ALS_TEMP) || defined(TEMP_SENSE)
     //We send temperature as a byte, ranging from -32 to 95 C (1 LSB = half a degree)
-    if (T < -32)
-      T = -32;
-    if (T > 95)
-      T = 95;
-    return (T + 0.5 + 32) * 2;
+    if (T_x2 < -32 * 2)
+      T_x2 = -32 * 2;
+    if (T_x2 > 95 * 2)
+      T_x2 = 95 * 2;
+    return T_x2 + 32 * 2 + 1;
 #endif
   }
 
@@ -544,10 +595,15 @@ namespace WeatherProcessing
       weatherRequired = true;
       windCountStored = windCounts;
       windCounts = 0;
+      Scheduler::post(Scheduler::WeatherEvent);
     }
+    windStatsTick();
 #ifdef WIND_DIR_AVERAGING
     if (windSampleTicks == 0 || tickCounts % windSampleTicks == 0)
+    {
       sampleWind = true;
+      Scheduler::post(Scheduler::WeatherEvent);
+    }
 #endif
   }
 
@@ -558,14 +614,15 @@ namespace WeatherProcessing
       return false;
 
     byte newValue, tsOffset, tsGain;
-    if ((commandType == 'O' || commandType == 'G') &&
+    bool deltaWeather;
+    if ((commandType == 'O' || commandType == 'G' || commandType == 'D' || commandType == 'S') &&
         src.readByte(newValue))
       return false;
 
     switch (commandType)
     {
     case 'C': // WC - perform wind calibration
-      calibrateWindDirection();
+      Vane::calibrate();
       return true;
     case 'O': // WO - set temp offset
       tsOffset = newValue;
@@ -575,10 +632,21 @@ namespace WeatherProcessing
       tsGain = newValue;
       SET_PERMANENT(tsGain);
       return true;
-#ifdef ALS_WIND
-    case 'E':
-      return writeAlsEeprom();
+    case 'D': // WD - delta encoded weather on (1) or off (0)
+      deltaWeather = newValue;
+      SET_PERMANENT_S(deltaWeather);
+      return true;
+#ifdef WIND_SERIES
+    case 'S': // WS - record one second wind to flash (1) or not (0)
+      {
+        bool recordWindSeries = newValue;
+        SET_PERMANENT_S(recordWindSeries);
+        setWindSeriesEnabled(recordWindSeries);
+        return true;
+      }
 #endif
+    case 'E':
+      return Vane::writeEeprom();
     default:
       return false;
     }
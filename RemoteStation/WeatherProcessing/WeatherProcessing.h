@@ -1,6 +1,8 @@
 #pragma once
 #include "../LoraMessaging.h"
 #include "../ArduinoWeatherStation.h"
+#include "WeatherDelta.h"
+#include "WindStats.h"
 
 #ifdef DEBUG_WEATHER
 #define WX_PRINT AWS_DEBUG_PRINT
@@ -25,24 +27,25 @@ namespace WeatherProcessing
   void setTimerInterval();
 
   void processWeather();
-  void createWeatherData(LoraMessageDestination& message);
+  void createWeatherData(LoraMessageDestination& message, byte uniqueID);
+  // Complex weather records, counting the bytes after the length from 1 as createWeatherData does:
+  // ...(Variability:1 - byte 15)(Histogram)(Heartbeat_4s:1)(RouteCost:1)(NextHop:1), then any debug extras.
+  // Relays read the heartbeat and route of the stations they hear from here.
+  constexpr byte weatherHeartbeatByte = 16 + packedHistogramSize;
+  constexpr byte weatherRouteEndByte = weatherHeartbeatByte + 2;
+  constexpr byte complexWeatherLength = weatherRouteEndByte;
+  // False while we're on the heartbeat and nothing has changed enough to report
+  bool weatherReportDue();
   bool handleWeatherCommand(MessageSource& src);
   unsigned short readBattery();
-  //ALS only:
-#ifdef ALS_WIND
-  bool writeAlsEeprom();
-  void sleepWind();
-  void setWindLowPower();
-  void setWindNormal();
-#ifdef ALS_FIELD_STRENGTH
+#if defined(ALS_WIND) && defined(ALS_FIELD_STRENGTH)
   extern unsigned long curFieldSquared;
   extern short curSampleCount;
-#endif
 #endif
 
   extern volatile bool weatherRequired;
   extern volatile unsigned short windCounts;
 
   extern short internalTemperature_x2;
-  extern float externalTemperature;
+  extern short externalTemperature_x2;
 }
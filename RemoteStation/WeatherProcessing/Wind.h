@@ -1,20 +1,128 @@
 #pragma once
+#include <Arduino.h>
+#include "../AdcSampler.h"
+
+// Each board picks its vane with DAVIS_WIND, ARGENTDATA_WIND or ALS_WIND.
+// The cups default to the ones that came with the vane, DAVIS_CUPS or ARGENTDATA_CUPS
+// override that for mixed boards (e.g. Davis cups with an ALS31313 vane).
+#if (defined(DAVIS_WIND) && defined(ARGENTDATA_WIND)) || \
+    (defined(DAVIS_WIND) && defined(ALS_WIND)) || \
+    (defined(ARGENTDATA_WIND) && defined(ALS_WIND))
+#error Multiple wind vanes defined
+#endif
+#if defined(DAVIS_CUPS) && defined(ARGENTDATA_CUPS)
+#error Multiple wind cups defined
+#endif
 
 namespace WeatherProcessing
 {
-  byte getCurWindDirection();
-  void doSampleWind();
-  byte atan2ToByte(float x, float y);
+  // Cups: km/h = speedConstant * ticks / milliseconds
+  struct ArgentDataCups
+  {
+    static constexpr unsigned short speedConstant = 2400;
+  };
 
-#if defined(DAVIS_WIND) || defined(ALS_WIND)
-  void calibrateWindDirection();
-#else
-  static inline void calibrateWindDirection() {}
+  struct DavisCups
+  {
+    static constexpr unsigned short speedConstant = 3600;
+  };
+
+  template <class TCups>
+  constexpr uint16_t countsToSpeed_x2(unsigned long counts, unsigned long periodMillis)
+  {
+    return (2UL * TCups::speedConstant * counts) / periodMillis;
+  }
+
+  // Vanes provide:
+  //   readDirection() - the instantaneous direction, 0-255 clockwise from north
+  //   sample() - called every windSampleTicks with WIND_DIR_AVERAGING
+  //   poll() - called every loop, for vanes that deliver their samples later
+  //   calibrate(), init(), sleep(), lowPower(), normal() and writeEeprom()
+  //   directionOffset - subtracted from averaged vectors, for sensors mounted rotated
+  byte getDavisDirection();
+  void sampleDavisVane();
+  void calibrateDavisVane();
+  byte getArgentDataDirection();
+  void sampleArgentDataVane();
+
+  byte getAlsDirection();
+  void sampleAls();
+  void pollAls();
+  void calibrateAls();
+  void initAls();
+  void sleepAls();
+  void setAlsLowPower();
+  void setAlsNormal();
+  bool writeAlsEeprom();
+
+  // Adds a direction reading to the average and the wind statistics
+  void accumulateDirection(byte wd);
+
+  inline void noCalibration() {}
+
+  inline void windPowerOn()
+  {
+  #ifdef WIND_PWR_PIN
+    digitalWrite(WIND_PWR_PIN, HIGH);
+    delayMicroseconds(1000); //use delayuS instead of standard to avoid putting the device to sleep.
+  #endif
+  }
+
+  inline void windPowerOff()
+  {
+  #ifdef WIND_PWR_PIN
+    digitalWrite(WIND_PWR_PIN, LOW);
+  #endif
+  }
+
+  // A vane we read through the ADC. Sample queues the conversions and the result arrives through AdcSampler::dispatch.
+  template <byte (*Read)(), void (*Calibrate)(), void (*Sample)()>
+  struct AnalogVane
+  {
+    static constexpr byte directionOffset = 0;
+
+    static byte readDirection() { return Read(); }
+    static void calibrate() { Calibrate(); }
+    static void sample() { Sample(); }
+    static void poll() { AdcSampler::dispatch(); }
+    static void init() {}
+    static void sleep() {}
+    static void lowPower() {}
+    static void normal() {}
+    static bool writeEeprom() { return false; }
+  };
+
+  using DavisVane = AnalogVane<getDavisDirection, calibrateDavisVane, sampleDavisVane>;
+  using ArgentDataVane = AnalogVane<getArgentDataDirection, noCalibration, sampleArgentDataVane>;
+
+  struct AlsVane
+  {
+    static constexpr byte directionOffset = 96; //Account for the fact that we put the sensor in 135 degree out.
+
+    static byte readDirection() { return getAlsDirection(); }
+    static void calibrate() { calibrateAls(); }
+    static void sample() { sampleAls(); }
+    static void poll() { pollAls(); }
+    static void init() { initAls(); }
+    static void sleep() { sleepAls(); }
+    static void lowPower() { setAlsLowPower(); }
+    static void normal() { setAlsNormal(); }
+    static bool writeEeprom() { return writeAlsEeprom(); }
+  };
+
+#if defined(DAVIS_WIND)
+  using Vane = DavisVane;
+#elif defined(ARGENTDATA_WIND)
+  using Vane = ArgentDataVane;
+#elif defined(ALS_WIND)
+  using Vane = AlsVane;
 #endif
 
-#ifdef ALS_WIND
-  void initWind();
+#if defined(DAVIS_CUPS) || (defined(DAVIS_WIND) && !defined(ARGENTDATA_CUPS))
+  using Cups = DavisCups;
 #else
-  static inline void initWind() {}
+  using Cups = ArgentDataCups;
 #endif
-}
\ No newline at end of file
+
+  byte atan2ToByte(long x, long y);
+}
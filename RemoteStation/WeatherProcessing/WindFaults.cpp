@@ -0,0 +1,146 @@
+#include "WindFaults.h"
+#include "Wind.h"
+#include "../TimerTwo.h"
+#include "../ArduinoWeatherStation.h"
+
+namespace WeatherProcessing
+{
+  // How long a signature has to persist before we believe it:
+  constexpr unsigned short cupsStoppedSeconds = 1800;
+  constexpr unsigned short vaneFrozenSeconds = 600;
+  // A moving vane averages at least this much travel between samples (about 5 degrees)
+  constexpr byte movingVaneTravel = 4;
+  // Enough wind that a working vane will never sit perfectly still
+  constexpr uint16_t frozenVaneSpeed_x2 = 15 * 2;
+  constexpr byte minDirectionSamples = 10;
+  // 250 km/h in one second's ticks
+  constexpr byte implausibleCounts = 250UL * 1000 / Cups::speedConstant;
+  constexpr byte noisySeconds = 3;
+  // Remind the ground of a fault that hasn't gone away
+  constexpr unsigned long faultRepeatSeconds = 6UL * 3600;
+
+  constexpr byte cupsStoppedFault = 0x01;
+  constexpr byte vaneFrozenFault = 0x02;
+  constexpr byte cupsNoiseFault = 0x04;
+  constexpr byte fieldDriftFault = 0x08;
+  constexpr byte faultCount = 4;
+  static_assert(fieldDriftFault < 1 << faultCount, "Every fault needs a lastFaultSignalSeconds");
+
+  // Since the last check. Written in the timer ISR.
+  volatile unsigned short faultTicks = 0;
+  volatile byte implausibleSeconds = 0;
+  // Only touched from the main loop:
+  unsigned short directionSamples = 0;
+  unsigned long vaneTravel = 0;
+  byte lastAngle;
+  unsigned long lastCheckSeconds = 0;
+
+  unsigned short stoppedCupsSeconds = 0;
+  unsigned short stillVaneSeconds = 0;
+  byte activeFaults = 0;
+  // Each fault repeats on its own clock, or one would keep putting off the others' reminders.
+  unsigned long lastFaultSignalSeconds[faultCount];
+
+  void windFaultSecond(byte counts)
+  {
+    if (faultTicks < 0xFFFF - counts)
+      faultTicks += counts;
+    if (counts >= implausibleCounts && implausibleSeconds < 255)
+      implausibleSeconds++;
+  }
+
+  void windFaultDirection(byte angle)
+  {
+    if (directionSamples > 0)
+    {
+      byte diff = angle - lastAngle;
+      vaneTravel += diff > 127 ? (byte)-diff : diff;
+    }
+    lastAngle = angle;
+    if (directionSamples < 0xFFFF)
+      directionSamples++;
+  }
+
+  static void updateFault(byte fault, short errorCode, bool present, unsigned long now)
+  {
+    if (!present)
+    {
+      activeFaults &= ~fault;
+      return;
+    }
+    unsigned long& lastSignal = lastFaultSignalSeconds[__builtin_ctz(fault)];
+    if (!(activeFaults & fault) || now - lastSignal >= faultRepeatSeconds)
+    {
+      SIGNALERROR(errorCode);
+      lastSignal = now;
+    }
+    activeFaults |= fault;
+  }
+
+  static inline unsigned short addSeconds(unsigned short total, unsigned long elapsed)
+  {
+    return total + elapsed > 0xFFFF ? 0xFFFF : total + elapsed;
+  }
+
+  void checkWindFaults()
+  {
+    unsigned long now = TimerTwo::seconds();
+    unsigned long elapsed = now - lastCheckSeconds;
+    lastCheckSeconds = now;
+
+    noInterrupts();
+    unsigned short ticks = faultTicks;
+    byte implausible = implausibleSeconds;
+    faultTicks = 0;
+    implausibleSeconds = 0;
+    interrupts();
+    unsigned short samples = directionSamples;
+    unsigned long travel = vaneTravel;
+    directionSamples = 0;
+    vaneTravel = 0;
+
+    // We don't count the wind in deep sleep, and the seconds aren't worth much after a time change.
+    if (batteryMode == BatteryMode::DeepSleep || elapsed == 0 || elapsed > 0xFFFF)
+      return;
+
+    if (samples >= minDirectionSamples)
+    {
+      bool vaneMoving = travel >= (unsigned long)movingVaneTravel * samples;
+      stoppedCupsSeconds = ticks == 0 && vaneMoving ? addSeconds(stoppedCupsSeconds, elapsed) : 0;
+
+      uint16_t speed_x2 = countsToSpeed_x2<Cups>(ticks, elapsed * 1000);
+      stillVaneSeconds = travel == 0 && speed_x2 >= frozenVaneSpeed_x2 ? addSeconds(stillVaneSeconds, elapsed) : 0;
+    }
+    else if (ticks > 0)
+      stoppedCupsSeconds = 0;
+
+    updateFault(cupsStoppedFault, WX_FAULT_CUPS_STOPPED, stoppedCupsSeconds >= cupsStoppedSeconds, now);
+    updateFault(vaneFrozenFault, WX_FAULT_VANE_FROZEN, stillVaneSeconds >= vaneFrozenSeconds, now);
+    updateFault(cupsNoiseFault, WX_FAULT_CUPS_NOISE, implausible >= noisySeconds, now);
+  }
+
+#if defined(ALS_WIND) && defined(ALS_FIELD_STRENGTH)
+  // Running averages of the mean squared field, one quick and one over a day or so of complex messages.
+  long recentField = 0, baselineField = 0;
+  byte fieldChecks = 0;
+  constexpr byte fieldWarmup = 64;
+
+  void checkFieldStrength(unsigned long meanFieldSquared)
+  {
+    long field = meanFieldSquared;
+    if (fieldChecks == 0)
+      recentField = baselineField = field;
+    recentField += (field - recentField) / 8;
+    baselineField += (field - baselineField) / 128;
+    if (fieldChecks < fieldWarmup)
+    {
+      fieldChecks++;
+      return;
+    }
+    // A quarter of the squared field is about 12% of the field. Once it's drifted we wait for it to come most of the way back.
+    long drift = abs(recentField - baselineField);
+    bool drifting = activeFaults & fieldDriftFault ? drift > baselineField / 8 : drift > baselineField / 4;
+    updateFault(fieldDriftFault, WX_FAULT_FIELD_DRIFT, drifting, TimerTwo::seconds());
+  }
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <Arduino.h>
+
+// Watches the raw wind data for the signatures of a sick sensor, and raises them with SIGNALERROR
+// so they go out with the next complex message:
+//   WX_FAULT_CUPS_STOPPED - the vane's been moving but the cups haven't ticked (broken cups, seized bearing)
+//   WX_FAULT_VANE_FROZEN - plenty of wind but the direction hasn't changed at all (iced or seized vane, hung ALS)
+//   WX_FAULT_CUPS_NOISE - seconds with more ticks than any real wind could make (flapping cable, bad switch)
+//   WX_FAULT_FIELD_DRIFT - the ALS magnet's field has wandered from its long term level (ALS_FIELD_STRENGTH only)
+// It's all a few counters and running averages, checked when we create the weather data.
+namespace WeatherProcessing
+{
+  // ISR context, once a second:
+  void windFaultSecond(byte counts);
+  // Every direction sample, in 1/256ths of a turn
+  void windFaultDirection(byte angle);
+  void checkWindFaults();
+#if defined(ALS_WIND) && defined(ALS_FIELD_STRENGTH)
+  void checkFieldStrength(unsigned long meanFieldSquared);
+#endif
+}
@@ -0,0 +1,78 @@
+#include "WindSeries.h"
+#ifdef WIND_SERIES
+#include "Wind.h"
+#include "../TimerTwo.h"
+#include "../Database.h"
+#include "../PermanentStorage.h"
+#include "../ArduinoWeatherStation.h"
+#include "../Scheduler.h"
+
+namespace WeatherProcessing
+{
+  // Most of a flash page, and still fits in a DR response with a callsign in front of it.
+  constexpr byte windSeriesSamples = 112;
+  constexpr byte windSeriesHeaderSize = 6;
+  byte windSeriesBuffer[windSeriesHeaderSize + 2 * windSeriesSamples];
+
+  // The ISR fills the buffer, then leaves it alone until the main loop has written it out.
+  // The main loop runs every timer tick so we don't lose a second waiting for it.
+  volatile byte windSeriesCount = 0;
+  volatile bool windSeriesFull = false;
+  volatile byte windSeriesLastDirection = 0;
+  volatile bool windSeriesEnabled = false;
+
+  void setupWindSeries()
+  {
+    bool recordWindSeries;
+    GET_PERMANENT_S(recordWindSeries);
+    setWindSeriesEnabled(recordWindSeries);
+  }
+
+  void setWindSeriesEnabled(bool enabled)
+  {
+    noInterrupts();
+    windSeriesEnabled = enabled;
+    windSeriesCount = 0;
+    windSeriesFull = false;
+    interrupts();
+  }
+
+  void windSeriesDirection(byte angle)
+  {
+    windSeriesLastDirection = angle;
+  }
+
+  void windSeriesSecond(byte counts)
+  {
+    // The timer is slowed in deep sleep, they wouldn't be seconds.
+    if (!windSeriesEnabled || windSeriesFull || batteryMode == BatteryMode::DeepSleep)
+      return;
+    if (windSeriesCount == 0)
+    {
+      *(unsigned long*)windSeriesBuffer = TimerTwo::seconds();
+      *(unsigned short*)(windSeriesBuffer + 4) = Cups::speedConstant;
+    }
+    byte* sample = windSeriesBuffer + windSeriesHeaderSize + 2 * windSeriesCount;
+    sample[0] = counts;
+    sample[1] = windSeriesLastDirection;
+    if (++windSeriesCount >= windSeriesSamples)
+    {
+      windSeriesFull = true;
+      Scheduler::post(Scheduler::WeatherEvent);
+    }
+  }
+
+  void flushWindSeries()
+  {
+    if (!windSeriesFull)
+      return;
+#ifndef NO_STORAGE
+    Database::storeData(windSeriesType, stationID, windSeriesBuffer, sizeof(windSeriesBuffer));
+#endif
+    noInterrupts();
+    windSeriesCount = 0;
+    windSeriesFull = false;
+    interrupts();
+  }
+}
+#endif // WIND_SERIES
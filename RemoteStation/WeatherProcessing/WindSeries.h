@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+
+// One second anemometer counts and vane directions, for replaying a flight or checking a sensor.
+// Built with WIND_SERIES=1 and turned on with WS1. Batches go into the flash database as 'T' records,
+// so they only cost airtime when someone asks for them with DL / DR.
+// Record: (StartSeconds:4)(SpeedConstant:2)[(Counts)(Direction)]...
+//   km/h = Counts * SpeedConstant / 1000, Direction is the last vane sample in 1/256ths of a turn from north.
+namespace WeatherProcessing
+{
+  constexpr byte windSeriesType = 'T';
+
+#ifdef WIND_SERIES
+  void setupWindSeries();
+  void setWindSeriesEnabled(bool enabled);
+  // ISR context, once a second:
+  void windSeriesSecond(byte counts);
+  // The latest vane reading, in 1/256ths of a turn
+  void windSeriesDirection(byte angle);
+  // Main loop: writes the batch once it's full
+  void flushWindSeries();
+#else
+  inline void setupWindSeries() {}
+  inline void windSeriesSecond(byte counts) {}
+  inline void windSeriesDirection(byte angle) {}
+  inline void flushWindSeries() {}
+#endif
+}
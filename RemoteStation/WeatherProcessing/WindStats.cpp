@@ -0,0 +1,168 @@
+#include "WindStats.h"
+#include "WindSeries.h"
+#include "WindFaults.h"
+#include "FixedPoint.h"
+#include "Wind.h"
+#include "../TimerTwo.h"
+
+namespace WeatherProcessing
+{
+  constexpr byte ticksPerSecond = 1000 / TimerTwo::MillisPerTick;
+  constexpr unsigned short secondMillis = ticksPerSecond * TimerTwo::MillisPerTick;
+  // Beyond this sumSquares * 16 can overflow. It's over an hour, we'll have sent a message by then.
+  constexpr unsigned short maxStatSeconds = 4000;
+
+  // Ring of the last gustSeconds one second counts, with their sum kept up to date
+  volatile byte countsThisSecond = 0;
+  byte ticksThisSecond = 0;
+  byte secondCounts[gustSeconds];
+  byte ringIdx = 0;
+  byte ringFilled = 0;
+  unsigned short runningSum = 0;
+
+  // Per interval. Written in the timer ISR.
+  volatile unsigned short maxRunningSum = 0;
+  volatile unsigned short secondsSampled = 0;
+  volatile unsigned long sumCounts = 0;
+  volatile unsigned long sumSquares = 0;
+
+#ifdef WIND_DIR_AVERAGING
+  // Sum of unit vectors (scaled by 255), only touched from the main loop
+  long dirSumX = 0, dirSumY = 0;
+  unsigned short dirSamples = 0;
+  // Weighted by the 3 second tick count. Halved when one would overflow, which keeps the proportions.
+  unsigned short directionHistogram[directionSectors];
+#endif
+
+  void windStatsCount()
+  {
+    if (countsThisSecond < 255)
+      countsThisSecond++;
+  }
+
+  void windStatsTick()
+  {
+    if (++ticksThisSecond < ticksPerSecond)
+      return;
+    ticksThisSecond = 0;
+    byte counts = countsThisSecond;
+    countsThisSecond = 0;
+
+    runningSum += counts;
+    runningSum -= secondCounts[ringIdx];
+    secondCounts[ringIdx] = counts;
+    if (++ringIdx >= gustSeconds)
+      ringIdx = 0;
+    if (ringFilled < gustSeconds)
+      ringFilled++;
+    if (ringFilled == gustSeconds && runningSum > maxRunningSum)
+      maxRunningSum = runningSum;
+
+    windSeriesSecond(counts);
+    windFaultSecond(counts);
+
+    if (secondsSampled < maxStatSeconds)
+    {
+      secondsSampled++;
+      sumCounts += counts;
+      sumSquares += (unsigned short)counts * counts;
+    }
+  }
+
+  void addDirectionSample(byte angle)
+  {
+    windSeriesDirection(angle);
+    windFaultDirection(angle);
+#ifdef WIND_DIR_AVERAGING
+    dirSumX += sin_i(angle);
+    dirSumY += cos_i(angle);
+    dirSamples++;
+
+    noInterrupts();
+    unsigned short weight = runningSum;
+    interrupts();
+    byte sector = ((angle + 8) >> 4) & (directionSectors - 1);
+    if (directionHistogram[sector] > 0xFFFF - weight)
+    {
+      for (byte i = 0; i < directionSectors; i++)
+        directionHistogram[i] >>= 1;
+    }
+    directionHistogram[sector] += weight;
+#endif
+  }
+
+  void takeDirectionHistogram(byte* packed)
+  {
+    memset(packed, 0, packedHistogramSize);
+#ifdef WIND_DIR_AVERAGING
+    unsigned short maxWeight = 0;
+    for (byte i = 0; i < directionSectors; i++)
+    {
+      if (directionHistogram[i] > maxWeight)
+        maxWeight = directionHistogram[i];
+    }
+    // All zero if it was calm
+    if (maxWeight > 0)
+    {
+      for (byte i = 0; i < directionSectors; i++)
+      {
+        byte level = ((unsigned long)directionHistogram[i] * 15 + maxWeight / 2) / maxWeight;
+        packed[i / 2] |= (i & 1) ? level << 4 : level;
+      }
+    }
+    memset(directionHistogram, 0, sizeof(directionHistogram));
+#endif
+  }
+
+  uint16_t peekGust_x2()
+  {
+    noInterrupts();
+    unsigned short localMax = maxRunningSum;
+    interrupts();
+    return countsToSpeed_x2<Cups>(localMax, (unsigned long)gustSeconds * secondMillis);
+  }
+
+  void takeWindStatistics(WindStatistics& stats)
+  {
+    noInterrupts();
+    unsigned short localMax = maxRunningSum;
+    unsigned short n = secondsSampled;
+    unsigned long sum = sumCounts;
+    unsigned long sumSq = sumSquares;
+    maxRunningSum = 0;
+    secondsSampled = 0;
+    sumCounts = 0;
+    sumSquares = 0;
+    interrupts();
+
+    stats.gust_x2 = countsToSpeed_x2<Cups>(localMax, (unsigned long)gustSeconds * secondMillis);
+
+    stats.speedStdDev_x2 = 0;
+    if (n >= 2)
+    {
+      // Variance of counts per second, in 1/256ths:
+      unsigned long mean_x16 = sum * 16 / n;
+      unsigned long meanSquare_x256 = sumSq * 16 / n * 16;
+      unsigned long var_x256 = meanSquare_x256 > mean_x16 * mean_x16
+        ? meanSquare_x256 - mean_x16 * mean_x16
+        : 0;
+      unsigned short sd_x16 = isqrt_i(var_x256);
+      stats.speedStdDev_x2 = countsToSpeed_x2<Cups>(sd_x16, 16UL * secondMillis);
+    }
+
+    stats.directionVariability = 255;
+#ifdef WIND_DIR_AVERAGING
+    if (dirSamples > 0)
+    {
+      // Length of the mean unit vector: 1 if the direction never moved, near 0 if it was all over the place.
+      long meanX_x16 = dirSumX * 16 / dirSamples;
+      long meanY_x16 = dirSumY * 16 / dirSamples;
+      unsigned short length_x16 = isqrt_i(meanX_x16 * meanX_x16 + meanY_x16 * meanY_x16);
+      unsigned short length = length_x16 / 16;
+      stats.directionVariability = length >= 255 ? 0 : 255 - length;
+    }
+    dirSumX = dirSumY = 0;
+    dirSamples = 0;
+#endif
+  }
+}
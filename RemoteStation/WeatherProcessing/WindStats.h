@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+// Wind statistics built from one second anemometer counts and the direction samples.
+// The gust is the highest 3 second running mean (as per the WMO definition) rather than
+// the shortest interval between ticks, which was very sensitive to noise on the line.
+// Everything is updated incrementally so the cost per sample doesn't depend on the interval.
+namespace WeatherProcessing
+{
+  constexpr byte gustSeconds = 3;
+  constexpr byte directionSectors = 16;
+  // Two sectors per byte
+  constexpr byte packedHistogramSize = directionSectors / 2;
+
+  struct WindStatistics
+  {
+    uint16_t gust_x2; // 0 until we've seen gustSeconds of wind
+    uint16_t speedStdDev_x2; // Of the one second speeds
+    byte directionVariability; // 0 = steady, 255 = no prevailing direction (or no samples)
+  };
+
+  // ISR context:
+  void windStatsCount();
+  void windStatsTick();
+
+  // Our direction bytes are 1/255ths of a turn, the trig wants 1/256ths.
+  inline byte directionToAngle(byte wd) { return ((unsigned short)wd * 257 + 128) >> 8; }
+
+  // angle is in 1/256ths of a turn
+  void addDirectionSample(byte angle);
+  // Returns the statistics since the last call and starts a new interval
+  void takeWindStatistics(WindStatistics& stats);
+  // The gust so far this interval, without starting a new one
+  uint16_t peekGust_x2();
+  // Speed weighted time in each 22.5 degree sector (sector 0 centred on north) since the last call.
+  // Each sector is a nibble, 15 = the busiest sector. Sector 0 is the low nibble of the first byte.
+  void takeDirectionHistogram(byte* packed);
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Makes the receiver's trace event dictionary from the X(Name, "First arg", "Second arg") list in Trace.h
+# Usage: gentrace.sh Trace.h ../dotNet_Receiver/dotNet_Receiver/Packets/TraceEvents.cs
+set -e
+IN=${1:-Trace.h}
+OUT=${2:-../dotNet_Receiver/dotNet_Receiver/Packets/TraceEvents.cs}
+
+{
+  printf '\357\273\277'
+  echo '// Generated from RemoteStation/Trace.h by gentrace.sh - edit that, not this.'
+  echo 'namespace core_Receiver.Packets'
+  echo '{'
+  echo '    static class TraceEvents'
+  echo '    {'
+  echo '        public static readonly (string Name, string A, string B)[] Events ='
+  echo '        {'
+  sed -n 's/^ *X(\([A-Za-z0-9_]*\), *\("[^"]*"\), *\("[^"]*"\)).*/            ("\1", \2, \3),/p' "$IN"
+  echo '        };'
+  echo '    }'
+  echo '}'
+} > "$OUT"
@@ -124,21 +124,23 @@ Standard message format is (MsgType)(StationID)(MessageID)[Message...]";
 (StationID)[Command...]
 A C type message with the next MessageID will be sent to (StationID) with contents [Command...].
 Command starting characters:
- R : Change relay settings.     : ((+|-)(W|C)(?<StationID>.))+
- I : Change reporting interval. : (shortInterval:4)(longInterval:4)
+ R : Change relay settings.     : ((+|-)(W|C)(?<StationID>.))+ or A(0|1) to pick relays automatically from what the station hears
+ I : Change reporting interval. : (shortInterval:4)(longInterval:4)[(heartbeatIntervals:1)(speedThreshold_x2:1)(gustThreshold_x2:1)(directionThreshold:1)]
  B : Change battery thresholds. : (new threshold in mV:2)(new emergency threshold mV:2)
- Q : Query station.             : QV for volatile data. QC for config data.
+ Q : Query station.             : QV for volatile data. QC for config data. QS for stack low water marks. QR for routes.
  O : Set Override interval.     : (L|S)(4 byte new interval)(H|M)
  M : Change radio settings.     : Same as modem. H6 for more info. (P|C|T|F|B|S|O)
- W : Change weather settings    : (C|O|G)(newValue) C: calibrate wind O: set temp offset G: set temp gain
+ W : Change weather settings    : (C|O|G|D|S)(newValue) C: calibrate wind O: set temp offset G: set temp gain D: delta encoded weather (0|1) S: record one second wind to flash (0|1)
  P : Reprogram station          : (Use programmer interface instead. )
  U : Change station ID          : UR for random. US(newID:1) to specify.
- C : Set charging parameters    : (charge voltage:2)(response rate:2)(freezing voltage:2)(freezing PWM:1)
+ C : Set charging parameters    : (charge voltage:2)(response rate:2)(freezing voltage:2)(freezing PWM:1)[(MPPT 0|1:1)]
  F : Force station to restart
- G : Read flash memory          : (R|W|E)(address:4)
+ G : Read flash memory          : (R|W|E)(address:4), T or C
                                 : R(address:4)(count:1)(I|E)? bytes to read, internal or external
                                 : W(address:4)[data...] external only, address > 32k
                                 : E(address:4) Erases 4kB. External only, address > 32k
+                                : T[(index:2)] Event trace (TRACE builds). The RAM ring, or records from index in the flash (TRACE_FLASH)
+                                : CH(first slot:1) Crash log headers. CB(slot:1)(part:1) 200 byte part of a crash record (0: details, 1-2: stack)
  D : Read message database      : (L|R)[Params:2]
                                 : L(type:1)(source:1) List all packets that match optional type/source filters.
                                 : R(address:2) Retrieve a packet. Address is header address from DL query.
@@ -153,7 +155,13 @@ Command starting characters:
  B : Bandwidth.        2 bytes  in HectoHertz (kHz * 10)
  S : Spreading Factor. 1 byte
  O : Outbound Preamble Length. 2 bytes
- I : Get radio stats. Modem only.";
+ E : Coding Rate.      1 byte   from 5 - 8 (4/5 - 4/8)
+ I : Get radio stats. Modem only.
+ H : Set hardware.     (flags:1)(freq:4)(bw:2)(sf:1)(cr:1)(preamble:2) Modem only.
+                       Zero fields are left unchanged. Flags: 1 = persist, 2 = revert to persisted first.
+                       Replies with the settings in use and the airtime per symbol and per byte.
+ K : Batch size.       1 byte   Maximum packets the modem puts in each extended frame.
+ D : Duplicate window. 2 bytes  in milliseconds. 0 disables. Repeats within the window are reported, not forwarded.";
 
 
         void HandleSimpleLine(string line, byte packetType)
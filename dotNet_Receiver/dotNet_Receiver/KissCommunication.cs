@@ -42,6 +42,13 @@ namespace core_Receiver
         ConcurrentDictionary<Stream, ConcurrentQueue<(byte[] data, byte writeType)>> _writeQueue =
             new ConcurrentDictionary<Stream, ConcurrentQueue<(byte[] data, byte writeType)>>();
 
+        // Number of frames, and bytes of frame data, the modem has told us it can accept. -1 until the modem reports,
+        // so TNCs that don't do flow control aren't held up. We count them down as we write, until the next report.
+        volatile int _modemFreeFrames = -1;
+        volatile int _modemFreeBytes = -1;
+        // The modem drops anything bigger (kissMaxFrameSize), so there's no point waiting for room for it.
+        const int ModemMaxFrameSize = 254;
+
         public TextWriter OutputWriter => Program.OutputWriter;
 
         public static IPEndPoint CreateIPEndPoint(string endPoint)
@@ -133,9 +140,19 @@ namespace core_Receiver
                 {
                     if (_disconnectRequested)
                         return -1;
-                    while (_writeQueue[stream].TryDequeue(out var toWrite))
+                    while (_writeQueue[stream].TryPeek(out var toWrite) && ModemHasRoom(toWrite.data.Length))
                     {
+                        _writeQueue[stream].TryDequeue(out toWrite);
+                        if (toWrite.data.Length > ModemMaxFrameSize && _modemFreeFrames >= 0)
+                        {
+                            StreamError?.Invoke($"Dropped a {toWrite.data.Length} byte frame, too big for the modem");
+                            continue;
+                        }
                         WriteStreamInternal(stream, toWrite.data, toWrite.writeType);
+                        if (_modemFreeFrames > 0)
+                            _modemFreeFrames--;
+                        if (_modemFreeBytes > 0)
+                            _modemFreeBytes = Math.Max(0, _modemFreeBytes - toWrite.data.Length);
                     }
                 }
             }
@@ -147,6 +164,7 @@ namespace core_Receiver
             bool inPacket = false;
             bool awaitingNull = false;
             bool corruptPacket = false;
+            bool extendedPacket = false;
             List<byte> curPacket = new List<byte>();
             if (!_writeQueue.TryAdd(stream, new ConcurrentQueue<(byte[] data, byte writeType)>()))
                 throw new InvalidOperationException($"Already connected to stream '{stream}.");
@@ -171,7 +189,17 @@ namespace core_Receiver
                         }
                         else if (inPacket && curPacket.Count > 0)
                         {
-                            PacketReceived?.Invoke(this, (curPacket, corruptPacket));
+                            if (extendedPacket)
+                                RaiseExtendedPackets(curPacket);
+                            else
+                            {
+                                if (!corruptPacket && IsFlowControl(curPacket))
+                                {
+                                    _modemFreeBytes = curPacket[5] | (curPacket[6] << 8);
+                                    _modemFreeFrames = curPacket[4];
+                                }
+                                PacketReceived?.Invoke(this, (curPacket, corruptPacket));
+                            }
                             curPacket.Clear();
                             inPacket = false;
                         }
@@ -186,12 +214,21 @@ namespace core_Receiver
                     {
                         inPacket = true;
                         corruptPacket = false;
+                        extendedPacket = false;
                         continue;
                     }
                     else if (curByte == 0x01)
                     {
                         inPacket = true;
                         corruptPacket = true;
+                        extendedPacket = false;
+                        continue;
+                    }
+                    else if (curByte == 0x02)
+                    {
+                        inPacket = true;
+                        corruptPacket = false;
+                        extendedPacket = true;
                         continue;
                     }
                 }
@@ -241,6 +278,52 @@ namespace core_Receiver
                 Console.Error.WriteLine("Unable to remove stream from write queue");
         }
 
+        // Extended frames hold one or more packets, each preceded by its metadata:
+        // (length:1)(flags:1)(rssi*2:2)(snr*4:1)(micros:4)(data...)
+        // Each packet is raised on its own, followed by a Stats packet so listeners see the same thing as from older modems.
+        private void RaiseExtendedPackets(List<byte> frame)
+        {
+            const int headerSize = 9;
+            int cur = 0;
+            while (cur + headerSize <= frame.Count)
+            {
+                int length = frame[cur];
+                if (cur + headerSize + length > frame.Count)
+                {
+                    StreamError?.Invoke("Truncated extended frame");
+                    return;
+                }
+                var header = frame.GetRange(cur, headerSize).ToArray();
+                bool crcMismatch = (header[1] & 0x01) != 0;
+                float rssi = BitConverter.ToInt16(header, 2) / 2.0f;
+                float snr = (sbyte)header[4] / 4.0f;
+                uint micros = BitConverter.ToUInt32(header, 5);
+
+                PacketReceived?.Invoke(this, (frame.GetRange(cur + headerSize, length), crcMismatch));
+
+                var stats = new List<byte> { (byte)'X', (byte)Packets.PacketTypes.Stats, 0, 0 };
+                stats.AddRange(BitConverter.GetBytes(rssi));
+                stats.AddRange(BitConverter.GetBytes(snr));
+                stats.AddRange(BitConverter.GetBytes(micros));
+                PacketReceived?.Invoke(this, (stats, false));
+
+                cur += headerSize + length;
+            }
+        }
+
+        bool ModemHasRoom(int length)
+        {
+            if (_modemFreeFrames < 0)
+                return true;
+            return _modemFreeFrames > 0 && (length > ModemMaxFrameSize || length <= _modemFreeBytes);
+        }
+
+        private static bool IsFlowControl(List<byte> packet)
+        {
+            return packet.Count >= 7 && packet[0] == (byte)'X' && packet[1] == (byte)Packets.PacketTypes.FlowControl
+                && packet[2] == 0 && packet[3] == 0;
+        }
+
         public void Write(byte[] data, byte writeType = 0x00)
         {
             if (!_writeQueue.Any())
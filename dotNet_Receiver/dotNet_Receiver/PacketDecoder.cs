@@ -57,12 +57,27 @@ namespace core_Receiver
                 case PacketTypes.Stats:
                     ret.packetData = new StatsResponse(bytes.AsSpan(dataStart));
                     break;
+                case PacketTypes.FlowControl:
+                    ret.packetData = new FlowControlResponse(bytes.AsSpan(dataStart));
+                    break;
+                case PacketTypes.Hardware:
+                    ret.packetData = new HardwareResponse(bytes.AsSpan(dataStart));
+                    break;
+                case PacketTypes.Duplicates:
+                    ret.packetData = new DuplicatesResponse(bytes.AsSpan(dataStart));
+                    break;
                 case PacketTypes.Weather:
                 case PacketTypes.Overflow2:
                     (ret.packetData, ret.exception) = DecodeWeatherPackets(bytes.AsSpan(cur), receivedTime);
                     ret.GetDataString =
                         data => (data as IList<SingleWeatherData>)?.ToCsv();
                     break;
+                case PacketTypes.WindSeries:
+                    ret.packetData = new WindSeriesRecord(bytes.AsSpan(dataStart));
+                    break;
+                case PacketTypes.StackDump:
+                    ret.packetData = new StackDump(bytes.AsSpan(dataStart));
+                    break;
                 case PacketTypes.Overflow:
                     (ret.packetData, ret.exception) = DecodeWeatherPackets(bytes.AsSpan(dataStart), receivedTime);
                     ret.GetDataString =
@@ -81,6 +96,10 @@ namespace core_Receiver
                                     ret.packetData = new QueryConfigResponse(bytes.AsSpan(dataStart + 1));
                                 else if (subType == 'V')
                                     ret.packetData = new QueryVolatileResponse(bytes.AsSpan(dataStart + 1));
+                                else if (subType == 'S')
+                                    ret.packetData = new QueryStackResponse(bytes.AsSpan(dataStart + 1));
+                                else if (subType == 'R')
+                                    ret.packetData = new QueryRouteResponse(bytes.AsSpan(dataStart + 1));
                                 break;
                             case 'P':
                                 ret.packetData = ProgrammingResponse.DecodeProgrammingResponse(bytes.AsSpan(dataStart));
@@ -94,6 +113,10 @@ namespace core_Receiver
                                     ret.packetData = bytes.AsSpan(dataStart + 1).ToArray();
                                     ret.GetDataString = Data => ((byte[])Data).ToCsv(b => b.ToString("X2"), " ");
                                 }
+                                else if (subType == 'T')
+                                    ret.packetData = new TraceResponse(bytes.AsSpan(dataStart + 1));
+                                else if (subType == 'C')
+                                    ret.packetData = new CrashLogResponse(bytes.AsSpan(dataStart + 1));
                                 break;
                             case 'D':
                                 if (subType == 'L')
@@ -151,6 +174,62 @@ namespace core_Receiver
         }
 
         public static HashSet<int> NtsStations { get; set; }
+        const int WindHistogramBytes = 8;
+        const byte DeltaLengthFlag = 0x80;
+
+        // The last full record from each station, which its delta records are relative to.
+        struct WeatherKeyframe
+        {
+            public byte UniqueID;
+            public byte Direction;
+            public byte Speed;
+            public byte Gust;
+        }
+        static readonly Dictionary<byte, WeatherKeyframe> Keyframes = new Dictionary<byte, WeatherKeyframe>();
+
+        static int Nibble(int b) => ((sbyte)(b << 4)) >> 4;
+
+        // (0x80 | Length)(Age:4 DirDelta/2:4)(SpeedDelta:4 GustDelta:4)(Seconds)[(Battery)[(ExtTemp)]]
+        // Returns null if we don't have the keyframe it refers to.
+        private static SingleWeatherData DecodeDeltaWeatherPacket(
+            Span<byte> data, int packetLen, DateTimeOffset now)
+        {
+            if (packetLen < 6)
+                throw new InvalidDataException("Delta weather packet too short");
+            int cur = 3;
+            byte sendingStation = data[0];
+            byte uniqueID = data[1];
+            int age = data[cur] & 0x0F;
+            int dDirection = Nibble(data[cur++] >> 4) * 2;
+            int dSpeed = Nibble(data[cur]);
+            int dGust = Nibble(data[cur++] >> 4);
+
+            if (!Keyframes.TryGetValue(sendingStation, out var keyframe) ||
+                (byte)(uniqueID - age) != keyframe.UniqueID)
+                return null;
+
+            SingleWeatherData ret = new SingleWeatherData()
+            {
+                sendingStation = sendingStation,
+                uniqueID = uniqueID,
+                windDirection = GetWindDirection((byte)(keyframe.Direction + dDirection)),
+                windSpeed = GetWindSpeed((byte)(keyframe.Speed + dSpeed)),
+                gust = GetWindSpeed((byte)(keyframe.Gust + dGust))
+            };
+            if (NtsStations == null || !NtsStations.Contains(ret.sendingStation))
+            {
+                ret.timestampByte = data[cur++];
+                ret.timeStamp = GetTimeStamp(ret.timestampByte.Value, now);
+            }
+            else
+                cur++;
+            if (packetLen > cur)
+                ret.batteryLevelH = data[cur++] / 255.0 * 7.5;
+            if (packetLen > cur)
+                ret.externalTemp = GetTemp(data[cur++]);
+            return ret;
+        }
+
         //static HashSet<int> timestampStations = new HashSet<int> { 49, 50, 51, 54, 68, 71 };
         private static SingleWeatherData DecodeWeatherPacket(
             Span<byte> data, out int packetLen, DateTimeOffset now)
@@ -163,6 +242,9 @@ namespace core_Receiver
 
             int cur = 3;
             var len = data[2];
+            bool isDelta = (len & DeltaLengthFlag) != 0;
+            if (isDelta)
+                len = (byte)(len & ~DeltaLengthFlag);
             packetLen = len + 3; // +3: Station ID, message ID, length
 
             if (packetLen > data.Length)
@@ -170,9 +252,22 @@ namespace core_Receiver
                 var easyReading = data.ToArray().ToCsv(b => $"{b:X2} {GetChar(b)}");
                 throw new InvalidDataException("invalid packet length.");
             }
+            if (isDelta)
+                return DecodeDeltaWeatherPacket(data, packetLen, now);
             if (packetLen < 5)
                 throw new InvalidDataException("No weather packets");
 
+            if (packetLen >= 6)
+            {
+                Keyframes[data[0]] = new WeatherKeyframe
+                {
+                    UniqueID = data[1],
+                    Direction = data[3],
+                    Speed = data[4],
+                    Gust = data[5]
+                };
+            }
+
             SingleWeatherData ret = new SingleWeatherData()
             {
                 sendingStation = data[0],
@@ -216,6 +311,40 @@ namespace core_Receiver
                     ret.lastErrorCode = BitConverter.ToInt16(data.Slice(cur));
                     cur += sizeof(UInt16);
                 }
+                //Newer stations always send the error pair, with zeros if there's nothing new:
+                if (ret.lastErrorCode == 0)
+                {
+                    ret.lastErrorCode = null;
+                    ret.lastErrorTSShort = null;
+                    ret.lastErrorTimestamp = null;
+                }
+                if (packetLen > cur + 1)
+                {
+                    ret.windSpeedStdDev = GetWindSpeed(data[cur++]);
+                    ret.directionVariability = data[cur++] / 255.0;
+                }
+                //16 sector wind rose, a nibble each, sector 0 (north) in the low nibble:
+                if (packetLen >= cur + WindHistogramBytes)
+                {
+                    ret.directionHistogram = new byte[WindHistogramBytes * 2];
+                    for (int i = 0; i < WindHistogramBytes; i++)
+                    {
+                        ret.directionHistogram[2 * i] = (byte)(data[cur] & 0x0F);
+                        ret.directionHistogram[2 * i + 1] = (byte)(data[cur] >> 4);
+                        cur++;
+                    }
+                }
+                if (packetLen > cur)
+                {
+                    byte heartbeat = data[cur++];
+                    if (heartbeat != 0)
+                        ret.heartbeatSeconds = heartbeat * 4;
+                }
+                if (packetLen > cur + 1)
+                {
+                    ret.routeCost = data[cur++];
+                    ret.routeNextHop = data[cur++];
+                }
             }
             if (packetLen > cur)
                 ret.extras = data[cur..packetLen].ToArray(); //8 (^9)
@@ -238,8 +367,12 @@ namespace core_Receiver
                 try
                 {
                     var packet = DecodeWeatherPacket(bytes.Slice(cur), out var len, now);
+                    //Deltas against a keyframe we missed can't be decoded, but we can skip over them.
                     if (packet == null)
-                        throw new NullReferenceException("Decode Weather Packet returned null");
+                    {
+                        cur += len;
+                        continue;
+                    }
                     // Something wrong with R packets... temporary fix
                     /*if (packet.sendingStation < 49 || packet.sendingStation > 80 || packet.extras?.Length > 5)
                         break;*/
@@ -0,0 +1,159 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    /// <summary>
+    /// FC: the station's log of watchdog crashes (CrashLog.h).
+    /// FCH(First:1)(Header:32)... lists the slots, FCB(Slot:1)(Part:1)(Bytes...) is part of one record.
+    /// </summary>
+    class CrashLogResponse
+    {
+        public const int RecordSize = 512;
+        public const int PartSize = 200;
+        public const int HeaderSize = 32;
+        const ushort Magic = 0x5AC3;
+
+        public class Header
+        {
+            public int Slot { get; set; }
+            public ushort Number { get; set; }
+            public string Revision { get; set; }
+            /// <summary>
+            /// Byte address the watchdog interrupted, as in the disassembly.
+            /// </summary>
+            public int PC { get; set; }
+            public ushort StackPointer { get; set; }
+            public byte MCUSR { get; set; }
+            public string BatteryMode { get; set; }
+            public DateTimeOffset Time { get; set; }
+            public TimeSpan Uptime { get; set; }
+            public byte StackSections { get; set; }
+            public byte TraceRecords { get; set; }
+            public byte TraceNext { get; set; }
+            public byte StackSize { get; set; }
+            public byte MillisPerTick { get; set; }
+            public byte TicksTop { get; set; }
+
+            static readonly string[] BatteryModes = { "Normal", "Save", "DeepSleep", "Stasis" };
+
+            /// <summary>
+            /// Null for an empty slot
+            /// </summary>
+            public static Header Read(Span<byte> data, int slot)
+            {
+                if (BitConverter.ToUInt16(data) != Magic)
+                    return null;
+                return new Header
+                {
+                    Slot = slot,
+                    Number = BitConverter.ToUInt16(data.Slice(2)),
+                    Revision = Encoding.ASCII.GetString(data.Slice(4, 8)).TrimEnd('\0'),
+                    PC = BitConverter.ToUInt16(data.Slice(12)) * 2,
+                    StackPointer = BitConverter.ToUInt16(data.Slice(14)),
+                    MCUSR = data[16],
+                    BatteryMode = data[17] < BatteryModes.Length ? BatteryModes[data[17]] : data[17].ToString(),
+                    Time = DateTimeOffset.FromUnixTimeSeconds(BitConverter.ToUInt32(data.Slice(18))).ToLocalTime(),
+                    Uptime = TimeSpan.FromSeconds(BitConverter.ToUInt32(data.Slice(22))),
+                    StackSections = data[26],
+                    TraceRecords = data[27],
+                    TraceNext = data[28],
+                    StackSize = data[29],
+                    MillisPerTick = data[30],
+                    TicksTop = data[31],
+                };
+            }
+
+            public override string ToString()
+                => $"#{Number} (slot {Slot}) {Time:yyyy-MM-dd HH:mm:ss} Up:{Uptime} Rev:{Revision} PC:{PC:X4} SP:{StackPointer:X4} MCUSR:{MCUSR:X2} Mode:{BatteryMode}";
+        }
+
+        public char Type { get; set; }
+        public List<Header> Headers { get; } = new List<Header>();
+
+        public int Slot { get; set; }
+        public int Part { get; set; }
+        public byte[] Bytes { get; set; }
+        /// <summary>
+        /// From part 0
+        /// </summary>
+        public Header RecordHeader { get; set; }
+        public ushort[] LowWater { get; set; }
+        public List<TraceResponse.Record> Trace { get; set; }
+
+        public CrashLogResponse(Span<byte> data)
+        {
+            Type = (char)data[0];
+            Slot = data[1];
+            if (Type == 'H')
+            {
+                for (int i = 0; (i + 1) * HeaderSize <= data.Length - 2; i++)
+                {
+                    var header = Header.Read(data.Slice(2 + i * HeaderSize, HeaderSize), Slot + i);
+                    if (header != null)
+                        Headers.Add(header);
+                }
+                return;
+            }
+            Part = data[2];
+            Bytes = data.Slice(3).ToArray();
+            if (Part != 0)
+                return;
+            RecordHeader = Header.Read(Bytes, Slot);
+            if (RecordHeader == null)
+                return;
+            int offset = HeaderSize;
+            LowWater = new ushort[RecordHeader.StackSections];
+            for (int i = 0; i < LowWater.Length; i++, offset += 2)
+                LowWater[i] = BitConverter.ToUInt16(Bytes, offset);
+            Trace = new List<TraceResponse.Record>();
+            for (int i = 0; i < RecordHeader.TraceRecords; i++, offset += TraceResponse.RecordSize)
+            {
+                var record = TraceResponse.ReadRecord(Bytes.AsSpan(offset, TraceResponse.RecordSize),
+                    RecordHeader.MillisPerTick, RecordHeader.TicksTop + 1);
+                // Slots the ring hadn't got to yet
+                if (record.Sequence == (byte)(RecordHeader.TraceNext - RecordHeader.TraceRecords + i))
+                    Trace.Add(record);
+            }
+        }
+
+        /// <summary>
+        /// Words on the stack that could be return addresses (byte addresses, to look up in the disassembly).
+        /// The stack starts at the beginning of part 1, and the first one there is where the watchdog caught us.
+        /// Anything can look like an address, so check them against the code.
+        /// </summary>
+        public IEnumerable<int> CandidateReturnAddresses()
+        {
+            if (Part == 0)
+                yield break;
+            for (int i = 0; i + 1 < Bytes.Length; i++)
+            {
+                int address = (Bytes[i] << 8 | Bytes[i + 1]) * 2;
+                if (address > 0 && address < 0x7000)
+                    yield return address;
+            }
+        }
+
+        public override string ToString()
+        {
+            if (Type == 'H')
+                return $"CRASH LOG from slot {Slot}:\n" + (Headers.Count > 0 ? Headers.ToCsv(h => h.ToString(), "\n") : "(Empty)");
+            var ret = $"CRASH RECORD slot {Slot} part {Part}:";
+            if (RecordHeader != null)
+            {
+                ret += $"\n{RecordHeader}\nLow Water: {QueryStackResponse.LowWaterString(LowWater)}";
+                if (Trace.Count > 0)
+                    ret += "\n" + Trace.ToCsv(r => r.ToString(), "\n");
+            }
+            else
+            {
+                ret += " " + Bytes.ToCsv(b => b.ToString("X2"), " ");
+                if (Part > 0)
+                    ret += "\nCandidate return addresses: " + CandidateReturnAddresses().ToCsv(a => a.ToString("X4"), " ");
+            }
+            return ret;
+        }
+    }
+}
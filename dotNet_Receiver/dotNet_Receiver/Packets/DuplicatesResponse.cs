@@ -0,0 +1,41 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    class DuplicatesResponse
+    {
+        public DuplicatesResponse(Span<byte> data)
+        {
+            using MemoryStream ms = new MemoryStream();
+            ms.Write(data);
+            ms.Seek(0, SeekOrigin.Begin);
+            BinaryReader br = new BinaryReader(ms, Encoding.ASCII);
+
+            Type = (PacketTypes)br.ReadByte();
+            StationID = br.ReadByte();
+            UniqueID = br.ReadByte();
+            Count = br.ReadByte();
+            while (ms.Length - ms.Position >= 2)
+                RSSIs.Add(br.ReadInt16() / 2.0f);
+        }
+
+        public PacketTypes Type { get; set; }
+        public byte StationID { get; set; }
+        public byte UniqueID { get; set; }
+        public byte Count { get; set; }
+        /// <summary>
+        /// The first few copies only, starting with the one that was forwarded.
+        /// </summary>
+        public List<float> RSSIs { get; } = new List<float>();
+
+        public override string ToString()
+        {
+            return $"Modem: {Type} from {StationID} ({UniqueID}) heard {Count} times, " +
+                $"RSSIs {string.Join(", ", RSSIs.Select(r => r.ToString("F1")))}";
+        }
+    }
+}
@@ -0,0 +1,31 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    class FlowControlResponse
+    {
+        public FlowControlResponse(Span<byte> data)
+        {
+            using MemoryStream ms = new MemoryStream();
+            ms.Write(data);
+            ms.Seek(0, SeekOrigin.Begin);
+            BinaryReader br = new BinaryReader(ms, Encoding.ASCII);
+
+            FreeFrames = br.ReadByte();
+            FreeBytes = br.ReadUInt16();
+            InboundWaiting = br.ReadByte();
+        }
+
+        public byte FreeFrames { get; set; }
+        public ushort FreeBytes { get; set; }
+        public byte InboundWaiting { get; set; }
+
+        public override string ToString()
+        {
+            return $"Modem: Free frames {FreeFrames}, Free bytes {FreeBytes}, Inbound waiting {InboundWaiting}";
+        }
+    }
+}
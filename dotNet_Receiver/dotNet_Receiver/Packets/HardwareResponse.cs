@@ -0,0 +1,43 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    class HardwareResponse
+    {
+        public HardwareResponse(Span<byte> data)
+        {
+            using MemoryStream ms = new MemoryStream();
+            ms.Write(data);
+            ms.Seek(0, SeekOrigin.Begin);
+            BinaryReader br = new BinaryReader(ms, Encoding.ASCII);
+
+            State = br.ReadInt16();
+            Frequency = br.ReadUInt32();
+            Bandwidth = br.ReadUInt16() / 10.0;
+            SpreadingFactor = br.ReadByte();
+            CodingRate = br.ReadByte();
+            OutboundPreambleLength = br.ReadUInt16();
+            SymbolTime = br.ReadUInt32();
+            ByteAirtime = br.ReadUInt32();
+        }
+
+        public short State { get; set; }
+        public uint Frequency { get; set; }
+        public double Bandwidth { get; set; }
+        public byte SpreadingFactor { get; set; }
+        public byte CodingRate { get; set; }
+        public ushort OutboundPreambleLength { get; set; }
+        public uint SymbolTime { get; set; }
+        public uint ByteAirtime { get; set; }
+
+        public override string ToString()
+        {
+            return $"Modem: {(State == 0 ? "OK" : $"Error {State}")}, " +
+                $"{Frequency / 1e6:F3} MHz, BW {Bandwidth} kHz, SF {SpreadingFactor}, CR 4/{CodingRate}, " +
+                $"Preamble {OutboundPreambleLength}, Symbol {SymbolTime / 1000.0} ms, {ByteAirtime / 1000.0} ms/byte";
+        }
+    }
+}
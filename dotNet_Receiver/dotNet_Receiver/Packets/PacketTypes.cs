@@ -9,6 +9,9 @@ namespace core_Receiver.Packets
         Unknown = 0,
         Modem = 6,
         Stats = 7,
+        FlowControl = 8,
+        Hardware = 9,
+        Duplicates = 10,
         Weather = (byte)'W',
         Overflow = (byte)'R',
         Overflow2 = (byte)'Q',
@@ -16,5 +19,6 @@ namespace core_Receiver.Packets
         Response = (byte)'K',
         Ping = (byte)'P',
         StackDump = (byte)'S',
+        WindSeries = (byte)'T',
     }
 }
@@ -0,0 +1,81 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    /// <summary>
+    /// QR: what the station has learnt about getting to the base (Routing.h on the station)
+    /// </summary>
+    class QueryRouteResponse : QueryResponse
+    {
+        public const byte NoRoute = 0xFF;
+
+        public QueryRouteResponse(Span<byte> data)
+            : base(data, out int consumed)
+        {
+            var d = data.Slice(consumed);
+            AutoRoute = d[0] != 0;
+            Cost = d[1];
+            NextHop = d[2];
+            BaseLinkCost = d[3];
+            int cur = 4;
+            int count = d[cur++];
+            Neighbours = new Neighbour[count];
+            for (int i = 0; i < count; i++, cur += 4)
+                Neighbours[i] = new Neighbour
+                {
+                    ID = d[cur].ToChar(),
+                    LinkCost = d[cur + 1],
+                    Cost = d[cur + 2],
+                    NextHop = d[cur + 3]
+                };
+            count = d[cur++];
+            Downstream = d.Slice(cur, count).ToArray().Select(b => b.ToChar()).ToArray();
+        }
+
+        public class Neighbour
+        {
+            public char ID { get; set; }
+            /// <summary>
+            /// What the station thinks of its link to them, from how well it hears them
+            /// </summary>
+            public byte LinkCost { get; set; }
+            /// <summary>
+            /// What they told us it costs them to get to the base
+            /// </summary>
+            public byte Cost { get; set; }
+            public byte NextHop { get; set; }
+        }
+
+        public bool AutoRoute { get; set; }
+        /// <summary>
+        /// To the base, through NextHop. 255 if there's no route.
+        /// </summary>
+        public byte Cost { get; set; }
+        /// <summary>
+        /// 0 is the base
+        /// </summary>
+        public byte NextHop { get; set; }
+        /// <summary>
+        /// From the last ping the station heard straight from the base. 255 if it hasn't lately.
+        /// </summary>
+        public byte BaseLinkCost { get; set; }
+        public Neighbour[] Neighbours { get; set; }
+        /// <summary>
+        /// Stations whose weather the station's children have passed to it
+        /// </summary>
+        public char[] Downstream { get; set; }
+
+        static string HopString(byte hop)
+            => hop == 0 ? "Base" : hop.ToChar().ToString();
+        static string CostString(byte cost)
+            => cost == NoRoute ? "-" : cost.ToString();
+
+        public override string ToString()
+            => $"ROUTE Version:{Version} Auto:{AutoRoute} Cost:{CostString(Cost)} Via:{HopString(NextHop)} Base Link:{CostString(BaseLinkCost)}"
+            + $" Neighbours: {Neighbours.Select(n => $"{n.ID}(Link:{n.LinkCost} Cost:{CostString(n.Cost)} Via:{HopString(n.NextHop)})").ToCsv()}"
+            + $" Downstream: {new string(Downstream)}";
+    }
+}
@@ -0,0 +1,48 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    /// <summary>
+    /// QS: the stack low water marks. Keep StackSections in sync with StackSection in StackCanary.h
+    /// </summary>
+    class QueryStackResponse : QueryResponse
+    {
+        public static readonly string[] StackSections = { "Other", "Messages", "Database", "Weather", "Programming" };
+
+        public QueryStackResponse(Span<byte> data)
+            : base(data, out int consumed)
+        {
+            LowWater = ReadLowWater(data.Slice(consumed), out _);
+        }
+
+        /// <summary>
+        /// Bytes of canary left under each section. 0xFFFF if it hasn't run since the station started.
+        /// </summary>
+        public ushort[] LowWater { get; set; }
+
+        /// <summary>
+        /// (Count:1)(LowWater:2)...
+        /// </summary>
+        public static ushort[] ReadLowWater(Span<byte> data, out int consumed)
+        {
+            int count = data[0];
+            var ret = new ushort[count];
+            for (int i = 0; i < count; i++)
+                ret[i] = BitConverter.ToUInt16(data.Slice(1 + 2 * i, 2));
+            consumed = 1 + 2 * count;
+            return ret;
+        }
+
+        public static string SectionName(int i)
+            => i < StackSections.Length ? StackSections[i] : $"Section{i}";
+
+        public static string LowWaterString(ushort[] lowWater)
+            => lowWater.Select((lw, i) => $"{SectionName(i)}:{(lw == 0xFFFF ? "-" : lw.ToString())}").ToCsv();
+
+        public override string ToString()
+            => $"STACK Version:{Version} Low Water: {LowWaterString(LowWater)}";
+    }
+}
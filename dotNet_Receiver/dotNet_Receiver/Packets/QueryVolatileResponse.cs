@@ -49,9 +49,11 @@ namespace core_Receiver.Packets
             }
             CheckZeroMarker();
             CheckMarker('S');
+            var seenOrder = new List<byte>();
             for (i = 0; i < ArraySize; i++)
             {
                 byte stationID = br.ReadByte();
+                seenOrder.Add(stationID);
                 if (!constantArraySize && stationID == 0)
                     break;
                 UInt32 seenMillis = br.ReadUInt32();
@@ -129,6 +131,25 @@ namespace core_Receiver.Packets
                 ushort repeatShort = br.ReadUInt16();
                 RelayRepeatRate = repeatShort / (double)0xFFFF;
             }
+
+            //Heartbeats, parallel to the recently seen stations:
+            if (ms.Length - ms.Position >= ArraySize)
+            {
+                for (i = 0; i < ArraySize; i++)
+                {
+                    byte heartbeat = br.ReadByte();
+                    if (i >= seenOrder.Count)
+                        continue;
+                    byte stationID = seenOrder[i];
+                    int idx = RecentlySeenStations.FindIndex(s => s.Id == stationID);
+                    if (stationID != 0 && idx >= 0 && heartbeat != 0)
+                    {
+                        var station = RecentlySeenStations[idx];
+                        station.HeartbeatSeconds = heartbeat * 4;
+                        RecentlySeenStations[idx] = station;
+                    }
+                }
+            }
         }
 
         public UInt32 Millis { get; set; }
@@ -145,9 +166,11 @@ namespace core_Receiver.Packets
             public DateTimeOffset Date;
             public double RSSI;
             public double SNR;
+            public int? HeartbeatSeconds;
 
             public override string ToString()
-                => $"{Id.ToChar()}:{RSSI:F1}/{SNR:F2}/{Age / 1000.0:F1}";
+                => $"{Id.ToChar()}:{RSSI:F1}/{SNR:F2}/{Age / 1000.0:F1}"
+                + (HeartbeatSeconds.HasValue ? $"/HB{HeartbeatSeconds}" : "");
         }
         public List<RecentlySeenStation> RecentlySeenStations { get; set; } = new List<RecentlySeenStation>();
 
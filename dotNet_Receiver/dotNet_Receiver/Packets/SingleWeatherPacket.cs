@@ -1,5 +1,6 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.Linq;
 using System.Text;
 
 namespace core_Receiver.Packets
@@ -23,6 +24,12 @@ namespace core_Receiver.Packets
         public ushort? lastErrorTSShort;
         public DateTimeOffset? lastErrorTimestamp;
         public short? lastErrorCode;
+        public double? windSpeedStdDev;
+        public double? directionVariability; // 0 = steady, 1 = no prevailing direction
+        public byte[] directionHistogram; // 16 sectors from north, 0-15 relative to the busiest
+        public int? heartbeatSeconds; // The station may go this long without reporting when nothing changes
+        public byte? routeCost; // 255: the station isn't routing (Routing.h)
+        public byte? routeNextHop; // 0 is the base
 
         public override string ToString()
         {
@@ -39,6 +46,16 @@ namespace core_Receiver.Packets
                 ret += $" PWM:{pwmValue:X}";
             if (current.HasValue)
                 ret += $" Cur:{current}";
+            if (windSpeedStdDev.HasValue)
+                ret += $" SD:{windSpeedStdDev:F1}";
+            if (directionVariability.HasValue)
+                ret += $" DV:{directionVariability:F2}";
+            if (directionHistogram != null)
+                ret += $" Rose:{string.Concat(directionHistogram.Select(b => b.ToString("X")))}";
+            if (heartbeatSeconds.HasValue)
+                ret += $" HB:{heartbeatSeconds}s";
+            if (routeCost.HasValue && routeCost != 255)
+                ret += $" Route:{routeCost}>{(routeNextHop == 0 ? "Base" : ((char)routeNextHop).ToString())}";
             if (timeStamp.HasValue)
                 ret += $" Delay:{(DateTimeOffset.Now - timeStamp).Value.TotalSeconds:F0}s";
             if (lastErrorCode.HasValue)
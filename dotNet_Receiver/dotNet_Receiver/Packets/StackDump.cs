@@ -0,0 +1,38 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    /// <summary>
+    /// Sent (and stored) after the watchdog caught the station. See sendStackTrace in ArduinoWeatherStation.cpp
+    /// (SP:2)[(Count:1)(LowWater:2)...](Stack...) - the low water marks are there if SP has its top bit set.
+    /// </summary>
+    class StackDump
+    {
+        public StackDump(Span<byte> data)
+        {
+            ushort sp = BitConverter.ToUInt16(data.Slice(0, 2));
+            int consumed = 2;
+            if ((sp & 0x8000) != 0)
+            {
+                LowWater = QueryStackResponse.ReadLowWater(data.Slice(2), out int lowWaterSize);
+                consumed += lowWaterSize;
+            }
+            StackPointer = (ushort)(sp & 0x7FFF);
+            Stack = data.Slice(consumed).ToArray();
+        }
+
+        public ushort StackPointer { get; set; }
+        /// <summary>
+        /// Null from older firmware
+        /// </summary>
+        public ushort[] LowWater { get; set; }
+        public byte[] Stack { get; set; }
+
+        public override string ToString()
+            => $"SP:{StackPointer:X4}"
+            + (LowWater != null ? $" Low Water: {QueryStackResponse.LowWaterString(LowWater)}" : "")
+            + $" Stack: {Stack.ToCsv(b => b.ToString("X2"), " ")}";
+    }
+}
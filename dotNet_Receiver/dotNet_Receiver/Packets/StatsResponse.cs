@@ -18,13 +18,22 @@ namespace core_Receiver.Packets
             SNR = br.ReadSingle();
             if (SNR >= 128 / 4)
                 SNR -= 256/4;
+            // Only present when the modem sends extended frames:
+            if (ms.Length - ms.Position >= 4)
+                ReceivedMicros = br.ReadUInt32();
         }
 
         public float RSSI { get; set; }
         public float SNR { get; set; }
+        /// <summary>
+        /// Modem's micros() when the packet was received. Wraps every 71 minutes.
+        /// </summary>
+        public uint? ReceivedMicros { get; set; }
 
         public override string ToString()
         {
+            if (ReceivedMicros.HasValue)
+                return $"Modem: RSSI {RSSI:F1}, SNR {SNR:F1}, Received {ReceivedMicros} us";
             return $"Modem: RSSI {RSSI:F1}, SNR {SNR:F1}";
         }
     }
@@ -0,0 +1,20 @@
+﻿// Generated from RemoteStation/Trace.h by gentrace.sh - edit that, not this.
+namespace core_Receiver.Packets
+{
+    static class TraceEvents
+    {
+        public static readonly (string Name, string A, string B)[] Events =
+        {
+            ("Boot", "MCUSR", "Old SP"),
+            ("Received", "Type", "Station"),
+            ("Command", "Command", "Handled"),
+            ("Relayed", "Type", "Station"),
+            ("WeatherSent", "Battery mV", "Relayed bytes"),
+            ("TimeStep", "Step ms", "Drift"),
+            ("BatteryModeChange", "Mode", "Battery mV"),
+            ("Error", "Code", ""),
+            ("NoPing", "Minutes since ping", ""),
+            ("RouteChange", "Next hop", "Cost"),
+        };
+    }
+}
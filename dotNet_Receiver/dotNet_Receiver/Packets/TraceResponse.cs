@@ -0,0 +1,85 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    /// <summary>
+    /// FT: records from the station's event trace (Trace.h), named from TraceEvents.
+    /// </summary>
+    class TraceResponse
+    {
+        public class Record
+        {
+            public byte Event { get; set; }
+            public byte Sequence { get; set; }
+            /// <summary>
+            /// Milliseconds, wrapping every 256 timer ticks.
+            /// </summary>
+            public int Time_ms { get; set; }
+            public ushort A { get; set; }
+            public ushort B { get; set; }
+
+            public override string ToString()
+            {
+                if (Event < TraceEvents.Events.Length)
+                {
+                    var (name, aName, bName) = TraceEvents.Events[Event];
+                    var ret = $"#{Sequence} {Time_ms}ms {name}";
+                    if (aName != "")
+                        ret += $" {aName}:{A}";
+                    if (bName != "")
+                        ret += $" {bName}:{B}";
+                    return ret;
+                }
+                return $"#{Sequence} {Time_ms}ms Event{Event} {A} {B}";
+            }
+        }
+
+        public bool FromFlash { get; set; }
+        public byte NextSequence { get; set; }
+        public List<Record> Records { get; } = new List<Record>();
+
+        /// <summary>
+        /// (MillisPerTick:2)(TicksTop:2)(Source:1)(NextSequence:1)((Event:1)(Sequence:1)(Time:2)(A:2)(B:2))...
+        /// </summary>
+        public TraceResponse(Span<byte> data)
+        {
+            int millisPerTick = BitConverter.ToUInt16(data.Slice(0, 2));
+            int ticksTop = BitConverter.ToUInt16(data.Slice(2, 2));
+            FromFlash = data[4] == 'F';
+            NextSequence = data[5];
+            int count = (data.Length - 6) / RecordSize;
+            for (int i = 0; i < count; i++)
+            {
+                var r = data.Slice(6 + i * RecordSize, RecordSize);
+                // Erased flash
+                if (r[0] == 0xFF)
+                    continue;
+                // The ring comes oldest first. A slot that doesn't hold the record we expect has never been written.
+                if (!FromFlash && r[1] != (byte)(NextSequence - count + i))
+                    continue;
+                Records.Add(ReadRecord(r, millisPerTick, ticksTop));
+            }
+        }
+
+        public const int RecordSize = 8;
+
+        /// <summary>
+        /// (Event:1)(Sequence:1)(Time:2)(A:2)(B:2)
+        /// </summary>
+        public static Record ReadRecord(Span<byte> r, int millisPerTick, int ticksTop)
+            => new Record
+            {
+                Event = r[0],
+                Sequence = r[1],
+                Time_ms = r[3] * millisPerTick + r[2] * millisPerTick / ticksTop,
+                A = BitConverter.ToUInt16(r.Slice(4, 2)),
+                B = BitConverter.ToUInt16(r.Slice(6, 2)),
+            };
+
+        public override string ToString()
+            => $"TRACE {(FromFlash ? "Flash" : "Ring")} Next:{NextSequence}\n" + Records.ToCsv(r => r.ToString(), "\n");
+    }
+}
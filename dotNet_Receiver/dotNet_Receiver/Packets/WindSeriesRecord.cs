@@ -0,0 +1,27 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace core_Receiver.Packets
+{
+    // One second wind from a station's flash database ('T' records, retrieved with DR)
+    class WindSeriesRecord
+    {
+        public DateTimeOffset StartTime { get; set; }
+        public List<(double speed, double direction)> Samples { get; } = new List<(double speed, double direction)>();
+
+        public WindSeriesRecord(Span<byte> data)
+        {
+            StartTime = DateTimeOffset.FromUnixTimeSeconds(BitConverter.ToUInt32(data));
+            ushort speedConstant = BitConverter.ToUInt16(data.Slice(4));
+            for (int i = 6; i + 1 < data.Length; i += 2)
+                Samples.Add((data[i] * speedConstant / 1000.0, data[i + 1] * 360 / 256.0));
+        }
+
+        public override string ToString()
+        {
+            return $"Wind Series from {StartTime.ToLocalTime()} ({Samples.Count} s):" + Environment.NewLine +
+                Samples.ToCsv(s => $"{s.speed:F1}/{s.direction:F0}", " ");
+        }
+    }
+}
@@ -38,6 +38,7 @@ Arguments:
  --noping               Specify that the software should not send pings
  --logWeather           Specify that the local db will store weather packets
  --nts <list>           [Temporary] List of stations that do not send timestamped messages (pre-2.5)
+ --stackReport <DB.sqlite> Print the stack low water marks in a local database by firmware version, then exit.
 "
 );
         }
@@ -58,10 +59,12 @@ Arguments:
         static string _npsFn = null;
         static int _offset = 0;
         static bool _logWeather = false;
+        static string _stackReportFn = null;
 
         static readonly CancellationTokenSource _exitingSource = new CancellationTokenSource();
 
-        static void ParseArgs(string[] args)
+        // False if the arguments don't make sense
+        static bool ParseArgs(string[] args)
         {
             var dbIndex = Array.FindIndex(args, arg => arg.Equals("--db", StringComparison.OrdinalIgnoreCase));
             if (dbIndex >= 0)
@@ -129,6 +132,18 @@ Arguments:
 
             if (args.Contains("--noPing", StringComparer.OrdinalIgnoreCase))
                 _sendPing = false;
+
+            var stackReportIndex = Array.FindIndex(args, arg => arg.Equals("--stackReport", StringComparison.OrdinalIgnoreCase));
+            if (stackReportIndex >= 0)
+            {
+                if (stackReportIndex + 1 >= args.Length || args[stackReportIndex + 1].StartsWith("--"))
+                {
+                    ErrorWriter.WriteLine("--stackReport needs a database file.");
+                    return false;
+                }
+                _stackReportFn = args[stackReportIndex + 1];
+            }
+            return true;
         }
 
         static void Main(string[] args)
@@ -149,7 +164,17 @@ Arguments:
             AppDomain.CurrentDomain.UnhandledException += CurrentDomain_UnhandledException;
             AppDomain.CurrentDomain.ProcessExit += CurrentDomain_ProcessExit;
 
-            ParseArgs(args);
+            if (!ParseArgs(args))
+            {
+                Help();
+                return;
+            }
+
+            if (_stackReportFn != null)
+            {
+                StackReport.Generate(_stackReportFn, OutputWriter);
+                return;
+            }
 
             PacketDecoder.NtsStations = _ntsStations;
 
@@ -341,7 +366,7 @@ Arguments:
                 }
                 //Do this in a Task to avoid waiting if we've scrolled up.
                 Task consoleTask = null;
-                if (packet.type != PacketTypes.Stats)
+                if (packet.type != PacketTypes.Stats && packet.type != PacketTypes.FlowControl)
                     consoleTask = Task.Run(async () =>
                     {
                         // Delay for 100ms to allow the modem to send through RSSI & SNR
@@ -366,7 +391,12 @@ Arguments:
                     case PacketTypes.Command:
                     case PacketTypes.Ping:
                     case PacketTypes.Modem:
+                    case PacketTypes.Hardware:
+                    case PacketTypes.Duplicates:
                         break;
+                    case PacketTypes.FlowControl:
+                        // Handled by KissCommunication, and doesn't belong to any other packet
+                        return;
                     case PacketTypes.Stats:
                         if (_lastPacket != null)
                         {
@@ -383,7 +413,8 @@ Arguments:
                         consoleTask.ContinueWith(notUsed => WriteUndecipherablePacket(receivedTime.LocalDateTime, localBytes, corrupt));
                         break;
                 }
-                _lastPacket = packet.type == PacketTypes.Stats || packet.type == PacketTypes.Modem ? null : packet;
+                _lastPacket = packet.type == PacketTypes.Stats || packet.type == PacketTypes.Modem
+                    || packet.type == PacketTypes.Hardware || packet.type == PacketTypes.Duplicates ? null : packet;
                 if (!corrupt)
                     Task.Run(() => _dataStore?.RecordPacket(packet));
                 
@@ -563,9 +594,15 @@ Arguments:
 
         public static void SendPing(byte packetUID)
         {
-            uint timestamp = (uint)DateTimeOffset.Now.ToUnixTimeSeconds();
+            var now = DateTimeOffset.Now;
+            uint timestamp = (uint)now.ToUnixTimeSeconds();
+            // Stations sync to the millisecond. The zero is the delay, which each relay adds its hold time to.
+            // Then the hop count, which each relay increments - zero tells a station it heard us directly.
             byte[] ping = Encoding.ASCII.GetBytes("P0#" + _callSign)
                 .Concat(BitConverter.GetBytes(timestamp))
+                .Concat(BitConverter.GetBytes((ushort)now.Millisecond))
+                .Concat(BitConverter.GetBytes((ushort)0))
+                .Append((byte)0)
                 .ToArray();
             //ping[0] |= 0x80; // Demand relay
             ping[1] = 0x00; //Addressed to all stations (any station which is set to relay commands will also relay the ping).
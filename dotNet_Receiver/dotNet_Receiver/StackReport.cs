@@ -0,0 +1,154 @@
+﻿using core_Receiver.Packets;
+using System;
+using System.Collections.Generic;
+using System.Data.SQLite;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace core_Receiver
+{
+    /// <summary>
+    /// --stackReport: the stack low water marks in the local database (QS responses and crash dumps), by firmware version.
+    /// Crash dumps don't say what version they're from, so they go against the last version the station reported.
+    /// </summary>
+    static class StackReport
+    {
+        class VersionStats
+        {
+            public string Version;
+            public Version VersionNumber;
+            public HashSet<byte> Stations = new HashSet<byte>();
+            public int Queries;
+            public int Crashes;
+            public ushort[] LowWater = new ushort[0];
+
+            public void AddLowWater(ushort[] lowWater)
+            {
+                if (lowWater.Length > LowWater.Length)
+                {
+                    var longer = Enumerable.Repeat((ushort)0xFFFF, lowWater.Length).ToArray();
+                    LowWater.CopyTo(longer, 0);
+                    LowWater = longer;
+                }
+                for (int i = 0; i < lowWater.Length; i++)
+                    LowWater[i] = Math.Min(LowWater[i], lowWater[i]);
+            }
+        }
+
+        public static void Generate(string dbFn, TextWriter output)
+        {
+            var csb = new SQLiteConnectionStringBuilder
+            {
+                DataSource = dbFn,
+                ReadOnly = true
+            };
+            using var dbConn = new SQLiteConnection(csb.ToString());
+            dbConn.Open();
+            using var cmd = dbConn.CreateCommand();
+            cmd.CommandText = "SELECT Timestamp, Station_ID, Type, Data FROM All_Packets " +
+                "WHERE Data IS NOT NULL AND Type IN ($Response, $StackDump) ORDER BY Timestamp";
+            cmd.Parameters.AddWithValue("$Response", (byte)PacketTypes.Response);
+            cmd.Parameters.AddWithValue("$StackDump", (byte)PacketTypes.StackDump);
+
+            var stats = new Dictionary<string, VersionStats>();
+            var lastVersion = new Dictionary<byte, QueryResponse>();
+            VersionStats GetStats(QueryResponse response)
+            {
+                string version = response?.Version ?? "Unknown";
+                if (!stats.TryGetValue(version, out var ret))
+                {
+                    ret = new VersionStats { Version = version, VersionNumber = response?.VersionNumber };
+                    stats.Add(version, ret);
+                }
+                return ret;
+            }
+
+            using var reader = cmd.ExecuteReader();
+            while (reader.Read())
+            {
+                var timestamp = DateTimeOffset.FromUnixTimeSeconds(reader.GetInt64(0));
+                var station = (byte)reader.GetInt64(1);
+                var type = (PacketTypes)reader.GetInt64(2);
+                var data = (byte[])reader[3];
+                if (type == PacketTypes.StackDump)
+                {
+                    // The receiver used to store just the dump, without the packet header. Those don't have low water marks.
+                    StackDump dump = null;
+                    if (data.Length > 4 && data[0] == 'X' && (data[1] & 0x7F) == (byte)PacketTypes.StackDump)
+                        dump = PacketDecoder.DecodeBytes(data, timestamp)?.packetData as StackDump;
+                    lastVersion.TryGetValue(station, out var response);
+                    var versionStats = GetStats(response);
+                    versionStats.Crashes++;
+                    versionStats.Stations.Add(station);
+                    if (dump?.LowWater != null)
+                        versionStats.AddLowWater(dump.LowWater);
+                }
+                else
+                {
+                    Packet packet;
+                    try
+                    {
+                        packet = PacketDecoder.DecodeBytes(data, timestamp);
+                    }
+                    catch
+                    {
+                        continue;
+                    }
+                    if (!(packet?.packetData is QueryResponse response))
+                        continue;
+                    lastVersion[station] = response;
+                    if (response is QueryStackResponse stackResponse)
+                    {
+                        var versionStats = GetStats(response);
+                        versionStats.Queries++;
+                        versionStats.Stations.Add(station);
+                        versionStats.AddLowWater(stackResponse.LowWater);
+                    }
+                }
+            }
+
+            if (stats.Count == 0)
+            {
+                output.WriteLine("No stack queries or crash dumps found.");
+                return;
+            }
+
+            // Oldest first, each compared with the one before
+            var ordered = stats.Values
+                .OrderBy(s => s.VersionNumber ?? new Version(0, 0))
+                .ThenBy(s => s.Version)
+                .ToList();
+            int sectionCount = Math.Max(QueryStackResponse.StackSections.Length, ordered.Max(s => s.LowWater.Length));
+            string LowWaterCell(ushort[] lowWater, int i)
+                => i < lowWater.Length && lowWater[i] != 0xFFFF ? lowWater[i].ToString() : "-";
+
+            output.WriteLine("Bytes of stack canary left under each section (least seen). Lower is closer to the heap.");
+            var header = new StringBuilder($"{"Version",-24}{"Stations",9}{"Queries",8}{"Crashes",8}");
+            for (int i = 0; i < sectionCount; i++)
+                header.Append($"{QueryStackResponse.SectionName(i),12}");
+            output.WriteLine(header);
+
+            VersionStats previous = null;
+            foreach (var s in ordered)
+            {
+                var line = new StringBuilder($"{s.Version,-24}{s.Stations.Count,9}{s.Queries,8}{s.Crashes,8}");
+                for (int i = 0; i < sectionCount; i++)
+                    line.Append($"{LowWaterCell(s.LowWater, i),12}");
+                output.WriteLine(line);
+                if (previous != null)
+                {
+                    var change = new StringBuilder($"{"  vs " + previous.Version,-49}");
+                    for (int i = 0; i < sectionCount; i++)
+                    {
+                        bool have = i < s.LowWater.Length && s.LowWater[i] != 0xFFFF;
+                        bool hadBefore = i < previous.LowWater.Length && previous.LowWater[i] != 0xFFFF;
+                        change.Append(have && hadBefore ? $"{s.LowWater[i] - previous.LowWater[i],12:+0;-0;0}" : $"{"",12}");
+                    }
+                    output.WriteLine(change);
+                }
+                previous = s;
+            }
+        }
+    }
+}